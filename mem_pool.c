@@ -2,9 +2,23 @@
  * Created by Ivo Georgiev on 2/9/16.
  */
 
+#define _DEFAULT_SOURCE // for MAP_ANONYMOUS and madvise()
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h> // for UINT_MAX
+#include <string.h> // for memcpy()
 #include <assert.h>
 #include <stdio.h> // for perror()
+#include <time.h> // for clock_gettime()
+#include <errno.h> // for EOWNERDEAD
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h> // for sysconf()
+#include <fcntl.h> // for open()
+#include <sys/mman.h>
+#include <sys/stat.h> // for fstat()
+#include <sys/file.h> // for flock()
 
 #include "mem_pool.h"
 
@@ -24,9 +38,42 @@ static const unsigned   MEM_NODE_HEAP_INIT_CAPACITY     = 40;
 static const float      MEM_NODE_HEAP_FILL_FACTOR       = 0.75;
 static const unsigned   MEM_NODE_HEAP_EXPAND_FACTOR     = 2;
 
-static const unsigned   MEM_GAP_IX_INIT_CAPACITY        = 40;
-static const float      MEM_GAP_IX_FILL_FACTOR          = 0.75;
-static const unsigned   MEM_GAP_IX_EXPAND_FACTOR        = 2;
+#define                 MEM_NODE_HEAP_MAX_CHUNKS        32 // the heap grows by chunks, never moves
+#define                 MEM_NODE_PENDING                2 // allocated of a node a batch is freeing
+#define                 MEM_NODE_MAGIC                  0x6d656d6eu // marks every node of the node heap
+#define                 MEM_MAX_ARENAS                  32 // regions of a growable pool, pool.mem first
+
+#define                 MEM_GAP_NUM_CLASSES             64 // one per power of two of size_t
+
+#define                 MEM_TLSF_SL_LOG2                4
+#define                 MEM_TLSF_SL_COUNT               (1 << MEM_TLSF_SL_LOG2)
+#define                 MEM_TLSF_FL_COUNT               (64 - MEM_TLSF_SL_LOG2 + 1)
+
+#define                 MEM_BUDDY_MIN_ORDER             4 // smallest block holds a buddy_link_t
+#define                 MEM_BUDDY_NUM_ORDERS            64
+#define                 MEM_BUDDY_ALLOCATED             0x80 // flag in the block map
+
+#define                 MEM_TAG_SIZE                    sizeof(size_t) // one header, one footer
+#define                 MEM_TAG_ALIGN                   16 // block sizes and payload addresses
+#define                 MEM_TAG_MIN_BLOCK               32 // tags plus a tag_link_t
+#define                 MEM_TAG_ALLOCATED               1 // flag in the low bit of a tag
+
+#define                 MEM_CACHE_GRAIN                 16 // cached sizes are multiples of this
+#define                 MEM_CACHE_NUM_CLASSES           16 // so at most 256 bytes are cached
+#define                 MEM_CACHE_MAX_BATCH             64
+
+#define                 MEM_LF_INDEX_MASK               0xffffffffu // of the free stack head
+
+#define                 MEM_MAP_RELEASE_MIN             (128 * 1024) // default smallest gap given back
+#define                 MEM_MAP_HUGE_PAGE               (2 * 1024 * 1024)
+
+#define                 MEM_FILE_MAGIC                  "MEMPOOL" // 8 bytes, with the terminator
+#define                 MEM_FILE_VERSION                1
+#define                 MEM_FILE_HEADER_SIZE            4096 // pool.mem starts this far into the file
+
+#define                 MEM_TRACE_MAGIC                 "MEMTRACE" // 8 bytes, without the terminator
+#define                 MEM_TRACE_VERSION               1
+#define                 MEM_TRACE_MAX_THREADS           65536 // numbered in the 16 bits of an event
 
 
 
@@ -44,21 +91,144 @@ typedef struct _node {
     alloc_t alloc_record;
     unsigned used;
     unsigned allocated;
+    unsigned magic; // MEM_NODE_MAGIC, checked with the handle of the node
+    atomic_uchar cached; // held by a thread cache, marked without the pool lock
     struct _node *next, *prev; // doubly-linked list for gap deletion
+                               // (unused nodes: next links the free node stack)
+    union { // gap index links of gap nodes, alignment of allocated ones
+        size_t alignment; // that compaction must keep, 0 if none
+        struct {
+            struct _node *left, *right; // tree links (FIRST_FIT, BEST_FIT)
+            int height;
+        };
+        struct {
+            struct _node *class_next, *class_prev; // size class list (FAST_FIT, TLSF_FIT)
+        };
+    };
 } node_t, *node_pt;
 
-typedef struct _gap {
+typedef struct _buddy_link {
+    struct _buddy_link *next, *prev; // free list of an order, kept in the free block itself
+} buddy_link_t, *buddy_link_pt;
+
+typedef struct _tag_link {
+    size_t next, prev; // free list of a size class, as offsets in pool.mem (0 for none)
+} tag_link_t, *tag_link_pt;
+
+// a region of a growable pool, its nodes are a run of the node list that
+// starts with head, gaps never merge across arenas
+typedef struct _mem_arena {
+    char *mem;
     size_t size;
-    node_pt node;
-} gap_t, *gap_pt;
+    size_t map_size; // 0 if the arena is on the heap
+    node_pt head; // node at mem, never put back on the free node stack
+} mem_arena_t, *mem_arena_pt;
+
+typedef struct _tag_lists {
+    size_t classes[MEM_GAP_NUM_CLASSES]; // free block offsets by power of two
+    uint64_t class_map; // bit c set iff classes[c] is non-empty
+    unsigned long counts[MEM_GAP_NUM_CLASSES]; // free blocks by power of two
+} tag_lists_t, *tag_lists_pt;
+
+// the start of the file (or shared memory object) of a persistent pool,
+// pool.mem follows it; the free lists live here and are offsets in pool.mem,
+// the counts are saved here when the pool is closed, or for a shared pool
+// every time its lock is released
+typedef struct _mem_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t clean; // 1 if the counts below are the pool's, 0 while it is open
+    uint32_t shared; // 1 if processes use the pool at once, under the lock below
+    pthread_mutex_t lock; // shared pools: process-shared and robust
+    size_t size; // bytes of pool.mem in the file
+    size_t root; // payload offset of the root allocation in pool.mem, 0 for none
+    size_t tag_first;
+    size_t total_size;
+    size_t alloc_size;
+    unsigned num_allocs;
+    unsigned num_gaps;
+    tag_lists_t tag_lists;
+} mem_file_header_t, *mem_file_header_pt;
+
+// a thread's trace events, written by the thread only: event i is at
+// events[i & mask], the latest mask + 1 are kept
+typedef struct _mem_trace_ring {
+    struct _mem_trace_ring *next; // rings of all threads (under the trace lock)
+    unsigned thread;
+    size_t mask;
+    atomic_ulong head; // events written so far
+    trace_event_t events[];
+} mem_trace_ring_t, *mem_trace_ring_pt;
+
+// segments stored by a walk, up to capacity, all of them counted
+typedef struct _mem_segment_buffer {
+    pool_segment_pt segments;
+    unsigned capacity;
+    unsigned count;
+} mem_segment_buffer_t, *mem_segment_buffer_pt;
+
+struct _pool_mgr;
+
+// a thread's cache of one pool: per size class, a stack of up to two batches
+// of allocations that the pool still counts as allocated
+typedef struct _mem_cache {
+    _Atomic(struct _pool_mgr *) pool_mgr; // NULL once the pool is closed
+    struct _mem_cache *pool_next; // caches of the same pool (under the pool lock)
+    struct _mem_cache *thread_next; // caches of the same thread
+    unsigned batch;
+    unsigned counts[MEM_CACHE_NUM_CLASSES];
+    atomic_ulong hits, misses, flushes; // written by the owner thread only
+    void *slots[]; // MEM_CACHE_NUM_CLASSES rows of 2 * batch
+} mem_cache_t, *mem_cache_pt;
 
 typedef struct _pool_mgr {
     pool_t pool;
-    node_pt node_heap;
+    pthread_mutex_t lock; // held by every call on the pool
+    size_t cache_max_size; // 0 if the pool has no thread caches
+    unsigned cache_batch; // allocations moved per refill or flush
+    mem_cache_pt caches; // thread caches of the pool
+    _Atomic uint64_t *cache_map; // BUDDY_FIT, SLAB_FIT and TAGGED_FIT: bit per unit held by a cache
+    unsigned long cache_hits, cache_misses, cache_flushes; // of caches already released
+    unsigned long gap_counts[MEM_GAP_NUM_CLASSES]; // node policies and BUDDY_FIT: gaps by power of two
+    unsigned locked_num_allocs; // num_allocs when the pool was locked
+    unsigned long total_allocs, total_frees; // counted when the pool is unlocked
+    size_t peak_alloc_size; // kept when the pool is unlocked
+    atomic_ulong failed_allocs; // allocation calls that returned null or failed
+    unsigned trace_id; // number of the pool in traces
+    node_pt node_heap[MEM_NODE_HEAP_MAX_CHUNKS]; // chunks, handles stay valid as it grows
+    node_pt node_list; // first node of the node list, the one at pool.mem
+    node_pt compact_cursor; // gap the last compaction stopped at, NULL to start from node_list
+    atomic_uint num_chunks; // read without the lock by thread caches checking handles
     unsigned total_nodes;
     unsigned used_nodes;
-    gap_pt gap_ix;
-    unsigned gap_ix_capacity;
+    node_pt free_nodes; // stack of unused nodes, linked through next
+    size_t arena_size; // growable pools: smallest arena added, 0 if the pool cannot grow
+    mem_arena_t arenas[MEM_MAX_ARENAS]; // growable pools: arena 0 is pool.mem
+    unsigned num_arenas;
+    node_pt gap_ix; // root of an AVL tree of gap nodes, keyed on (size, mem)
+    node_pt gap_classes[MEM_GAP_NUM_CLASSES]; // FAST_FIT: gap lists by power of two
+    uint64_t gap_class_map; // FAST_FIT: bit c set iff gap_classes[c] is non-empty
+    node_pt tlsf_lists[MEM_TLSF_FL_COUNT][MEM_TLSF_SL_COUNT]; // TLSF_FIT: two-level gap lists
+    uint64_t tlsf_fl_map; // TLSF_FIT: bit f set iff tlsf_sl_map[f] is non-zero
+    uint32_t tlsf_sl_map[MEM_TLSF_FL_COUNT]; // TLSF_FIT: bit s set iff tlsf_lists[f][s] is non-empty
+    unsigned char *buddy_map; // BUDDY_FIT: per min block, order | allocated at block starts, 0 inside
+    buddy_link_pt buddy_free[MEM_BUDDY_NUM_ORDERS]; // BUDDY_FIT: free lists by order
+    uint64_t buddy_free_map; // BUDDY_FIT: bit k set iff buddy_free[k] is non-empty
+    char *slab_free; // SLAB_FIT: free slot list, each free slot holds the next one
+    size_t slab_slot_size; // SLAB_FIT: object size rounded up to hold a pointer
+    size_t slab_object_size; // SLAB_FIT: object size the slab was opened with
+    uint64_t *slab_map; // SLAB_FIT: bit i set iff slot i is allocated
+    size_t mem_alignment; // base alignment of pool.mem and of any arenas
+    size_t map_size; // bytes mapped at pool.mem, 0 if pool.mem is on the heap
+    size_t map_page; // mapped pools: pages are given back in units of this
+    size_t map_release_min; // mapped pools: gaps of at least this are given back to the OS
+    mem_file_header_pt file; // persistent pools: the mapped file, map_size bytes, NULL otherwise
+    int file_fd; // persistent pools not shared: the file, locked while open, -1 otherwise
+    _Atomic uint64_t lf_head; // ATOMIC_SLAB_FIT: free slot stack, ABA tag << 32 | slot index + 1
+    atomic_uchar *lf_state; // ATOMIC_SLAB_FIT: per slot, 1 if allocated
+    size_t tag_first; // TAGGED_FIT: offset of the first block header in pool.mem
+    tag_lists_pt tag_lists; // TAGGED_FIT: tag_lists_store, or the file header of a persistent pool
+    tag_lists_t tag_lists_store; // TAGGED_FIT: free lists of a pool in memory
 } pool_mgr_t, *pool_mgr_pt;
 
 
@@ -71,6 +241,20 @@ typedef struct _pool_mgr {
 static pool_mgr_pt *pool_store = NULL; // an array of pointers, only expand
 static unsigned pool_store_size = 0;
 static unsigned pool_store_capacity = 0;
+static pthread_mutex_t pool_store_lock = PTHREAD_MUTEX_INITIALIZER; // guards the three above
+                                                                    // and the detaching of caches
+static _Thread_local mem_cache_pt thread_caches = NULL; // caches of the calling thread
+static pthread_key_t thread_caches_key; // releases the caches when the thread exits
+static pthread_once_t thread_caches_once = PTHREAD_ONCE_INIT;
+static unsigned trace_num_pools = 0; // pools opened so far (under the pool store lock)
+static atomic_int trace_on = 0; // checked by every traced call
+static atomic_uint trace_generation = 0; // bumped by mem_trace_start, rings of older ones are gone
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER; // guards the three below
+static mem_trace_ring_pt trace_rings = NULL;
+static unsigned trace_num_threads = 0;
+static size_t trace_capacity = 0; // events per ring, a power of two
+static _Thread_local mem_trace_ring_pt thread_ring = NULL; // ring of the calling thread
+static _Thread_local unsigned thread_ring_generation = 0; // thread_ring is good if it is current
 
 
 
@@ -80,8 +264,43 @@ static unsigned pool_store_capacity = 0;
 /*                                          */
 /********************************************/
 static alloc_status _mem_resize_pool_store();
-static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr);
-static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr);
+static alloc_status _mem_register_pool(pool_mgr_pt pool_mgr);
+static void _mem_release_pool(pool_mgr_pt pool_mgr);
+static char * _mem_new_region(pool_mgr_pt pool_mgr, size_t size, size_t *map_size);
+static void _mem_free_region(char *mem, size_t map_size);
+static node_pt _mem_grow(pool_mgr_pt pool_mgr, size_t size);
+static void _mem_shrink(pool_mgr_pt pool_mgr, node_pt gap);
+static unsigned _mem_arena_of(pool_mgr_pt pool_mgr, node_pt node);
+static void _mem_release_pages(pool_mgr_pt pool_mgr, char *gap, size_t gap_size, char *lo, char *hi);
+static alloc_status _mem_file_map(pool_mgr_pt pool_mgr, const char *path, size_t size, int shm);
+static void _mem_file_save(pool_mgr_pt pool_mgr, uint32_t clean);
+static pool_pt _mem_reopen(const char *path, int shm);
+static void _mem_lock(pool_mgr_pt pool_mgr);
+static void _mem_unlock(pool_mgr_pt pool_mgr);
+static void _mem_count_failed(pool_mgr_pt pool_mgr);
+static size_t _mem_largest_gap(pool_mgr_pt pool_mgr);
+static void _mem_trace(pool_mgr_pt pool_mgr, trace_op op, const void *handle, size_t size, size_t arg);
+static mem_trace_ring_pt _mem_trace_ring();
+static void * _mem_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_free(pool_mgr_pt pool_mgr, void *alloc);
+static alloc_status _mem_alloc_n(pool_mgr_pt pool_mgr, size_t size, unsigned n, void *allocs[]);
+static alloc_status _mem_free_n(pool_mgr_pt pool_mgr, unsigned n, void *allocs[]);
+static void * _mem_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size);
+static void * _mem_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static void * _mem_node_alloc(pool_mgr_pt pool_mgr, size_t size);
+static void * _mem_node_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static alloc_status _mem_node_alloc_n(pool_mgr_pt pool_mgr, size_t size, unsigned n, void *allocs[]);
+static alloc_status _mem_node_free_n(pool_mgr_pt pool_mgr, unsigned n, void *allocs[]);
+static alloc_status _mem_node_free(pool_mgr_pt pool_mgr, void *alloc);
+static void * _mem_node_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size);
+static alloc_status _mem_node_compact(pool_mgr_pt pool_mgr, size_t budget);
+static unsigned _mem_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg);
+static int _mem_segment_store(const pool_segment_t *segment, void *buffer);
+static unsigned _mem_node_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg);
+static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr, unsigned needed);
+static node_pt _mem_find_node(pool_mgr_pt pool_mgr, void *alloc);
+static node_pt _mem_get_node(pool_mgr_pt pool_mgr);
+static void _mem_put_node(pool_mgr_pt pool_mgr, node_pt node);
 static alloc_status
         _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
                            size_t size,
@@ -90,8 +309,57 @@ static alloc_status
         _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr,
                                 size_t size,
                                 node_pt node);
-static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr);
-static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr);
+static node_pt _mem_find_gap(pool_mgr_pt pool_mgr, size_t size);
+static node_pt _mem_split_node(pool_mgr_pt pool_mgr, node_pt node, size_t rem_gap);
+static node_pt _mem_find_best_gap(pool_mgr_pt pool_mgr, size_t size);
+static node_pt _mem_find_fast_gap(pool_mgr_pt pool_mgr, size_t size);
+static unsigned _mem_gap_class(size_t size);
+static node_pt _mem_find_tlsf_gap(pool_mgr_pt pool_mgr, size_t size);
+static void _mem_tlsf_mapping(size_t size, unsigned *fl, unsigned *sl);
+static void _mem_gap_list_push(node_pt *head, node_pt node);
+static alloc_status _mem_buddy_init(pool_mgr_pt pool_mgr);
+static void * _mem_buddy_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_buddy_free(pool_mgr_pt pool_mgr, void *alloc);
+static unsigned _mem_buddy_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg);
+static void _mem_buddy_push(pool_mgr_pt pool_mgr, size_t offset, unsigned order);
+static void _mem_buddy_unlink(pool_mgr_pt pool_mgr, size_t offset, unsigned order);
+static void * _mem_slab_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_tag_init(pool_mgr_pt pool_mgr);
+static void * _mem_tag_alloc(pool_mgr_pt pool_mgr, size_t size);
+static void * _mem_tag_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment);
+static alloc_status _mem_tag_free(pool_mgr_pt pool_mgr, void *alloc);
+static unsigned _mem_tag_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg);
+static void _mem_tag_push(pool_mgr_pt pool_mgr, size_t offset, size_t size);
+static void _mem_tag_unlink(pool_mgr_pt pool_mgr, size_t offset, size_t size);
+static alloc_status _mem_tag_rebuild(pool_mgr_pt pool_mgr);
+static alloc_status _mem_slab_free(pool_mgr_pt pool_mgr, void *alloc);
+static unsigned _mem_slab_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg);
+static void * _mem_lf_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_lf_free(pool_mgr_pt pool_mgr, void *alloc);
+static unsigned _mem_lf_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg);
+static void * _mem_cache_alloc(pool_mgr_pt pool_mgr, size_t size);
+static alloc_status _mem_cache_free(pool_mgr_pt pool_mgr, void *alloc);
+static mem_cache_pt _mem_cache_get(pool_mgr_pt pool_mgr);
+static size_t _mem_cache_round(pool_mgr_pt pool_mgr, size_t size);
+static size_t _mem_cache_size_of(pool_mgr_pt pool_mgr, void *alloc);
+static int _mem_cache_class(pool_mgr_pt pool_mgr, size_t size);
+static void _mem_cache_drain(pool_mgr_pt pool_mgr, mem_cache_pt cache);
+static size_t _mem_cache_unit(pool_mgr_pt pool_mgr, void *alloc, size_t *units);
+static int _mem_cache_mark(pool_mgr_pt pool_mgr, void *alloc, int held);
+static int _mem_cache_held(pool_mgr_pt pool_mgr, void *alloc);
+static void _mem_cache_thread_exit(void *caches);
+static void _mem_cache_key_create();
+static void _mem_cache_count(atomic_ulong *counter);
+static alloc_status _mem_gap_list_unlink(node_pt *head, node_pt node);
+static int _mem_gap_cmp(size_t size, const char *mem, node_pt node);
+static int _mem_gap_height(node_pt node);
+static void _mem_gap_update(node_pt node);
+static node_pt _mem_gap_rotate_left(node_pt node);
+static node_pt _mem_gap_rotate_right(node_pt node);
+static node_pt _mem_gap_rebalance(node_pt node);
+static node_pt _mem_gap_insert(node_pt root, node_pt node);
+static node_pt _mem_gap_remove_min(node_pt root, node_pt *min);
+static node_pt _mem_gap_remove(node_pt root, node_pt node, int *found);
 
 
 /****************************************/
@@ -104,6 +372,10 @@ alloc_status mem_init()
     // ensure that it's called only once until mem_free
     // allocate the pool store with initial capacity
     // note: holds pointers only, other functions to allocate/deallocate
+    // note: the pool store is shared by all threads, hold its lock throughout
+    alloc_status status = ALLOC_CALLED_AGAIN;
+
+    pthread_mutex_lock(&pool_store_lock);
 
     // first check if pool_store == NULL
     if(pool_store == NULL)
@@ -115,13 +387,22 @@ alloc_status mem_init()
          *
          */
         pool_store = (pool_mgr_pt*) calloc(MEM_POOL_STORE_INIT_CAPACITY, sizeof(pool_mgr_pt));
-        pool_store_capacity = MEM_POOL_STORE_INIT_CAPACITY;
-        pool_store_size = 0;
-
-        return ALLOC_OK;
+        if(pool_store == NULL)
+        {
+            status = ALLOC_FAIL;
+        }
+        else
+        {
+            pool_store_capacity = MEM_POOL_STORE_INIT_CAPACITY;
+            pool_store_size = 0;
+            status = ALLOC_OK;
+        }
     }
     // non-empty, which means it has already been called
-    return ALLOC_CALLED_AGAIN;
+
+    pthread_mutex_unlock(&pool_store_lock);
+
+    return status;
 }
 
 alloc_status mem_free()
@@ -130,10 +411,13 @@ alloc_status mem_free()
     // make sure all pool managers have been deallocated
     // can free the pool store array
     // update static variables
+    // note: the pool store is shared by all threads, hold its lock throughout
+    pthread_mutex_lock(&pool_store_lock);
 
     // first check if pool_store == NULL
     if(pool_store == NULL)
     {
+        pthread_mutex_unlock(&pool_store_lock);
         return ALLOC_CALLED_AGAIN;
     }
     /* pool_store is an array of pointers
@@ -144,6 +428,7 @@ alloc_status mem_free()
         // if not null we fail
         if(pool_store[i] != NULL)
         {
+            pthread_mutex_unlock(&pool_store_lock);
             return ALLOC_FAIL;
         }
 
@@ -155,38 +440,59 @@ alloc_status mem_free()
     // update static variables
     pool_store_size = 0;
     pool_store_capacity = 0;
+
+    pthread_mutex_unlock(&pool_store_lock);
     return ALLOC_OK;
 }
 
 pool_pt mem_pool_open(size_t size, alloc_policy policy) {
-    // make sure there the pool store is allocated
-    // expand the pool store, if necessary
+    // open the pool with the default options
+    return mem_pool_open_opts(size, policy, NULL);
+}
+
+pool_pt mem_pool_open_opts(size_t size, alloc_policy policy, const pool_options_t *options) {
+    // check the policy and the options, the slab pools have their own
+    //   open calls, a base alignment must be a power of two, only the
+    //   node policies can grow, only TAGGED_FIT pools persist or are shared
     // allocate a new mem pool mgr
     // check success, on error return null
-    // allocate a new memory pool
+    // initialize the pool lock
+    // allocate a new memory pool, at the base alignment if there is one,
+    //   mapped if the options ask for it, in a new file if persistent,
+    //   in a new shared memory object if shared
     // check success, on error deallocate mgr and return null
+    // if BUDDY_FIT or TAGGED_FIT, set up the engine instead, save the
+    //   header of a persistent pool (with the lock of a shared one),
+    //   link and return
     // allocate a new node heap
     // check success, on error deallocate mgr/pool and return null
-    // allocate a new gap index
-    // check success, on error deallocate mgr/pool/heap and return null
     // assign all the pointers and update meta data:
     //   initialize top node of node heap
-    //   initialize top node of gap index
     //   initialize pool mgr
-    //   link pool mgr to pool store
+    //   stack the rest of the node heap as unused
+    //   initialize the gap index with the top node
+    //   if the pool can grow, make pool.mem its first arena
+    // link pool mgr to pool store (it must be allocated), on error deallocate all
     // return the address of the mgr, cast to (pool_pt)
 
-    // check to see if pool store needs to be allocated
-    // we don't need to do anything unless ALLOC_FAIL returned
-
-    if(pool_store == NULL)
+    // check the policy and the options, the slab pools have their own
+    //   open calls, a base alignment must be a power of two, only the
+    //   node policies can grow, only TAGGED_FIT pools persist or are shared
+    size_t alignment = (options != NULL) ? options->alignment : 0;
+    size_t arena_size = (options != NULL) ? options->arena_size : 0;
+    const char *path = (options != NULL) ? options->path : NULL;
+    const char *shm_name = (options != NULL) ? options->shm_name : NULL;
+    if(policy == SLAB_FIT || policy == ATOMIC_SLAB_FIT
+       || (alignment & (alignment - 1)) != 0
+       || (arena_size != 0 && policy != FIRST_FIT && policy != BEST_FIT
+           && policy != FAST_FIT && policy != TLSF_FIT)
+       || (path != NULL && shm_name != NULL)
+       || ((path != NULL || shm_name != NULL)
+           && (policy != TAGGED_FIT || options->huge_pages || alignment > MEM_FILE_HEADER_SIZE)))
     {
         return NULL;
     }
 
-
-    _mem_resize_pool_store();
-
     // allocate a new mem pool mgr
     pool_mgr_pt mem_mgr = (pool_mgr_pt ) calloc(1, sizeof(pool_mgr_t));
     // check if successful
@@ -195,82 +501,342 @@ pool_pt mem_pool_open(size_t size, alloc_policy policy) {
         return NULL;
     }
 
-    // allocate new memory pool
-    mem_mgr->pool.mem = (char*) calloc(size, sizeof(char));
+    // initialize the pool lock
+    pthread_mutex_init(&mem_mgr->lock, NULL);
+
+    // allocate new memory pool, at the base alignment if there is one,
+    //   mapped if the options ask for it, in a new file if persistent,
+    //   in a new shared memory object if shared
+    // note: pages of a file are not given back, they would only be read in again
+    mem_mgr->mem_alignment = alignment;
+    if(path != NULL || shm_name != NULL)
+    {
+        mem_mgr->map_release_min = SIZE_MAX;
+        _mem_file_map(mem_mgr, (path != NULL) ? path : shm_name, size, path == NULL);
+    }
+    else
+    {
+        if(options != NULL && (options->use_mmap || options->huge_pages))
+        {
+            mem_mgr->map_release_min = (options->release_min != 0) ? options->release_min : MEM_MAP_RELEASE_MIN;
+            mem_mgr->map_page = options->huge_pages ? MEM_MAP_HUGE_PAGE : (size_t) sysconf(_SC_PAGESIZE);
+        }
+        mem_mgr->pool.mem = _mem_new_region(mem_mgr, size, &mem_mgr->map_size);
+    }
     mem_mgr->pool.num_allocs = 0;
     mem_mgr->pool.policy = policy;
-    mem_mgr->pool.num_gaps = 1;
+    mem_mgr->pool.num_gaps = 0;
     mem_mgr->pool.alloc_size = 0;
     mem_mgr->pool.total_size = size;
 
     // check if successful
-    if(&mem_mgr->pool.mem == NULL)
+    if(mem_mgr->pool.mem == NULL)
     {
-        free(mem_mgr);
+        _mem_release_pool(mem_mgr);
         return NULL;
     }
 
+    // if BUDDY_FIT, the pool gets a block map and free lists instead of
+    // a node heap, if TAGGED_FIT, boundary tags and free lists in the pool
+    // itself, then link pool mgr to pool store
+    if(policy == BUDDY_FIT || policy == TAGGED_FIT)
+    {
+        alloc_status status = (policy == BUDDY_FIT)
+                              ? _mem_buddy_init(mem_mgr)
+                              : _mem_tag_init(mem_mgr);
+        if(status == ALLOC_FAIL || _mem_register_pool(mem_mgr) == ALLOC_FAIL)
+        {
+            _mem_release_pool(mem_mgr);
+            return NULL;
+        }
+
+        // the header of a persistent pool, marked open, with a lock
+        //   for the processes of a shared one
+        if(mem_mgr->file != NULL)
+        {
+            if(shm_name != NULL)
+            {
+                pthread_mutexattr_t attr;
+                pthread_mutexattr_init(&attr);
+                pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+                pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+                pthread_mutex_init(&mem_mgr->file->lock, &attr);
+                pthread_mutexattr_destroy(&attr);
+                mem_mgr->file->shared = 1;
+            }
+            _mem_file_save(mem_mgr, 0);
+        }
+
+        return (pool_pt)mem_mgr;
+    }
 
-    // allocate new node heap
-    mem_mgr->node_heap = (node_pt) calloc(MEM_NODE_HEAP_INIT_CAPACITY, sizeof(node_t));
+    // allocate new node heap (its first chunk)
+    mem_mgr->node_heap[0] = (node_pt) calloc(MEM_NODE_HEAP_INIT_CAPACITY, sizeof(node_t));
     // check if successful
-    if(mem_mgr->node_heap == NULL)
+    if(mem_mgr->node_heap[0] == NULL)
     {
         // free pool and mem mgr
-        free(mem_mgr->pool.mem);
-        free(mem_mgr);
+        _mem_release_pool(mem_mgr);
+        return NULL;
+    }
+
+    // initialize top node of node heap
+    mem_mgr->node_heap[0][0].allocated = 0;
+    mem_mgr->node_heap[0][0].next = NULL;
+    mem_mgr->node_heap[0][0].prev = NULL;
+    mem_mgr->node_heap[0][0].used = 1;
+    mem_mgr->node_heap[0][0].magic = MEM_NODE_MAGIC;
+    mem_mgr->node_heap[0][0].alloc_record.size = size;
+    mem_mgr->node_heap[0][0].alloc_record.mem = mem_mgr->pool.mem;
+
+    // initialize pool mgr
+    mem_mgr->num_chunks = 1;
+    mem_mgr->total_nodes = MEM_NODE_HEAP_INIT_CAPACITY;
+    mem_mgr->used_nodes = 1;
+    mem_mgr->gap_ix = NULL;
+
+    // stack the rest of the node heap as unused, lowest on top
+    mem_mgr->free_nodes = NULL;
+    for(unsigned i = MEM_NODE_HEAP_INIT_CAPACITY - 1; i > 0; i--)
+    {
+        _mem_put_node(mem_mgr, &mem_mgr->node_heap[0][i]);
+    }
+
+    // initialize the gap index with the top node
+    _mem_add_to_gap_ix(mem_mgr, size, mem_mgr->node_heap[0]);
+    mem_mgr->node_list = mem_mgr->node_heap[0];
+
+    // if the pool can grow, pool.mem is its first arena
+    if(arena_size != 0)
+    {
+        mem_mgr->arena_size = arena_size;
+        mem_mgr->arenas[0].mem = mem_mgr->pool.mem;
+        mem_mgr->arenas[0].size = size;
+        mem_mgr->arenas[0].map_size = mem_mgr->map_size;
+        mem_mgr->arenas[0].head = mem_mgr->node_heap[0];
+        mem_mgr->num_arenas = 1;
+    }
+
+    // link pool mgr to pool store (it must be allocated), on error deallocate all
+    if(_mem_register_pool(mem_mgr) == ALLOC_FAIL)
+    {
+        _mem_release_pool(mem_mgr);
+        return NULL;
+    }
+
+    // return the address of the mgr, cast to (pool_pt)
+    return (pool_pt)mem_mgr;
+}
+
+pool_pt mem_slab_open(size_t object_size, size_t count) {
+    // round the object size up to a slot that can hold a pointer
+    // allocate a new mem pool mgr
+    // check success, on error return null
+    // initialize the pool lock
+    // allocate a new memory pool of count slots, and the slot map
+    // check success, on error deallocate mgr and return null
+    // thread the free list through the slots, in address order
+    // initialize pool mgr
+    // link pool mgr to pool store (it must be allocated), on error deallocate all
+    // return the address of the mgr, cast to (pool_pt)
+
+    if(count == 0 || count > UINT_MAX)
+    {
+        return NULL;
+    }
+
+    // round the object size up to a slot that can hold a pointer
+    size_t slot_size = (object_size + sizeof(char *) - 1) & ~(sizeof(char *) - 1);
+    if(slot_size == 0)
+    {
+        slot_size = sizeof(char *);
+    }
+    if(slot_size < object_size || count > SIZE_MAX / slot_size)
+    {
         return NULL;
     }
 
-    // allocate new gap index
-    mem_mgr->gap_ix = (gap_pt) calloc(MEM_GAP_IX_INIT_CAPACITY, sizeof(gap_t));
+    // allocate a new mem pool mgr
+    pool_mgr_pt mem_mgr = (pool_mgr_pt ) calloc(1, sizeof(pool_mgr_t));
     // check if successful
-    if(mem_mgr->gap_ix == NULL)
+    if(mem_mgr == NULL)
     {
-        // free pool and mem mgr and node heap
-        free(mem_mgr->pool.mem);
-        free(mem_mgr->node_heap);
-        free(mem_mgr);
         return NULL;
     }
 
-    // initialize top node of node heap
-    mem_mgr->node_heap[0].allocated = 0;
-    mem_mgr->node_heap[0].next = NULL;
-    mem_mgr->node_heap[0].prev = NULL;
-    mem_mgr->node_heap[0].used = 1;
-    mem_mgr->node_heap[0].alloc_record.size = size;
-    mem_mgr->node_heap[0].alloc_record.mem = mem_mgr->pool.mem;
+    // initialize the pool lock
+    pthread_mutex_init(&mem_mgr->lock, NULL);
+
+    // allocate a new memory pool of count slots, and the slot map
+    mem_mgr->pool.mem = (char*) calloc(count, slot_size);
+    mem_mgr->slab_map = calloc((count + 63) / 64, sizeof(uint64_t));
+    // check if successful
+    if(mem_mgr->pool.mem == NULL || mem_mgr->slab_map == NULL)
+    {
+        _mem_release_pool(mem_mgr);
+        return NULL;
+    }
 
-     // initialize top node of gap index
-    mem_mgr->gap_ix[0].size = size;
-    mem_mgr->gap_ix[0].node = mem_mgr->node_heap;
+    // thread the free list through the slots, in address order
+    for(size_t i = 0; i < count; i++)
+    {
+        char *slot = mem_mgr->pool.mem + i * slot_size;
+        *(char **) slot = (i + 1 < count) ? slot + slot_size : NULL;
+    }
 
     // initialize pool mgr
-    mem_mgr->gap_ix_capacity = MEM_GAP_IX_INIT_CAPACITY;
-    mem_mgr->total_nodes = MEM_NODE_HEAP_INIT_CAPACITY;
-    mem_mgr->used_nodes = 1;
+    mem_mgr->pool.policy = SLAB_FIT;
+    mem_mgr->pool.total_size = count * slot_size;
+    mem_mgr->pool.alloc_size = 0;
+    mem_mgr->pool.num_allocs = 0;
+    mem_mgr->pool.num_gaps = (unsigned) count;
+    mem_mgr->slab_free = mem_mgr->pool.mem;
+    mem_mgr->slab_slot_size = slot_size;
+    mem_mgr->slab_object_size = object_size;
 
-    // link pool mgr to pool store
-    pool_store[pool_store_size] = mem_mgr;
-    // increment pool_store_size
-    pool_store_size++;
+    // link pool mgr to pool store (it must be allocated), on error deallocate all
+    if(_mem_register_pool(mem_mgr) == ALLOC_FAIL)
+    {
+        _mem_release_pool(mem_mgr);
+        return NULL;
+    }
 
     // return the address of the mgr, cast to (pool_pt)
     return (pool_pt)mem_mgr;
 }
 
+pool_pt mem_atomic_slab_open(size_t object_size, size_t count) {
+    // check the slots can be numbered in 32 bits
+    // open a slab pool
+    // allocate the slot states, on error close the pool and return null
+    // thread the free stack through the slots by index, in address order
+    // switch the pool to ATOMIC_SLAB_FIT, the slot states replace the map
+    // return the pool
+
+    // check the slots can be numbered in 32 bits
+    if(count >= MEM_LF_INDEX_MASK)
+    {
+        return NULL;
+    }
+
+    // open a slab pool
+    pool_pt pool = mem_slab_open(object_size, count);
+    if(pool == NULL)
+    {
+        return NULL;
+    }
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+
+    // allocate the slot states, on error close the pool and return null
+    mem_mgr->lf_state = calloc(count, sizeof(atomic_uchar));
+    if(mem_mgr->lf_state == NULL)
+    {
+        mem_pool_close(pool);
+        return NULL;
+    }
+
+    // thread the free stack through the slots by index, in address order
+    // note: a slot holds the index + 1 of the next one, 0 ends the stack
+    for(size_t i = 0; i < count; i++)
+    {
+        char *slot = mem_mgr->pool.mem + i * mem_mgr->slab_slot_size;
+        atomic_init((_Atomic uint32_t *) slot, (i + 1 < count) ? (uint32_t) (i + 2) : 0);
+        atomic_init(&mem_mgr->lf_state[i], 0);
+    }
+    atomic_init(&mem_mgr->lf_head, 1);
+
+    // switch the pool to ATOMIC_SLAB_FIT, the slot states replace the map
+    mem_mgr->slab_free = NULL;
+    free(mem_mgr->slab_map);
+    mem_mgr->slab_map = NULL;
+    mem_mgr->pool.policy = ATOMIC_SLAB_FIT;
+
+    // return the pool
+    return pool;
+}
+
+pool_pt mem_pool_reopen(const char *path) {
+    // reopen the pool in the file
+    return _mem_reopen(path, 0);
+}
+
+pool_pt mem_pool_attach(const char *shm_name) {
+    // reopen the pool in the shared memory object
+    return _mem_reopen(shm_name, 1);
+}
+
+alloc_status mem_pool_set_root(pool_pt pool, void *alloc) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // check the pool is persistent
+    // lock the pool
+    // clear the root, or check the allocation is an allocated payload
+    //   of the pool and record its offset
+    // unlock the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_OK;
+
+    if(mem_mgr->file == NULL)
+    {
+        return ALLOC_FAIL;
+    }
+
+    _mem_lock(mem_mgr);
+
+    uintptr_t addr = (uintptr_t) alloc;
+    uintptr_t first = (uintptr_t) mem_mgr->pool.mem + mem_mgr->tag_first + MEM_TAG_SIZE;
+    if(alloc == NULL)
+    {
+        mem_mgr->file->root = 0;
+    }
+    else if(addr < first || addr >= first + mem_mgr->pool.total_size
+            || (addr - first) % MEM_TAG_ALIGN != 0
+            || !(*(size_t *) (addr - MEM_TAG_SIZE) & MEM_TAG_ALLOCATED))
+    {
+        status = ALLOC_INVALID_HANDLE;
+    }
+    else
+    {
+        mem_mgr->file->root = (size_t) ((char *) alloc - mem_mgr->pool.mem);
+    }
+
+    _mem_unlock(mem_mgr);
+
+    return status;
+}
+
+void * mem_pool_root(pool_pt pool) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // return the root allocation, null if there is none
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+    void *root = NULL;
+
+    if(mem_mgr->file != NULL)
+    {
+        _mem_lock(mem_mgr);
+        if(mem_mgr->file->root != 0)
+        {
+            root = mem_mgr->pool.mem + mem_mgr->file->root;
+        }
+        _mem_unlock(mem_mgr);
+    }
+
+    return root;
+}
+
 alloc_status mem_pool_close(pool_pt pool) {
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
     // check if this pool is allocated
+    // lock the pool store, so that no thread releases its cache meanwhile
+    // return the allocations in thread caches to the pool, detach the caches
     // check if pool has only one gap
     // check if it has zero allocations
-    // free memory pool
-    // free node heap
-    // free gap index
-    // find mgr in pool store and set to null
+    // note: a persistent pool keeps its allocations
+    // find mgr in pool store and set to null, trace the close
     // note: don't decrement pool_store_size, because it only grows
-    // free mgr
+    // unlock the pool store
+    // save the state of a persistent pool in its header, marked closed
+    // free memory pool, node heap chunks and mgr
+    // note: the pool must not be in use by other threads while it is closed
 
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
     pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
@@ -281,28 +847,35 @@ alloc_status mem_pool_close(pool_pt pool) {
         return ALLOC_NOT_FREED;
     }
 
-    // check if pool has only one gap
-    if(mem_mgr->pool.num_gaps != 1)
+    // lock the pool store, so that no thread releases its cache meanwhile
+    pthread_mutex_lock(&pool_store_lock);
+
+    // return the allocations in thread caches to the pool, detach the caches
+    // note: a detached cache is released by its thread
+    _mem_lock(mem_mgr);
+    while(mem_mgr->caches != NULL)
     {
-        return ALLOC_NOT_FREED;
+        mem_cache_pt cache = mem_mgr->caches;
+        mem_mgr->caches = cache->pool_next;
+        _mem_cache_drain(mem_mgr, cache);
+        atomic_store_explicit(&cache->pool_mgr, NULL, memory_order_release);
     }
+    _mem_unlock(mem_mgr);
 
+    // check if pool has only one gap
+    // note: an empty BUDDY_FIT pool is one free block per set bit of its size
+    //       and an empty SLAB_FIT or ATOMIC_SLAB_FIT pool is one gap per slot
     // check if it has zero allocations
-    if(mem_mgr->pool.alloc_size != 0)
+    if(mem_mgr->file == NULL
+       && ((mem_mgr->pool.policy != BUDDY_FIT && mem_mgr->pool.policy != SLAB_FIT
+            && mem_mgr->pool.policy != ATOMIC_SLAB_FIT && mem_mgr->pool.num_gaps != 1)
+           || mem_mgr->pool.num_allocs != 0))
     {
+        pthread_mutex_unlock(&pool_store_lock);
         return ALLOC_NOT_FREED;
     }
 
-    // free memory pool
-    free(mem_mgr->pool.mem);
-
-    // free node heap
-    free(mem_mgr->node_heap);
-
-    // free gap index
-    free(mem_mgr->gap_ix);
-
-    // find mgr in pool store and set to null
+    // find mgr in pool store and set to null, trace the close
     for(int i = 0; i < pool_store_size; i++)
     {
         if(pool_store[i] == mem_mgr)
@@ -311,563 +884,3932 @@ alloc_status mem_pool_close(pool_pt pool) {
             break;
         }
     }
+    _mem_trace(mem_mgr, TRACE_CLOSE, NULL, 0, 0);
 
-    // free mgr
-    free(mem_mgr);
+    // unlock the pool store
+    pthread_mutex_unlock(&pool_store_lock);
+
+    // save the state of a persistent pool in its header, marked closed
+    // note: the header of a shared pool is always up to date
+    if(mem_mgr->file != NULL && !mem_mgr->file->shared)
+    {
+        _mem_file_save(mem_mgr, 1);
+    }
+
+    // free memory pool, node heap chunks and mgr
+    _mem_release_pool(mem_mgr);
 
     return ALLOC_OK;
 }
 
 void * mem_new_alloc(pool_pt pool, size_t size) {
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    // check if any gaps, return null if none
-    // expand heap node, if necessary, quit on error
-    // check used nodes fewer than total nodes, quit on error
-    // get a node for allocation:
-    // if FIRST_FIT, then find the first sufficient node in the node heap
-    // if BEST_FIT, then find the first sufficient node in the gap index
-    // check if node found
-    // update metadata (num_allocs, alloc_size)
-    // calculate the size of the remaining gap, if any
-    // remove node from gap index
-    // convert gap_node to an allocation node of given size
-    // adjust node heap:
-    //   if remaining gap, need a new node
-    //   find an unused one in the node heap
-    //   make sure one was found
-    //   initialize it to a gap node
-    //   update metadata (used_nodes)
-    //   update linked list (new node right after the node for allocation)
-    //   add to gap index
-    //   check if successful
-    // return allocation record by casting the node to (alloc_pt)
+    // if ATOMIC_SLAB_FIT, pop a slot off the free stack without locking
+    // if the pool has thread caches and the size is cached,
+    //   serve it from the cache of the calling thread
+    // otherwise lock the pool, hand off to the allocator of the policy
+    //   and unlock the pool
+    // count a failure
+    // trace the allocation, once it is made
+    // return the allocation
 
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
     pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+    void *alloc;
 
-    // check if any gaps, return null if none
-    if(mem_mgr->pool.num_gaps == 0)
+    // if ATOMIC_SLAB_FIT, pop a slot off the free stack without locking
+    if(mem_mgr->pool.policy == ATOMIC_SLAB_FIT)
     {
-        return NULL;
+        alloc = _mem_lf_alloc(mem_mgr, size);
     }
-
-    // expand heap node, if necessary, quit on error
-    if(_mem_resize_node_heap(mem_mgr) == ALLOC_FAIL)
+    // if the pool has thread caches and the size is cached,
+    //   serve it from the cache of the calling thread
+    else if(mem_mgr->cache_max_size != 0 && size != 0
+            && _mem_cache_round(mem_mgr, size) <= mem_mgr->cache_max_size)
     {
-        return NULL;
+        alloc = _mem_cache_alloc(mem_mgr, size);
     }
-
-    // check used nodes fewer than total nodes, quit on error
-    if(mem_mgr->used_nodes >= mem_mgr->total_nodes)
+    // otherwise lock the pool, hand off to the allocator of the policy
+    //   and unlock the pool
+    else
     {
-        return NULL;
+        _mem_lock(mem_mgr);
+        alloc = _mem_alloc(mem_mgr, size);
+        _mem_unlock(mem_mgr);
     }
 
-    // get a node for allocation:
-    node_pt temp_node = NULL;
-
-    // if FIRST_FIT, then find the first sufficient node in the node heap
-    if(mem_mgr->pool.policy == FIRST_FIT)
+    // count a failure
+    if(alloc == NULL)
     {
-        /* need to check if node is used, is allocated, and if
-         * the allocated size is larger than size
-         */
-        for(int i = 0; i < mem_mgr->total_nodes; i++)
-        {
-            if(!(mem_mgr->node_heap[i].allocated) && mem_mgr->node_heap[i].used && mem_mgr->node_heap[i].alloc_record.size >= size)
-            {
-                temp_node = &mem_mgr->node_heap[i];
-                break;
-            }
-        }
+        _mem_count_failed(mem_mgr);
     }
 
-    // if BEST_FIT, then find the first sufficient node in the gap index
-    if(mem_mgr->pool.policy == BEST_FIT)
+    // trace the allocation, once it is made
+    _mem_trace(mem_mgr, TRACE_ALLOC, alloc, size, 0);
+
+    // return the allocation
+    return alloc;
+}
+
+alloc_status mem_del_alloc(pool_pt pool, void * alloc) {
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // trace the free, before the allocation can be made again
+    // if ATOMIC_SLAB_FIT, push the slot onto the free stack without locking
+    // if the pool has thread caches and the allocation is of a cached size,
+    //   push it onto the cache of the calling thread
+    // lock the pool
+    // hand off to the allocator of the policy
+    // unlock the pool
+    // return the status
+
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+
+    // trace the free, before the allocation can be made again
+    _mem_trace(mem_mgr, TRACE_FREE, alloc, 0, 0);
+
+    // if ATOMIC_SLAB_FIT, push the slot onto the free stack without locking
+    if(mem_mgr->pool.policy == ATOMIC_SLAB_FIT)
     {
-        /* need to check if gap size is greater than size
-         */
-        for(int i = 0; i < mem_mgr->gap_ix_capacity; i++)
-        {
-            if (mem_mgr->gap_ix[i].size >= size)
-            {
-                temp_node = mem_mgr->gap_ix[i].node;
-                break;
-            }
-        }
+        return _mem_lf_free(mem_mgr, alloc);
     }
 
-    // check if node found
-    if(temp_node == NULL)
+    // if the pool has thread caches and the allocation is of a cached size,
+    //   push it onto the cache of the calling thread
+    if(mem_mgr->cache_max_size != 0
+       && _mem_cache_class(mem_mgr, _mem_cache_size_of(mem_mgr, alloc)) >= 0)
     {
-        return NULL;
+        return _mem_cache_free(mem_mgr, alloc);
     }
 
-    // update metadata (num_allocs, alloc_size)
-    mem_mgr->pool.num_allocs++;
-    mem_mgr->pool.alloc_size += size;
-
-    // calculate the size of the remaining gap, if any
-    size_t rem_gap = mem_mgr->gap_ix->size - size;
+    // lock the pool
+    _mem_lock(mem_mgr);
 
-    // remove node from gap index
-    _mem_remove_from_gap_ix(mem_mgr, size, temp_node);
+    // hand off to the allocator of the policy
+    alloc_status status = _mem_free(mem_mgr, alloc);
 
-    // convert gap_node to an allocation node of given size
-    temp_node->alloc_record.size = size;
-    temp_node->allocated = 1;
-    temp_node->used = 1;
+    // unlock the pool
+    _mem_unlock(mem_mgr);
 
-    // adjust node heap:
-    //   if remaining gap, need a new node
-    if(rem_gap != 0)
-    {
-        node_pt new_node = NULL;
-        //   find an unused one in the node heap
-        for(int i = 0; i < mem_mgr->total_nodes; i++)
-        {
-            if(!(mem_mgr->node_heap[i].used))
-            {
-                new_node = &mem_mgr->node_heap[i];
-                break;
-            }
-        }
-        //   make sure one was found
-        if(new_node == NULL)
-        {
-            return NULL;
-        }
+    // return the status
+    return status;
+}
 
-        //   initialize it to a gap node
-        new_node->allocated = 0;
-        new_node->used = 1;
-        new_node->next = NULL;
-        new_node->prev = NULL;
-        new_node->alloc_record.size = rem_gap;
-        new_node->alloc_record.mem = temp_node->alloc_record.mem + size;
+void * mem_new_alloc_aligned(pool_pt pool, size_t size, size_t alignment)
+{
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // check the alignment is a power of two
+    // if ATOMIC_SLAB_FIT, the slots are aligned or none is, no locking
+    // lock the pool
+    // hand off to the aligned allocator of the policy
+    // unlock the pool
+    // count a failure
+    // trace the allocation, once it is made
+    // return the allocation
+    // note: aligned allocations bypass the thread caches
 
-        //   update metadata (used_nodes)
-        mem_mgr->used_nodes++;
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-        //   update linked list (new node right after the node for allocation)
-        new_node->prev = temp_node;
-        new_node->next = temp_node->next;
-        // update temp_node next information
-        if(temp_node->next != NULL)
-        {
-            temp_node->next->prev = new_node;
-        }
-        temp_node->next = new_node;
+    // check the alignment is a power of two
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return NULL;
+    }
 
-        //   add to gap index
-        //   check if successful
-        if(_mem_add_to_gap_ix(mem_mgr, rem_gap, new_node) == ALLOC_FAIL)
+    // if ATOMIC_SLAB_FIT, the slots are aligned or none is, no locking
+    void *alloc = NULL;
+    if(mem_mgr->pool.policy == ATOMIC_SLAB_FIT)
+    {
+        if((uintptr_t) mem_mgr->pool.mem % alignment == 0 && mem_mgr->slab_slot_size % alignment == 0)
         {
-            return NULL;
+            alloc = _mem_lf_alloc(mem_mgr, size);
         }
     }
+    else
+    {
+        // lock the pool
+        _mem_lock(mem_mgr);
 
-    // return allocation record by casting the node to (alloc_pt)
-    return (alloc_pt) temp_node;
+        // hand off to the aligned allocator of the policy
+        alloc = _mem_alloc_aligned(mem_mgr, size, alignment);
 
-}
+        // unlock the pool
+        _mem_unlock(mem_mgr);
+    }
 
-alloc_status mem_del_alloc(pool_pt pool, void * alloc) {
-    // get mgr from pool by casting the pointer to (pool_mgr_pt)
-    // get node from alloc by casting the pointer to (node_pt)
-    // find the node in the node heap
-    // this is node-to-delete
-    // make sure it's found
-    // convert to gap node
-    // update metadata (num_allocs, alloc_size)
-    // if the next node in the list is also a gap, merge into node-to-delete
-    //   remove the next node from gap index
-    //   check success
-    //   add the size to the node-to-delete
-    //   update node as unused
-    //   update metadata (used nodes)
-    //   update linked list:
-    /*
-                    if (next->next) {
-                        next->next->prev = node_to_del;
-                        node_to_del->next = next->next;
-                    } else {
-                        node_to_del->next = NULL;
-                    }
-                    next->next = NULL;
-                    next->prev = NULL;
-     */
+    // count a failure
+    if(alloc == NULL)
+    {
+        _mem_count_failed(mem_mgr);
+    }
 
-    // this merged node-to-delete might need to be added to the gap index
-    // but one more thing to check...
-    // if the previous node in the list is also a gap, merge into previous!
-    //   remove the previous node from gap index
-    //   check success
-    //   add the size of node-to-delete to the previous
-    //   update node-to-delete as unused
-    //   update metadata (used_nodes)
-    //   update linked list
-    /*
-                    if (node_to_del->next) {
-                        prev->next = node_to_del->next;
-                        node_to_del->next->prev = prev;
-                    } else {
-                        prev->next = NULL;
-                    }
-                    node_to_del->next = NULL;
-                    node_to_del->prev = NULL;
-     */
-    //   change the node to add to the previous node!
-    // add the resulting node to the gap index
-    // check success
+    // trace the allocation, once it is made
+    _mem_trace(mem_mgr, TRACE_ALIGNED, alloc, size, alignment);
+
+    // return the allocation
+    return alloc;
+}
 
+alloc_status mem_new_alloc_n(pool_pt pool, size_t size, unsigned n, void *allocs[])
+{
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // lock the pool
+    // hand off to the batch allocator, all or none are allocated
+    // unlock the pool
+    // count a failure
+    // trace the allocations, once they are made, failed ones if the batch failed
+    // return the status
+    // note: batches bypass the thread caches
 
     // get mgr from pool by casting the pointer to (pool_mgr_pt)
     pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-    // get node from alloc by casting the pointer to (node_pt)
-    node_pt temp_node = (node_pt) alloc;
+    // lock the pool
+    _mem_lock(mem_mgr);
 
-    // boolean for found
-    int bool_found = 0;
+    // hand off to the batch allocator, all or none are allocated
+    alloc_status status = _mem_alloc_n(mem_mgr, size, n, allocs);
 
-    // find the node in the node heap
-    for(int i = 0; i < mem_mgr->total_nodes; i++)
+    // unlock the pool
+    _mem_unlock(mem_mgr);
+
+    // count a failure
+    if(status != ALLOC_OK)
     {
-        if(temp_node == &mem_mgr->node_heap[i])
-        {
-            bool_found = 1;
-            break;
-        }
+        _mem_count_failed(mem_mgr);
     }
-    // this is node-to-delete
-    // make sure it's found
-    if(!bool_found)
+
+    // trace the allocations, once they are made, failed ones if the batch failed
+    for(unsigned i = 0; i < n; i++)
     {
-        return ALLOC_NOT_FREED;
+        _mem_trace(mem_mgr, TRACE_ALLOC, (status == ALLOC_OK) ? allocs[i] : NULL, size, 0);
     }
 
-    // convert to gap node
-    temp_node->allocated = 0;
-    temp_node->used = 1;
+    // return the status
+    return status;
+}
 
-    // update metadata (num_allocs, alloc_size)
-    mem_mgr->pool.num_allocs--;
-    mem_mgr->pool.alloc_size -= temp_node->alloc_record.size;
+alloc_status mem_del_alloc_n(pool_pt pool, unsigned n, void *allocs[])
+{
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // trace the frees, before the allocations can be made again
+    // lock the pool
+    // hand off to the batch deallocator, the good handles are all freed
+    // unlock the pool
+    // return the status (of the first bad handle, if any)
+    // note: batches bypass the thread caches
 
-    // if the next node in the list is also a gap, merge into node-to-delete
-    if(temp_node->next != NULL && temp_node->next->allocated == 0)
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+
+    // trace the frees, before the allocations can be made again
+    for(unsigned i = 0; i < n; i++)
     {
-        //   remove the next node from gap index
-        //   check success
-        if(_mem_remove_from_gap_ix(mem_mgr,temp_node->alloc_record.size, temp_node->next) == ALLOC_NOT_FREED)
-        {
-            return ALLOC_NOT_FREED;
-        }
+        _mem_trace(mem_mgr, TRACE_FREE, allocs[i], 0, 0);
+    }
 
-        //   add the size to the node-to-delete
-        temp_node->alloc_record.size += temp_node->next->alloc_record.size;
+    // lock the pool
+    _mem_lock(mem_mgr);
 
-        //   update node as unused
-        temp_node->used = 0;
-        temp_node->alloc_record.size = 0;
-        temp_node->alloc_record.mem = NULL;
+    // hand off to the batch deallocator, the good handles are all freed
+    alloc_status status = _mem_free_n(mem_mgr, n, allocs);
 
-        //   update metadata (used nodes)
-        mem_mgr->used_nodes--;
+    // unlock the pool
+    _mem_unlock(mem_mgr);
 
-        //   update linked list:
-        /*
-                    if (next->next) {
-                        next->next->prev = node_to_del;
-                        node_to_del->next = next->next;
-                    } else {
-                        node_to_del->next = NULL;
-                    }
-                    next->next = NULL;
-                    next->prev = NULL;
-        */
-        if (temp_node->next->next != NULL)
+    // return the status (of the first bad handle, if any)
+    return status;
+}
+
+void * mem_realloc_alloc(pool_pt pool, void *alloc, size_t new_size)
+{
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    // if ATOMIC_SLAB_FIT, the slot either fits or nothing does, no locking,
+    //   a size of 0 frees it
+    // lock the pool
+    // hand off to the reallocator, in place if possible, otherwise by moving
+    // trace the reallocation while the pool is locked, after the frees of
+    //   the new allocation and before the allocations of the old one
+    // unlock the pool
+    // count a failure
+    // return the allocation (null on failure, the old one is left as is,
+    //   or for a size of 0, the old one is freed)
+    // note: reallocations bypass the thread caches
+
+    // get mgr from pool by casting the pointer to (pool_mgr_pt)
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+
+    // if ATOMIC_SLAB_FIT, the slot either fits or nothing does, no locking,
+    //   a size of 0 frees it
+    void *new_alloc;
+    if(mem_mgr->pool.policy == ATOMIC_SLAB_FIT)
+    {
+        if(alloc == NULL)
         {
-            temp_node->next->next->prev = temp_node;
-            temp_node->next = temp_node->next->next;
+            new_alloc = _mem_lf_alloc(mem_mgr, new_size);
+        }
+        else if(new_size == 0)
+        {
+            _mem_lf_free(mem_mgr, alloc);
+            new_alloc = NULL;
         }
         else
         {
-            temp_node->next = NULL;
+            new_alloc = (new_size <= _mem_cache_size_of(mem_mgr, alloc)) ? alloc : NULL;
         }
-        temp_node->next->next = NULL;
-        temp_node->next->prev = NULL;
+        _mem_trace(mem_mgr, TRACE_REALLOC, new_alloc, new_size, (uintptr_t) alloc);
     }
+    else
+    {
+        // lock the pool
+        _mem_lock(mem_mgr);
 
-    // this merged node-to-delete might need to be added to the gap index
-    // but one more thing to check...
-    // if the previous node in the list is also a gap, merge into previous!
-    if(temp_node->prev != NULL && !(temp_node->prev->allocated))
+        // hand off to the reallocator, in place if possible, otherwise by moving
+        new_alloc = _mem_realloc(mem_mgr, alloc, new_size);
+
+        // trace the reallocation while the pool is locked, after the frees of
+        //   the new allocation and before the allocations of the old one
+        _mem_trace(mem_mgr, TRACE_REALLOC, new_alloc, new_size, (uintptr_t) alloc);
+
+        // unlock the pool
+        _mem_unlock(mem_mgr);
+    }
+
+    // count a failure
+    if(new_alloc == NULL && new_size != 0)
     {
+        _mem_count_failed(mem_mgr);
+    }
 
-        //   remove the previous node from gap index
-        //   check success
-        if(_mem_remove_from_gap_ix(mem_mgr, temp_node->prev->alloc_record.size, temp_node) == ALLOC_NOT_FREED)
-        {
-            return ALLOC_NOT_FREED;
-        }
+    // return the allocation (null on failure, the old one is left as is,
+    //   or for a size of 0, the old one is freed)
+    return new_alloc;
+}
 
-        //   add the size of node-to-delete to the previous
-        temp_node->prev->alloc_record.size += temp_node->alloc_record.size;
+void * mem_alloc_addr(pool_pt pool, void *alloc)
+{
+    // get the mgr from the pool
+    // if not a node policy, the allocation is its memory
+    // lock the pool
+    // find the node of the handle, make sure it's allocated
+    // take the memory of the node
+    // unlock the pool
+    // return the memory (null for a bad handle)
 
-        //   update node-to-delete as unused
-        temp_node->used = 0;
-        temp_node->alloc_record.size = 0;
-        temp_node->alloc_record.mem = NULL;
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-        //   update metadata (used_nodes)
-        mem_mgr->used_nodes--;
+    // if not a node policy, the allocation is its memory
+    if(mem_mgr->pool.policy != FIRST_FIT && mem_mgr->pool.policy != BEST_FIT
+       && mem_mgr->pool.policy != FAST_FIT && mem_mgr->pool.policy != TLSF_FIT)
+    {
+        return alloc;
+    }
 
-        //   update linked list
-        /*
-                        if (node_to_del->next) {
-                            prev->next = node_to_del->next;
-                            node_to_del->next->prev = prev;
-                        } else {
-                            prev->next = NULL;
-                        }
-                        node_to_del->next = NULL;
-                        node_to_del->prev = NULL;
-         */
-        if(temp_node->next != NULL)
-        {
-            temp_node->prev->next = temp_node->next;
-            temp_node->next->prev = temp_node->prev;
-        }
-        else
-        {
-            temp_node->prev->next = NULL;
-        }
-        temp_node->next = NULL;
-        temp_node->prev = NULL;
+    // lock the pool
+    _mem_lock(mem_mgr);
 
-        //   change the node to add to the previous node!
-        temp_node = temp_node->prev;
+    // find the node of the handle, make sure it's allocated
+    char *mem = NULL;
+    node_pt node = _mem_find_node(mem_mgr, alloc);
+    if(node != NULL && node->used && node->allocated == 1 && !_mem_cache_held(mem_mgr, alloc))
+    {
+        // take the memory of the node
+        mem = node->alloc_record.mem;
     }
 
-    // add the resulting node to the gap index
-    // check success
-    if(_mem_add_to_gap_ix(mem_mgr, temp_node->alloc_record.size, temp_node) == ALLOC_FAIL)
+    // unlock the pool
+    _mem_unlock(mem_mgr);
+
+    // return the memory (null for a bad handle)
+    return mem;
+}
+
+alloc_status mem_pool_compact(pool_pt pool, size_t budget)
+{
+    // get the mgr from the pool
+    // check the policy hands out nodes, the others cannot move allocations
+    // lock the pool
+    // hand off to the compactor
+    // unlock the pool
+    // return whether more is left to move
+
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+
+    // check the policy hands out nodes, the others cannot move allocations
+    if(mem_mgr->pool.policy != FIRST_FIT && mem_mgr->pool.policy != BEST_FIT
+       && mem_mgr->pool.policy != FAST_FIT && mem_mgr->pool.policy != TLSF_FIT)
     {
-        return ALLOC_NOT_FREED;
+        return ALLOC_FAIL;
     }
 
-    return ALLOC_OK;
+    // lock the pool
+    _mem_lock(mem_mgr);
+
+    // hand off to the compactor
+    alloc_status status = _mem_node_compact(mem_mgr, budget);
+
+    // unlock the pool
+    _mem_unlock(mem_mgr);
+
+    // return whether more is left to move
+    return status;
 }
 
 void mem_inspect_pool(pool_pt pool,
                       pool_segment_pt *segments,
                       unsigned *num_segments) {
     // get the mgr from the pool
-    // allocate the segments array with size == used_nodes
-    // check successful
-    // loop through the node heap and the segments array
-    //    for each node, write the size and allocated in the segment
-    // "return" the values:
-    /*
-                    *segments = segs;
-                    *num_segments = pool_mgr->used_nodes;
-     */
+    // lock the pool
+    // count the segments: one per node, per block for BUDDY_FIT and
+    //   TAGGED_FIT, per slot for the slab pools
+    // allocate the segments array
+    // check successful, fill it in with the walker of the policy
+    // unlock the pool
+    // "return" the values
 
     // get the mgr from the pool
     pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-    // allocate the segments array with size == used_nodes
-    pool_segment_pt pool_seg = malloc(mem_mgr->used_nodes * sizeof(pool_segment_pt));
+    // lock the pool
+    _mem_lock(mem_mgr);
 
-    // check successful
-    if(pool_seg != NULL)
+    // count the segments
+    unsigned num;
+    if(mem_mgr->pool.policy == BUDDY_FIT || mem_mgr->pool.policy == TAGGED_FIT)
+    {
+        num = mem_mgr->pool.num_gaps + mem_mgr->pool.num_allocs;
+    }
+    else if(mem_mgr->pool.policy == SLAB_FIT || mem_mgr->pool.policy == ATOMIC_SLAB_FIT)
+    {
+        num = (unsigned) (mem_mgr->pool.total_size / mem_mgr->slab_slot_size);
+    }
+    else
     {
+        num = mem_mgr->used_nodes;
+    }
 
-        // loop through the node heap and the segments array
-        //    for each node, write the size and allocated in the segment
-        for(int i = 0; i < mem_mgr->used_nodes; i++)
-        {
-            pool_seg->size = mem_mgr->node_heap[i].alloc_record.size;
-            pool_seg->allocated = mem_mgr->node_heap[i].allocated;
-        }
+    // allocate the segments array
+    pool_segment_pt pool_seg = calloc(num, sizeof(pool_segment_t));
+
+    // check successful, fill it in with the walker of the policy
+    if(pool_seg != NULL)
+    {
+        mem_segment_buffer_t buffer = { pool_seg, num, 0 };
+        _mem_walk(mem_mgr, _mem_segment_store, &buffer);
     }
-    // "return" the values:
-    /*
-                    *segments = segs;
-                    *num_segments = pool_mgr->used_nodes;
-     */
+
+    // unlock the pool
+    _mem_unlock(mem_mgr);
+
+    // "return" the values
     *segments = pool_seg;
-    *num_segments = mem_mgr->used_nodes;
+    *num_segments = num;
 }
 
+unsigned mem_inspect_pool_into(pool_pt pool, pool_segment_pt segments, unsigned capacity)
+{
+    // get the mgr from the pool
+    // lock the pool
+    // walk the segments, storing as many as fit
+    // unlock the pool
+    // return the number of segments, stored or not
 
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-/***********************************/
-/*                                 */
-/* Definitions of static functions */
-/*                                 */
-/***********************************/
-static alloc_status _mem_resize_pool_store() {
-    // check if necessary
-    /*
-                if (((float) pool_store_size / pool_store_capacity)
-                    > MEM_POOL_STORE_FILL_FACTOR) {...}
-     */
-    // don't forget to update capacity variables
+    // lock the pool
+    _mem_lock(mem_mgr);
 
-    if(((float)pool_store_size / pool_store_capacity) > MEM_POOL_STORE_FILL_FACTOR){
-        unsigned int oldSize = pool_store_size;
-        pool_store_size = pool_store_size * MEM_POOL_STORE_EXPAND_FACTOR;
-        pool_store = (pool_mgr_pt  *)realloc(pool_store,sizeof(pool_mgr_pt) * pool_store_size);
-        for(size_t i = oldSize; i< pool_store_size; i++){
-            pool_store[i] = NULL;
-        }
+    // walk the segments, storing as many as fit
+    mem_segment_buffer_t buffer = { segments, capacity, 0 };
+    _mem_walk(mem_mgr, _mem_segment_store, &buffer);
 
-        if(pool_store != NULL){
-            return ALLOC_OK;
-        }
-    }
+    // unlock the pool
+    _mem_unlock(mem_mgr);
 
-    return ALLOC_FAIL;
+    // return the number of segments, stored or not
+    return buffer.count;
 }
 
-static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr) {
-    // see above
-    if(((float)pool_mgr->used_nodes / pool_mgr->total_nodes) > MEM_NODE_HEAP_FILL_FACTOR){
-        pool_mgr->total_nodes *= MEM_NODE_HEAP_EXPAND_FACTOR;
-        pool_mgr->node_heap = (node_pt) realloc(pool_mgr->node_heap, sizeof(node_pt) * pool_mgr->total_nodes);
+unsigned mem_inspect_pool_visit(pool_pt pool, pool_segment_visitor visit, void *arg)
+{
+    // get the mgr from the pool
+    // lock the pool
+    // hand off to the walker of the policy
+    // unlock the pool
+    // return the number of segments visited
 
-        for(size_t i = pool_mgr->used_nodes ; i < pool_mgr->total_nodes; i++){
-            node_t nd;
-            nd.used = 0;
-            nd.allocated = 0;
-            pool_mgr->node_heap[i] = nd;
-        }
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-        if(pool_mgr == NULL){
-            return ALLOC_FAIL;
-        }
-    }
+    // lock the pool
+    _mem_lock(mem_mgr);
+
+    // hand off to the walker of the policy
+    unsigned n = _mem_walk(mem_mgr, visit, arg);
 
-    return ALLOC_FAIL;
+    // unlock the pool
+    _mem_unlock(mem_mgr);
+
+    // return the number of segments visited
+    return n;
 }
 
-static alloc_status _mem_resize_gap_ix(pool_mgr_pt pool_mgr) {
-    // see above
-    if(((float)pool_mgr->pool.num_gaps /pool_mgr->gap_ix_capacity) > MEM_GAP_IX_FILL_FACTOR){
-        unsigned int oldSize = pool_mgr->gap_ix_capacity;
-        pool_mgr->gap_ix_capacity *= MEM_GAP_IX_EXPAND_FACTOR;
-        pool_mgr->gap_ix = (gap_pt) realloc(pool_mgr->gap_ix,sizeof(gap_pt)*pool_mgr->gap_ix_capacity);
+size_t mem_pool_metadata(pool_pt pool)
+{
+    // get the mgr from the pool
+    // count the mgr itself
+    // count the node heap chunks (total_nodes nodes in all)
+    // if BUDDY_FIT, count the block map
+    // if SLAB_FIT, count the slot map
+    // if ATOMIC_SLAB_FIT, count the slot states
+    // if persistent, count the header of the file
+    // count the thread caches
+    // TAGGED_FIT and SLAB_FIT keep the rest of their metadata in pool->mem
 
-        for(size_t i = oldSize; i < pool_mgr->gap_ix_capacity;i++){
-            gap_t gp;
-            gp.node = NULL;
-            gp.size = 0;
-            pool_mgr->gap_ix[i] = gp;
-        }
-        if(pool_mgr->gap_ix != NULL) {
-            return ALLOC_OK;
-        }
-    }
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-    return ALLOC_FAIL;
-}
+    _mem_lock(mem_mgr);
 
-static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
-                                       size_t size,
-                                       node_pt node) {
+    // count the mgr itself
+    size_t bytes = sizeof(pool_mgr_t);
 
-    // expand the gap index, if necessary (call the function)
-    // add the entry at the end
-    // update metadata (num_gaps)
-    // sort the gap index (call the function)
-    // check success
-    _mem_resize_gap_ix(pool_mgr);
+    // count the node heap chunks (total_nodes nodes in all)
+    bytes += mem_mgr->total_nodes * sizeof(node_t);
 
-    gap_t gap;
-    gap.node = node;
-    gap.size = size;
+    // if BUDDY_FIT, count the block map
+    if(mem_mgr->pool.policy == BUDDY_FIT)
+    {
+        bytes += (mem_mgr->pool.total_size >> MEM_BUDDY_MIN_ORDER) + 1;
+    }
 
+    // if SLAB_FIT, count the slot map
+    if(mem_mgr->pool.policy == SLAB_FIT)
+    {
+        bytes += (mem_mgr->pool.total_size / mem_mgr->slab_slot_size + 63) / 64 * sizeof(uint64_t);
+    }
 
-    pool_mgr->gap_ix[pool_mgr->pool.num_gaps] = gap;
+    // if ATOMIC_SLAB_FIT, count the slot states
+    if(mem_mgr->pool.policy == ATOMIC_SLAB_FIT)
+    {
+        bytes += mem_mgr->pool.total_size / mem_mgr->slab_slot_size;
+    }
 
-    gap_pt cg = &pool_mgr->gap_ix[pool_mgr->pool.num_gaps];
+    // if persistent, count the header of the file
+    if(mem_mgr->file != NULL)
+    {
+        bytes += MEM_FILE_HEADER_SIZE;
+    }
 
-    if(cg->node != node){
-        printf("Failed to Allocate to Gaps\n");
-        return ALLOC_FAIL;
+    // count the thread caches, and the map of what they hold
+    if(mem_mgr->cache_map != NULL)
+    {
+        size_t units;
+        _mem_cache_unit(mem_mgr, NULL, &units);
+        bytes += (units + 63) / 64 * sizeof(uint64_t);
+    }
+    for(mem_cache_pt cache = mem_mgr->caches; cache != NULL; cache = cache->pool_next)
+    {
+        bytes += sizeof(mem_cache_t) + MEM_CACHE_NUM_CLASSES * 2 * cache->batch * sizeof(void *);
     }
 
-    pool_mgr->pool.num_gaps += 1;
-    return _mem_sort_gap_ix(pool_mgr);
+    _mem_unlock(mem_mgr);
 
-    return ALLOC_FAIL;
+    return bytes;
 }
 
-static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr,
-                                            size_t size,
-                                            node_pt node) {
-    // find the position of the node in the gap index
-    // loop from there to the end of the array:
-    //    pull the entries (i.e. copy over) one position up
-    //    this effectively deletes the chosen node
-    // update metadata (num_gaps)
-    // zero out the element at position num_gaps!
+alloc_status mem_pool_cache(pool_pt pool, size_t max_size, unsigned batch)
+{
+    // get the mgr from the pool
+    // check the max size is within the cached classes and the batch is sane
+    // lock the pool
+    // check the pool has no thread caches yet
+    // for BUDDY_FIT, SLAB_FIT and TAGGED_FIT, allocate the map of the
+    //   allocations the caches hold (the node policies mark their nodes)
+    // turn the thread caches on
+    // unlock the pool
 
-    size_t idx =0;
-    while(idx < pool_mgr->pool.num_gaps && pool_mgr->gap_ix[idx].node != node){
-        idx += 1;
-    }
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+    alloc_status status = ALLOC_OK;
 
-    if(idx == pool_mgr->pool.num_gaps){
-        printf("Failed to Remove Gap\n");
+    // check the max size is within the cached classes and the batch is sane
+    // note: ATOMIC_SLAB_FIT pools do not lock, they have no use for caches
+    if(mem_mgr->pool.policy == ATOMIC_SLAB_FIT
+       || max_size == 0 || max_size > MEM_CACHE_GRAIN * MEM_CACHE_NUM_CLASSES
+       || batch == 0 || batch > MEM_CACHE_MAX_BATCH)
+    {
         return ALLOC_FAIL;
     }
 
-    for(size_t i = idx;i < pool_mgr->pool.num_gaps;i++){
-        pool_mgr->gap_ix[i] = pool_mgr->gap_ix[i+1];
+    // lock the pool
+    _mem_lock(mem_mgr);
+
+    // check the pool has no thread caches yet
+    if(mem_mgr->cache_max_size != 0)
+    {
+        status = ALLOC_CALLED_AGAIN;
     }
+    else
+    {
+        // for BUDDY_FIT, SLAB_FIT and TAGGED_FIT, allocate the map of the
+        //   allocations the caches hold (the node policies mark their nodes)
+        if(mem_mgr->pool.policy == BUDDY_FIT || mem_mgr->pool.policy == SLAB_FIT
+           || mem_mgr->pool.policy == TAGGED_FIT)
+        {
+            size_t units;
+            _mem_cache_unit(mem_mgr, NULL, &units);
+            mem_mgr->cache_map = calloc((units + 63) / 64, sizeof(uint64_t));
+            if(mem_mgr->cache_map == NULL)
+            {
+                status = ALLOC_FAIL;
+            }
+        }
 
-    gap_t gap;
-    gap.size =0;
-    gap.node = NULL;
-    pool_mgr->gap_ix[pool_mgr->pool.num_gaps] = gap;
+        // turn the thread caches on
+        if(status == ALLOC_OK)
+        {
+            mem_mgr->cache_max_size = max_size;
+            mem_mgr->cache_batch = batch;
+        }
+    }
 
+    // unlock the pool
+    _mem_unlock(mem_mgr);
 
-    pool_mgr->pool.num_gaps -= 1;
-    return ALLOC_OK;
+    return status;
 }
 
-// note: only called by _mem_add_to_gap_ix, which appends a single entry
-static alloc_status _mem_sort_gap_ix(pool_mgr_pt pool_mgr) {
-    // the new entry is at the end, so "bubble it up"
-    // loop from num_gaps - 1 until but not including 0:
-    //    if the size of the current entry is less than the previous (u - 1)
-    //    or if the sizes are the same but the current entry points to a
-    //    node with a lower address of pool allocation address (mem)
-    //       swap them (by copying) (remember to use a temporary variable)
-    size_t start = pool_mgr->pool.num_gaps - 1;
-    while(start > 0 && pool_mgr->gap_ix[start].size < pool_mgr->gap_ix[start -1].size){
-        gap_t temp = pool_mgr->gap_ix[start];
-        pool_mgr->gap_ix[start] = pool_mgr->gap_ix[start -1];
-        start -=1;
-        pool_mgr->gap_ix[start] = temp;
-    }
+alloc_status mem_pool_cache_flush(pool_pt pool)
+{
+    // get the mgr from the pool
+    // find the cache of the pool among the calling thread's caches
+    // lock the pool
+    // return all the cached allocations to the pool
+    // unlock the pool
 
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
 
-    //using start loop until lowest address
-    while(start > 0 && pool_mgr->gap_ix[start].size == pool_mgr->gap_ix[start - 1].size && pool_mgr->gap_ix[start].node->alloc_record.mem < pool_mgr->gap_ix[start -1].node->alloc_record.mem){
-        gap_t temp = pool_mgr->gap_ix[start];
-        pool_mgr->gap_ix[start] = pool_mgr->gap_ix[start -1];
-        start -=1;
-        pool_mgr->gap_ix[start] = temp;
+    // find the cache of the pool among the calling thread's caches
+    mem_cache_pt cache = thread_caches;
+    while(cache != NULL && atomic_load_explicit(&cache->pool_mgr, memory_order_acquire) != mem_mgr)
+    {
+        cache = cache->thread_next;
     }
+    if(cache == NULL)
+    {
+        return ALLOC_OK;
+    }
+
+    // lock the pool
+    _mem_lock(mem_mgr);
+
+    // return all the cached allocations to the pool
+    _mem_cache_drain(mem_mgr, cache);
+
+    // unlock the pool
+    _mem_unlock(mem_mgr);
 
     return ALLOC_OK;
 }
 
-static alloc_status _mem_invalidate_gap_ix(pool_mgr_pt pool_mgr) {
-    return ALLOC_FAIL;
+void mem_pool_cache_stats(pool_pt pool, pool_cache_stats_pt stats)
+{
+    // get the mgr from the pool
+    // lock the pool
+    // start from the counts of the caches already released
+    // add the counts of the live caches
+    // unlock the pool
+
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+
+    // lock the pool
+    _mem_lock(mem_mgr);
+
+    // start from the counts of the caches already released
+    stats->hits = mem_mgr->cache_hits;
+    stats->misses = mem_mgr->cache_misses;
+    stats->flushes = mem_mgr->cache_flushes;
+
+    // add the counts of the live caches
+    for(mem_cache_pt cache = mem_mgr->caches; cache != NULL; cache = cache->pool_next)
+    {
+        stats->hits += atomic_load_explicit(&cache->hits, memory_order_relaxed);
+        stats->misses += atomic_load_explicit(&cache->misses, memory_order_relaxed);
+        stats->flushes += atomic_load_explicit(&cache->flushes, memory_order_relaxed);
+    }
+
+    // unlock the pool
+    _mem_unlock(mem_mgr);
+}
+
+void mem_pool_stats(pool_pt pool, pool_stats_pt stats)
+{
+    // get the mgr from the pool
+    // count the metadata, which locks the pool itself
+    // lock the pool
+    // take the free bytes from the pool counts, slots for the slab pools
+    // take the gap counts of the policy, a slab pool has its slots only
+    // find the largest gap, the fragmentation follows from it
+    // take the cumulative counts
+    // unlock the pool
+
+    // get the mgr from the pool
+    pool_mgr_pt mem_mgr = (pool_mgr_pt) pool;
+
+    // count the metadata, which locks the pool itself
+    stats->metadata_size = mem_pool_metadata(pool);
+
+    // lock the pool
+    _mem_lock(mem_mgr);
+
+    // take the free bytes from the pool counts, slots for the slab pools
+    // take the gap counts of the policy, a slab pool has its slots only
+    memset(stats->gap_classes, 0, sizeof(stats->gap_classes));
+    if(mem_mgr->pool.policy == SLAB_FIT || mem_mgr->pool.policy == ATOMIC_SLAB_FIT)
+    {
+        stats->free_size = (size_t) mem_mgr->pool.num_gaps * mem_mgr->slab_slot_size;
+        stats->gap_classes[_mem_gap_class(mem_mgr->slab_slot_size)] = mem_mgr->pool.num_gaps;
+    }
+    else
+    {
+        stats->free_size = mem_mgr->pool.total_size - mem_mgr->pool.alloc_size;
+        const unsigned long *counts = (mem_mgr->pool.policy == TAGGED_FIT)
+                                      ? mem_mgr->tag_lists->counts : mem_mgr->gap_counts;
+        memcpy(stats->gap_classes, counts, sizeof(stats->gap_classes));
+    }
+
+    // find the largest gap, the fragmentation follows from it
+    stats->largest_gap = _mem_largest_gap(mem_mgr);
+    stats->fragmentation = (stats->free_size != 0)
+                           ? 1.0 - (double) stats->largest_gap / (double) stats->free_size
+                           : 0.0;
+
+    // take the cumulative counts
+    stats->peak_alloc_size = __atomic_load_n(&mem_mgr->peak_alloc_size, __ATOMIC_RELAXED);
+    stats->allocs = __atomic_load_n(&mem_mgr->total_allocs, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&mem_mgr->total_frees, __ATOMIC_RELAXED);
+    stats->failed_allocs = atomic_load_explicit(&mem_mgr->failed_allocs, memory_order_relaxed);
+
+    // unlock the pool
+    _mem_unlock(mem_mgr);
+}
+
+alloc_status mem_trace_start(unsigned capacity)
+{
+    // check the capacity, round it up to a power of two
+    // lock the pool store, so that no pool opens or closes meanwhile
+    // lock the trace, check it is not on already
+    // start a new trace: bump the generation, so that threads take new rings
+    // unlock the trace
+    // trace an open for each pool already open
+    // unlock the pool store
+    if(capacity == 0 || capacity > (1u << 31))
+    {
+        return ALLOC_FAIL;
+    }
+    size_t rounded = 1;
+    while(rounded < capacity)
+    {
+        rounded <<= 1;
+    }
+
+    // lock the pool store, so that no pool opens or closes meanwhile
+    pthread_mutex_lock(&pool_store_lock);
+
+    // lock the trace, check it is not on already
+    pthread_mutex_lock(&trace_lock);
+    if(atomic_load_explicit(&trace_on, memory_order_relaxed))
+    {
+        pthread_mutex_unlock(&trace_lock);
+        pthread_mutex_unlock(&pool_store_lock);
+        return ALLOC_CALLED_AGAIN;
+    }
+
+    // start a new trace: bump the generation, so that threads take new rings
+    trace_capacity = rounded;
+    trace_num_threads = 0;
+    atomic_fetch_add_explicit(&trace_generation, 1, memory_order_release);
+    atomic_store_explicit(&trace_on, 1, memory_order_relaxed);
+
+    // unlock the trace
+    pthread_mutex_unlock(&trace_lock);
+
+    // trace an open for each pool already open
+    for(unsigned i = 0; i < pool_store_size; i++)
+    {
+        pool_mgr_pt mem_mgr = pool_store[i];
+        if(mem_mgr != NULL)
+        {
+            _mem_trace(mem_mgr, TRACE_OPEN, (void *) (uintptr_t) mem_mgr->slab_object_size,
+                       mem_mgr->pool.total_size, mem_mgr->pool.policy);
+        }
+    }
+
+    // unlock the pool store
+    pthread_mutex_unlock(&pool_store_lock);
+
+    return ALLOC_OK;
+}
+
+alloc_status mem_trace_dump(const char *path)
+{
+    // lock the trace, check it is on
+    // find the oldest kept event of each ring and count them all
+    // open the file and write the header
+    // merge the rings in time order, each of them already is
+    // close the file, unlock the trace
+    alloc_status status = ALLOC_OK;
+
+    // lock the trace, check it is on
+    pthread_mutex_lock(&trace_lock);
+    if(!atomic_load_explicit(&trace_on, memory_order_relaxed))
+    {
+        pthread_mutex_unlock(&trace_lock);
+        return ALLOC_FAIL;
+    }
+
+    // find the oldest kept event of each ring and count them all
+    // note: from[r] is the next event of ring r to write, to[r] its head
+    mem_trace_ring_pt *rings = calloc(trace_num_threads + 1, sizeof(mem_trace_ring_pt));
+    unsigned long *from = calloc(trace_num_threads + 1, sizeof(unsigned long));
+    unsigned long *to = calloc(trace_num_threads + 1, sizeof(unsigned long));
+    FILE *file = NULL;
+    if(rings == NULL || from == NULL || to == NULL || (file = fopen(path, "wb")) == NULL)
+    {
+        status = ALLOC_FAIL;
+    }
+    else
+    {
+        unsigned num_rings = 0;
+        unsigned long long num_events = 0;
+        for(mem_trace_ring_pt ring = trace_rings; ring != NULL; ring = ring->next)
+        {
+            rings[num_rings] = ring;
+            to[num_rings] = atomic_load_explicit(&ring->head, memory_order_acquire);
+            from[num_rings] = (to[num_rings] > ring->mask) ? to[num_rings] - ring->mask - 1 : 0;
+            num_events += to[num_rings] - from[num_rings];
+            num_rings++;
+        }
+
+        // open the file and write the header
+        trace_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MEM_TRACE_MAGIC, sizeof(header.magic));
+        header.version = MEM_TRACE_VERSION;
+        header.event_size = sizeof(trace_event_t);
+        header.num_events = num_events;
+        if(fwrite(&header, sizeof(header), 1, file) != 1)
+        {
+            status = ALLOC_FAIL;
+        }
+
+        // merge the rings in time order, each of them already is
+        for(unsigned long long n = 0; n < num_events && status == ALLOC_OK; n++)
+        {
+            trace_event_pt next = NULL;
+            unsigned next_ring = 0;
+            for(unsigned r = 0; r < num_rings; r++)
+            {
+                if(from[r] == to[r])
+                {
+                    continue;
+                }
+                trace_event_pt event = &rings[r]->events[from[r] & rings[r]->mask];
+                if(next == NULL || event->time_ns < next->time_ns)
+                {
+                    next = event;
+                    next_ring = r;
+                }
+            }
+            from[next_ring]++;
+            if(fwrite(next, sizeof(trace_event_t), 1, file) != 1)
+            {
+                status = ALLOC_FAIL;
+            }
+        }
+    }
+
+    // close the file, unlock the trace
+    if(file != NULL && fclose(file) != 0)
+    {
+        status = ALLOC_FAIL;
+    }
+    free(rings);
+    free(from);
+    free(to);
+    pthread_mutex_unlock(&trace_lock);
+
+    return status;
+}
+
+alloc_status mem_trace_stop()
+{
+    // lock the trace, check it is on
+    // turn it off
+    // release the rings, threads take new ones on the next start
+    // unlock the trace
+    pthread_mutex_lock(&trace_lock);
+    if(!atomic_load_explicit(&trace_on, memory_order_relaxed))
+    {
+        pthread_mutex_unlock(&trace_lock);
+        return ALLOC_CALLED_AGAIN;
+    }
+
+    // turn it off
+    atomic_store_explicit(&trace_on, 0, memory_order_relaxed);
+
+    // release the rings, threads take new ones on the next start
+    while(trace_rings != NULL)
+    {
+        mem_trace_ring_pt ring = trace_rings;
+        trace_rings = ring->next;
+        free(ring);
+    }
+    trace_num_threads = 0;
+
+    // unlock the trace
+    pthread_mutex_unlock(&trace_lock);
+
+    return ALLOC_OK;
+}
+
+
+
+/***********************************/
+/*                                 */
+/* Definitions of static functions */
+/*                                 */
+/***********************************/
+static void * _mem_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    // hand off to the allocator of the policy:
+    //   BUDDY_FIT, the buddy allocator
+    //   SLAB_FIT, pop a slot off the free list
+    //   TAGGED_FIT, the boundary tag allocator
+    //   ATOMIC_SLAB_FIT, pop a slot off the free stack
+    //   otherwise, the node heap and gap index
+    // note: the caller holds the pool lock
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        return _mem_buddy_alloc(pool_mgr, size);
+    }
+    if(pool_mgr->pool.policy == SLAB_FIT){
+        return _mem_slab_alloc(pool_mgr, size);
+    }
+    if(pool_mgr->pool.policy == TAGGED_FIT){
+        return _mem_tag_alloc(pool_mgr, size);
+    }
+    if(pool_mgr->pool.policy == ATOMIC_SLAB_FIT){
+        return _mem_lf_alloc(pool_mgr, size);
+    }
+    return _mem_node_alloc(pool_mgr, size);
+}
+
+static alloc_status _mem_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // hand off to the allocator of the policy:
+    //   BUDDY_FIT, the buddy allocator
+    //   SLAB_FIT, push the slot onto the free list
+    //   TAGGED_FIT, the boundary tag allocator
+    //   ATOMIC_SLAB_FIT, push the slot onto the free stack
+    //   otherwise, the node heap and gap index
+    // an allocation a thread cache holds is already free
+    // note: the caller holds the pool lock
+    if(_mem_cache_held(pool_mgr, alloc)){
+        return ALLOC_DOUBLE_FREE;
+    }
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        return _mem_buddy_free(pool_mgr, alloc);
+    }
+    if(pool_mgr->pool.policy == SLAB_FIT){
+        return _mem_slab_free(pool_mgr, alloc);
+    }
+    if(pool_mgr->pool.policy == TAGGED_FIT){
+        return _mem_tag_free(pool_mgr, alloc);
+    }
+    if(pool_mgr->pool.policy == ATOMIC_SLAB_FIT){
+        return _mem_lf_free(pool_mgr, alloc);
+    }
+    return _mem_node_free(pool_mgr, alloc);
+}
+
+static alloc_status _mem_alloc_n(pool_mgr_pt pool_mgr, size_t size, unsigned n, void *allocs[]) {
+    // for the node policies, carve the batch out of one gap, if there is one
+    // otherwise allocate one by one, on error free the ones allocated
+    // note: the caller holds the pool lock
+    if(pool_mgr->pool.policy == FIRST_FIT || pool_mgr->pool.policy == BEST_FIT
+       || pool_mgr->pool.policy == FAST_FIT || pool_mgr->pool.policy == TLSF_FIT){
+        if(_mem_node_alloc_n(pool_mgr, size, n, allocs) == ALLOC_OK){
+            return ALLOC_OK;
+        }
+    }
+
+    for(unsigned i = 0; i < n; i++){
+        allocs[i] = _mem_alloc(pool_mgr, size);
+        if(allocs[i] == NULL){
+            while(i > 0){
+                _mem_free(pool_mgr, allocs[--i]);
+            }
+            return ALLOC_FAIL;
+        }
+    }
+
+    return ALLOC_OK;
+}
+
+static alloc_status _mem_free_n(pool_mgr_pt pool_mgr, unsigned n, void *allocs[]) {
+    // for the node policies, free the batch with one merge per run of gaps
+    // otherwise free one by one, keeping the status of the first bad handle
+    // note: the caller holds the pool lock
+    if(pool_mgr->pool.policy == FIRST_FIT || pool_mgr->pool.policy == BEST_FIT
+       || pool_mgr->pool.policy == FAST_FIT || pool_mgr->pool.policy == TLSF_FIT){
+        return _mem_node_free_n(pool_mgr, n, allocs);
+    }
+
+    alloc_status status = ALLOC_OK;
+    for(unsigned i = 0; i < n; i++){
+        alloc_status one = _mem_free(pool_mgr, allocs[i]);
+        if(status == ALLOC_OK){
+            status = one;
+        }
+    }
+
+    return status;
+}
+
+static void * _mem_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size) {
+    // a null allocation is a new one, a size of 0 frees it, like realloc
+    // one a thread cache holds fails (it is free)
+    // for the node policies, grow or shrink in place into the neighbour gaps
+    // otherwise keep the allocation if its block already holds size
+    // failing that, move: allocate, copy, free
+    // note: the caller holds the pool lock
+    if(alloc == NULL){
+        return _mem_alloc(pool_mgr, size);
+    }
+    if(size == 0){
+        _mem_free(pool_mgr, alloc);
+        return NULL;
+    }
+    if(_mem_cache_held(pool_mgr, alloc)){
+        return NULL;
+    }
+
+    if(pool_mgr->pool.policy == FIRST_FIT || pool_mgr->pool.policy == BEST_FIT
+       || pool_mgr->pool.policy == FAST_FIT || pool_mgr->pool.policy == TLSF_FIT){
+        return _mem_node_realloc(pool_mgr, alloc, size);
+    }
+
+    size_t old_size = _mem_cache_size_of(pool_mgr, alloc);
+    if(old_size == 0){
+        return NULL;
+    }
+    if(size <= old_size){
+        return alloc;
+    }
+
+    void *new_alloc = _mem_alloc(pool_mgr, size);
+    if(new_alloc == NULL){
+        return NULL;
+    }
+    memcpy(new_alloc, alloc, old_size);
+    _mem_free(pool_mgr, alloc);
+
+    return new_alloc;
+}
+
+static void * _mem_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    // hand off to the aligned allocator of the policy:
+    //   BUDDY_FIT, a block of at least alignment, blocks are aligned to
+    //     their size within the pool
+    //   SLAB_FIT, any slot if the base and the slot size are aligned
+    //   TAGGED_FIT, the boundary tag allocator, payloads are 16-aligned
+    //   otherwise, the node heap and gap index
+    // check the result against the alignment, free it if it is off
+    // note: the caller holds the pool lock
+    void *alloc;
+
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        alloc = _mem_buddy_alloc(pool_mgr, (size < alignment) ? alignment : size);
+    } else if(pool_mgr->pool.policy == SLAB_FIT){
+        if(pool_mgr->slab_slot_size % alignment != 0){
+            return NULL;
+        }
+        alloc = _mem_slab_alloc(pool_mgr, size);
+    } else if(pool_mgr->pool.policy == TAGGED_FIT){
+        return (alignment <= MEM_TAG_ALIGN)
+               ? _mem_tag_alloc(pool_mgr, size)
+               : _mem_tag_alloc_aligned(pool_mgr, size, alignment);
+    } else {
+        return _mem_node_alloc_aligned(pool_mgr, size, alignment);
+    }
+
+    if(alloc != NULL && (uintptr_t) alloc % alignment != 0){
+        _mem_free(pool_mgr, alloc);
+        return NULL;
+    }
+
+    return alloc;
+}
+
+static void * _mem_node_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    // check if any gaps, return null if none (and the pool cannot grow)
+    // expand heap node, if necessary, quit on error
+    // check used nodes fewer than total nodes, quit on error
+    // get a node for allocation from the policy's gap search
+    // if none, grow the pool by an arena, if it can grow
+    // check if node found
+    // update metadata (num_allocs, alloc_size)
+    // calculate the size of the remaining gap, if any
+    // remove node from gap index
+    // convert gap_node to an allocation node of given size
+    // adjust node heap:
+    //   if remaining gap, split it off into a new node
+    //   make sure one was found
+    //   add to gap index
+    //   check if successful
+    // return allocation record by casting the node to (alloc_pt)
+
+    // check if any gaps, return null if none (and the pool cannot grow)
+    if(pool_mgr->pool.num_gaps == 0 && pool_mgr->arena_size == 0)
+    {
+        return NULL;
+    }
+
+    // expand heap node, if necessary, quit on error
+    if(_mem_resize_node_heap(pool_mgr, 0) == ALLOC_FAIL)
+    {
+        return NULL;
+    }
+
+    // check used nodes fewer than total nodes, quit on error
+    if(pool_mgr->used_nodes >= pool_mgr->total_nodes)
+    {
+        return NULL;
+    }
+
+    // get a node for allocation from the policy's gap search
+    node_pt temp_node = _mem_find_gap(pool_mgr, size);
+
+    // if none, grow the pool by an arena, if it can grow
+    if(temp_node == NULL)
+    {
+        temp_node = _mem_grow(pool_mgr, size);
+    }
+
+    // check if node found
+    if(temp_node == NULL)
+    {
+        return NULL;
+    }
+
+    // update metadata (num_allocs, alloc_size)
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += size;
+
+    // calculate the size of the remaining gap, if any
+    size_t rem_gap = temp_node->alloc_record.size - size;
+
+    // remove node from gap index
+    _mem_remove_from_gap_ix(pool_mgr, temp_node->alloc_record.size, temp_node);
+
+    // convert gap_node to an allocation node of given size
+    temp_node->alloc_record.size = size;
+    temp_node->allocated = 1;
+    temp_node->alignment = 0;
+    temp_node->used = 1;
+
+    // adjust node heap:
+    //   if remaining gap, split it off into a new node
+    if(rem_gap != 0)
+    {
+        node_pt new_node = _mem_split_node(pool_mgr, temp_node, rem_gap);
+        //   make sure one was found
+        if(new_node == NULL)
+        {
+            return NULL;
+        }
+
+        //   add to gap index
+        //   check if successful
+        if(_mem_add_to_gap_ix(pool_mgr, rem_gap, new_node) == ALLOC_FAIL)
+        {
+            return NULL;
+        }
+    }
+
+    // return allocation record by casting the node to (alloc_pt)
+    return (alloc_pt) temp_node;
+}
+
+static void * _mem_node_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    // check the padded size does not overflow
+    // expand heap node for the two nodes a split may take, quit on error
+    // find a gap by the policy that holds size at any alignment, or grow
+    //    the pool by an arena that does, quit if none
+    // remove it from the gap index
+    // if its start is not aligned, keep the padding as the gap and put it
+    //    back in the gap index, the allocation is a new node right after it
+    // if a gap remains after the allocation, split it off and add it to
+    //    the gap index
+    // update metadata (num_allocs, alloc_size)
+    if(size > SIZE_MAX - (alignment - 1)){
+        return NULL;
+    }
+
+    if(_mem_resize_node_heap(pool_mgr, 2) == ALLOC_FAIL
+       || pool_mgr->total_nodes - pool_mgr->used_nodes < 2){
+        return NULL;
+    }
+
+    node_pt node = _mem_find_gap(pool_mgr, size + alignment - 1);
+    if(node == NULL){
+        node = _mem_grow(pool_mgr, size + alignment - 1);
+    }
+    if(node == NULL){
+        return NULL;
+    }
+
+    size_t gap_size = node->alloc_record.size;
+    size_t pad = (alignment - (uintptr_t) node->alloc_record.mem % alignment) % alignment;
+    _mem_remove_from_gap_ix(pool_mgr, gap_size, node);
+
+    if(pad != 0){
+        node->alloc_record.size = pad;
+        _mem_add_to_gap_ix(pool_mgr, pad, node);
+        node = _mem_split_node(pool_mgr, node, size);
+    } else {
+        node->alloc_record.size = size;
+    }
+    node->allocated = 1;
+    node->alignment = alignment;
+
+    if(gap_size - pad - size != 0){
+        node_pt gap = _mem_split_node(pool_mgr, node, gap_size - pad - size);
+        _mem_add_to_gap_ix(pool_mgr, gap_size - pad - size, gap);
+    }
+
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += size;
+
+    return (alloc_pt) node;
+}
+
+static alloc_status _mem_node_alloc_n(pool_mgr_pt pool_mgr, size_t size, unsigned n, void *allocs[]) {
+    // check the batch size does not overflow
+    // expand heap node for n more nodes, quit on error
+    // find one gap for the whole batch by the policy, or grow the pool by
+    //   an arena that holds it, quit if none
+    // remove it from the gap index
+    // carve the allocations off its front, each a node right after the last
+    // if a gap remains, split it off and add it to the gap index
+    // update metadata (num_allocs, alloc_size)
+    if(n == 0){
+        return ALLOC_OK;
+    }
+    if(size == 0 || size > SIZE_MAX / n){
+        return ALLOC_FAIL;
+    }
+
+    if(_mem_resize_node_heap(pool_mgr, n) == ALLOC_FAIL
+       || pool_mgr->total_nodes - pool_mgr->used_nodes <= n){
+        return ALLOC_FAIL;
+    }
+
+    node_pt node = _mem_find_gap(pool_mgr, size * n);
+    if(node == NULL){
+        node = _mem_grow(pool_mgr, size * n);
+    }
+    if(node == NULL || pool_mgr->total_nodes - pool_mgr->used_nodes <= n){
+        return ALLOC_FAIL;
+    }
+
+    size_t rem_gap = node->alloc_record.size - size * n;
+    _mem_remove_from_gap_ix(pool_mgr, node->alloc_record.size, node);
+
+    node->alloc_record.size = size;
+    node->allocated = 1;
+    node->alignment = 0;
+    allocs[0] = (alloc_pt) node;
+    for(unsigned i = 1; i < n; i++){
+        node = _mem_split_node(pool_mgr, node, size);
+        node->allocated = 1;
+        node->alignment = 0;
+        allocs[i] = (alloc_pt) node;
+    }
+
+    if(rem_gap != 0){
+        node = _mem_split_node(pool_mgr, node, rem_gap);
+        _mem_add_to_gap_ix(pool_mgr, rem_gap, node);
+    }
+
+    pool_mgr->pool.num_allocs += n;
+    pool_mgr->pool.alloc_size += size * n;
+
+    return ALLOC_OK;
+}
+
+static alloc_status _mem_node_free_n(pool_mgr_pt pool_mgr, unsigned n, void *allocs[]) {
+    // mark the node of every good handle as pending, keeping the status
+    //   of the first bad handle (a handle given twice is a double free)
+    // update metadata (num_allocs, alloc_size)
+    // for each pending node not yet merged:
+    //   walk back to the first node of its run of gaps and pending nodes,
+    //   within its arena
+    //   merge the run into that node: gaps come out of the gap index,
+    //   the other nodes go onto the free node stack
+    //   add the merged node to the gap index
+    //   give the pages of the freed nodes and small gaps back to the OS
+    //   release the arena if it is all one gap now
+    alloc_status status = ALLOC_OK;
+
+    for(unsigned i = 0; i < n; i++){
+        node_pt node = _mem_find_node(pool_mgr, allocs[i]);
+        alloc_status one = ALLOC_OK;
+
+        if(node == NULL){
+            one = ALLOC_INVALID_HANDLE;
+        } else if(!node->used || node->allocated != 1 || _mem_cache_held(pool_mgr, allocs[i])){
+            one = ALLOC_DOUBLE_FREE;
+        } else {
+            node->allocated = MEM_NODE_PENDING;
+            pool_mgr->pool.num_allocs--;
+            pool_mgr->pool.alloc_size -= node->alloc_record.size;
+        }
+        if(status == ALLOC_OK){
+            status = one;
+        }
+    }
+
+    for(unsigned i = 0; i < n; i++){
+        node_pt node = _mem_find_node(pool_mgr, allocs[i]);
+        if(node == NULL || !node->used || node->allocated != MEM_NODE_PENDING){
+            continue;
+        }
+
+        while(node->prev != NULL && node->prev->allocated != 1 && !_mem_arena_of(pool_mgr, node)){
+            node = node->prev;
+        }
+
+        size_t size = 0;
+        char *lo = NULL, *hi = NULL;
+        node_pt run = node;
+        while(run != NULL && run->allocated != 1 && (run == node || !_mem_arena_of(pool_mgr, run))){
+            node_pt next = run->next;
+
+            if(run->allocated == MEM_NODE_PENDING || run->alloc_record.size < pool_mgr->map_release_min){
+                if(lo == NULL){
+                    lo = run->alloc_record.mem;
+                }
+                hi = run->alloc_record.mem + run->alloc_record.size;
+            }
+            if(run->allocated == 0){
+                _mem_remove_from_gap_ix(pool_mgr, run->alloc_record.size, run);
+            }
+            size += run->alloc_record.size;
+            if(run != node){
+                node->next = next;
+                if(next != NULL){
+                    next->prev = node;
+                }
+                _mem_put_node(pool_mgr, run);
+            }
+            run = next;
+        }
+
+        node->alloc_record.size = size;
+        node->allocated = 0;
+        _mem_add_to_gap_ix(pool_mgr, size, node);
+        _mem_release_pages(pool_mgr, node->alloc_record.mem, size, lo, hi);
+        _mem_shrink(pool_mgr, node);
+    }
+
+    return status;
+}
+
+static alloc_status _mem_node_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // get node from alloc by checking it is in a node heap chunk
+    // (range and alignment)
+    // this is node-to-delete
+    // make sure it's still allocated
+    // convert to gap node
+    // update metadata (num_allocs, alloc_size)
+    // if the next node in the list is also a gap (of the same arena),
+    // merge into node-to-delete
+    //   remove the next node from gap index
+    //   check success
+    //   add the size to the node-to-delete
+    //   update linked list:
+    /*
+                    if (next->next) {
+                        next->next->prev = node_to_del;
+                        node_to_del->next = next->next;
+                    } else {
+                        node_to_del->next = NULL;
+                    }
+                    next->next = NULL;
+                    next->prev = NULL;
+     */
+    //   push next node onto the free node stack as unused
+
+    // this merged node-to-delete might need to be added to the gap index
+    // but one more thing to check...
+    // if the previous node in the list is also a gap (of the same arena),
+    // merge into previous!
+    //   remove the previous node from gap index
+    //   check success
+    //   add the size of node-to-delete to the previous
+    //   update linked list
+    /*
+                    if (node_to_del->next) {
+                        prev->next = node_to_del->next;
+                        node_to_del->next->prev = prev;
+                    } else {
+                        prev->next = NULL;
+                    }
+                    node_to_del->next = NULL;
+                    node_to_del->prev = NULL;
+     */
+    //   push node-to-delete onto the free node stack as unused
+    //   change the node to add to the previous node!
+    // add the resulting node to the gap index
+    // check success
+    // give the pages of the freed bytes (and of small merged gaps) back to
+    // the OS, if the pool is mapped and the resulting gap is big enough
+    // release the arena if it is all one gap now
+
+    // get node from alloc by checking it is in a node heap chunk
+    // (range and alignment)
+    node_pt temp_node = _mem_find_node(pool_mgr, alloc);
+    if(temp_node == NULL)
+    {
+        return ALLOC_INVALID_HANDLE;
+    }
+
+    // this is node-to-delete
+    // make sure it's still allocated
+    if(!(temp_node->used) || !(temp_node->allocated))
+    {
+        return ALLOC_DOUBLE_FREE;
+    }
+
+    // convert to gap node
+    temp_node->allocated = 0;
+    temp_node->used = 1;
+
+    // update metadata (num_allocs, alloc_size)
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size -= temp_node->alloc_record.size;
+
+    char *lo = temp_node->alloc_record.mem;
+    char *hi = lo + temp_node->alloc_record.size;
+
+    // if the next node in the list is also a gap (of the same arena),
+    // merge into node-to-delete
+    if(temp_node->next != NULL && !(temp_node->next->allocated)
+       && !_mem_arena_of(pool_mgr, temp_node->next))
+    {
+        node_pt next = temp_node->next;
+        if(next->alloc_record.size < pool_mgr->map_release_min)
+        {
+            hi += next->alloc_record.size;
+        }
+
+        //   remove the next node from gap index
+        //   check success
+        if(_mem_remove_from_gap_ix(pool_mgr, next->alloc_record.size, next) == ALLOC_FAIL)
+        {
+            return ALLOC_NOT_FREED;
+        }
+
+        //   add the size to the node-to-delete
+        temp_node->alloc_record.size += next->alloc_record.size;
+
+        //   update linked list:
+        if (next->next != NULL)
+        {
+            next->next->prev = temp_node;
+            temp_node->next = next->next;
+        }
+        else
+        {
+            temp_node->next = NULL;
+        }
+        next->next = NULL;
+        next->prev = NULL;
+
+        //   push next node onto the free node stack as unused
+        _mem_put_node(pool_mgr, next);
+    }
+
+    // this merged node-to-delete might need to be added to the gap index
+    // but one more thing to check...
+    // if the previous node in the list is also a gap (of the same arena),
+    // merge into previous!
+    if(temp_node->prev != NULL && !(temp_node->prev->allocated)
+       && !_mem_arena_of(pool_mgr, temp_node))
+    {
+        node_pt prev = temp_node->prev;
+        if(prev->alloc_record.size < pool_mgr->map_release_min)
+        {
+            lo = prev->alloc_record.mem;
+        }
+
+        //   remove the previous node from gap index
+        //   check success
+        if(_mem_remove_from_gap_ix(pool_mgr, prev->alloc_record.size, prev) == ALLOC_FAIL)
+        {
+            return ALLOC_NOT_FREED;
+        }
+
+        //   add the size of node-to-delete to the previous
+        prev->alloc_record.size += temp_node->alloc_record.size;
+
+        //   update linked list
+        if(temp_node->next != NULL)
+        {
+            prev->next = temp_node->next;
+            temp_node->next->prev = prev;
+        }
+        else
+        {
+            prev->next = NULL;
+        }
+        temp_node->next = NULL;
+        temp_node->prev = NULL;
+
+        //   push node-to-delete onto the free node stack as unused
+        _mem_put_node(pool_mgr, temp_node);
+
+        //   change the node to add to the previous node!
+        temp_node = prev;
+    }
+
+    // add the resulting node to the gap index
+    // check success
+    if(_mem_add_to_gap_ix(pool_mgr, temp_node->alloc_record.size, temp_node) == ALLOC_FAIL)
+    {
+        return ALLOC_NOT_FREED;
+    }
+
+    // give the pages of the freed bytes (and of small merged gaps) back to
+    // the OS, if the pool is mapped and the resulting gap is big enough
+    _mem_release_pages(pool_mgr, temp_node->alloc_record.mem, temp_node->alloc_record.size, lo, hi);
+
+    // release the arena if it is all one gap now
+    _mem_shrink(pool_mgr, temp_node);
+
+    return ALLOC_OK;
+}
+
+static void * _mem_node_realloc(pool_mgr_pt pool_mgr, void *alloc, size_t size) {
+    // get node from alloc, make sure it's still allocated
+    // expand heap node, if necessary, quit on error
+    // if the node and the next gap (of the same arena) hold size, stay in place
+    // else if the previous gap, the node and the next gap hold size, and
+    //    the start of the previous gap keeps the node aligned, slide the
+    //    contents down into the previous gap
+    // else move: allocate by the policy, at the alignment of the node if
+    //    it has one, copy, free the node
+    // in place:
+    //   remove the neighbour gaps used from the gap index
+    //   merge them into the node that stays first (the handle may change)
+    //   split off what remains past size and add it to the gap index,
+    //   giving the pages of a shrunk tail back to the OS
+    //   update metadata (alloc_size)
+    // note: the first node in the list is never put back on the free node
+    //       stack, it heads the list, so merges keep the previous node
+    node_pt node = _mem_find_node(pool_mgr, alloc);
+    if(node == NULL || !node->used || node->allocated != 1){
+        return NULL;
+    }
+
+    if(_mem_resize_node_heap(pool_mgr, 0) == ALLOC_FAIL
+       || pool_mgr->used_nodes >= pool_mgr->total_nodes){
+        return NULL;
+    }
+
+    size_t old_size = node->alloc_record.size;
+    node_pt next = (node->next != NULL && !node->next->allocated
+                    && !_mem_arena_of(pool_mgr, node->next)) ? node->next : NULL;
+    size_t alignment = node->alignment;
+    node_pt prev = (node->prev != NULL && !node->prev->allocated && !_mem_arena_of(pool_mgr, node)
+                    && (alignment <= 1 || (uintptr_t) node->prev->alloc_record.mem % alignment == 0))
+                   ? node->prev : NULL;
+    size_t fwd = old_size + (next ? next->alloc_record.size : 0);
+
+    if(size <= fwd){
+        prev = NULL;
+    } else if(prev == NULL || size - fwd > prev->alloc_record.size){
+        void *new_alloc = (alignment > 1) ? _mem_node_alloc_aligned(pool_mgr, size, alignment)
+                                          : _mem_node_alloc(pool_mgr, size);
+        if(new_alloc == NULL){
+            return NULL;
+        }
+        memcpy(_mem_find_node(pool_mgr, new_alloc)->alloc_record.mem, node->alloc_record.mem, old_size);
+        _mem_node_free(pool_mgr, alloc);
+        return new_alloc;
+    }
+
+    size_t total = fwd;
+    if(next != NULL){
+        _mem_remove_from_gap_ix(pool_mgr, next->alloc_record.size, next);
+        node->next = next->next;
+        if(next->next != NULL){
+            next->next->prev = node;
+        }
+        _mem_put_node(pool_mgr, next);
+    }
+    if(prev != NULL){
+        _mem_remove_from_gap_ix(pool_mgr, prev->alloc_record.size, prev);
+        memmove(prev->alloc_record.mem, node->alloc_record.mem, old_size);
+        total += prev->alloc_record.size;
+        prev->next = node->next;
+        if(node->next != NULL){
+            node->next->prev = prev;
+        }
+        _mem_put_node(pool_mgr, node);
+        node = prev;
+        node->allocated = 1;
+        node->alignment = alignment;
+    }
+
+    node->alloc_record.size = size;
+    if(total > size){
+        node_pt gap = _mem_split_node(pool_mgr, node, total - size);
+        _mem_add_to_gap_ix(pool_mgr, total - size, gap);
+        if(prev == NULL && size < old_size){
+            _mem_release_pages(pool_mgr, gap->alloc_record.mem, total - size,
+                               gap->alloc_record.mem, node->alloc_record.mem + old_size);
+        }
+    }
+
+    pool_mgr->pool.alloc_size = pool_mgr->pool.alloc_size - old_size + size;
+
+    return (alloc_pt) node;
+}
+
+static alloc_status _mem_node_compact(pool_mgr_pt pool_mgr, size_t budget) {
+    // walk the node list for a gap followed by an allocation of the same
+    //   arena that may move into it, aligned ones only if the start of the
+    //   gap keeps them aligned
+    // for each such pair, until the budget is used up (at least one moves):
+    //    remove the gap from the gap index
+    //    move the payload down to the start of the gap, the gap after it
+    //    swap the two in the node list, the allocation now starts the list
+    //      or the arena if the gap did
+    //    merge the gap with the next node if that is a gap of the same arena
+    //    add the gap back to the gap index at its new place
+    //    give the pages of the bytes moved out of (and of a small merged
+    //      gap) back to the OS, if the pool is mapped and the gap is big enough
+    //    carry on from the gap
+    // return ALLOC_OK if nothing more can move, ALLOC_CALLED_AGAIN otherwise,
+    //   keeping the gap to carry on from on the next call
+    // note: handles are the nodes, so they stay valid, only mem changes
+    // note: nothing before the cursor can move, any gap added to the gap
+    //       index or node put back resets it, as that may change
+    size_t moved = 0;
+    node_pt gap = pool_mgr->compact_cursor != NULL ? pool_mgr->compact_cursor : pool_mgr->node_list;
+
+    while(gap != NULL){
+        node_pt node = gap->next;
+        if(gap->allocated || node == NULL || !node->allocated || _mem_arena_of(pool_mgr, node)
+           || (node->alignment > 1 && (uintptr_t) gap->alloc_record.mem % node->alignment != 0)){
+            gap = node;
+            continue;
+        }
+
+        char *from = node->alloc_record.mem;
+        size_t size = node->alloc_record.size;
+        if(budget != 0 && moved != 0 && size > budget - moved){
+            pool_mgr->compact_cursor = gap;
+            return ALLOC_CALLED_AGAIN;
+        }
+        moved += size;
+
+        // remove the gap from the gap index
+        _mem_remove_from_gap_ix(pool_mgr, gap->alloc_record.size, gap);
+
+        // move the payload down to the start of the gap, the gap after it
+        memmove(gap->alloc_record.mem, from, size);
+        node->alloc_record.mem = gap->alloc_record.mem;
+        gap->alloc_record.mem += size;
+
+        // swap the two in the node list
+        node->prev = gap->prev;
+        if(node->prev != NULL){
+            node->prev->next = node;
+        }
+        gap->next = node->next;
+        if(gap->next != NULL){
+            gap->next->prev = gap;
+        }
+        node->next = gap;
+        gap->prev = node;
+        if(pool_mgr->node_list == gap){
+            pool_mgr->node_list = node;
+        }
+        for(unsigned i = 0; i < pool_mgr->num_arenas; i++){
+            if(pool_mgr->arenas[i].head == gap){
+                pool_mgr->arenas[i].head = node;
+            }
+        }
+
+        // merge the gap with the next node if that is a gap of the same arena
+        char *hi = from + size;
+        node_pt next = gap->next;
+        if(next != NULL && !next->allocated && !_mem_arena_of(pool_mgr, next)){
+            if(next->alloc_record.size < pool_mgr->map_release_min){
+                hi += next->alloc_record.size;
+            }
+            _mem_remove_from_gap_ix(pool_mgr, next->alloc_record.size, next);
+            gap->alloc_record.size += next->alloc_record.size;
+            gap->next = next->next;
+            if(next->next != NULL){
+                next->next->prev = gap;
+            }
+            _mem_put_node(pool_mgr, next);
+        }
+
+        // add the gap back to the gap index at its new place
+        _mem_add_to_gap_ix(pool_mgr, gap->alloc_record.size, gap);
+
+        // give the pages of the bytes moved out of back to the OS
+        _mem_release_pages(pool_mgr, gap->alloc_record.mem, gap->alloc_record.size, from, hi);
+    }
+
+    pool_mgr->compact_cursor = NULL;
+    return ALLOC_OK;
+}
+
+static unsigned _mem_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg) {
+    // hand off to the walker of the policy:
+    //   BUDDY_FIT, walk the block map
+    //   SLAB_FIT, walk the slots along the free list
+    //   TAGGED_FIT, walk the block headers
+    //   ATOMIC_SLAB_FIT, walk the slot states
+    //   otherwise, walk the node list
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        return _mem_buddy_walk(pool_mgr, visit, arg);
+    }
+    if(pool_mgr->pool.policy == SLAB_FIT){
+        return _mem_slab_walk(pool_mgr, visit, arg);
+    }
+    if(pool_mgr->pool.policy == TAGGED_FIT){
+        return _mem_tag_walk(pool_mgr, visit, arg);
+    }
+    if(pool_mgr->pool.policy == ATOMIC_SLAB_FIT){
+        return _mem_lf_walk(pool_mgr, visit, arg);
+    }
+    return _mem_node_walk(pool_mgr, visit, arg);
+}
+
+static int _mem_segment_store(const pool_segment_t *segment, void *buffer) {
+    // store the segment if there is room, count it either way
+    mem_segment_buffer_pt segments = buffer;
+    if(segments->count < segments->capacity){
+        segments->segments[segments->count] = *segment;
+    }
+    segments->count++;
+    return 0;
+}
+
+static unsigned _mem_node_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg) {
+    // walk the node list (address order, arena by arena)
+    //    for each node, visit its size and allocated, stop if the visitor says so
+    // return the number of nodes visited
+    unsigned n = 0;
+
+    for(node_pt node = pool_mgr->node_list; node != NULL && n < pool_mgr->used_nodes; node = node->next)
+    {
+        pool_segment_t segment = { node->alloc_record.size, node->allocated };
+        n++;
+        if(visit(&segment, arg) != 0)
+        {
+            break;
+        }
+    }
+
+    return n;
+}
+
+static alloc_status _mem_resize_pool_store() {
+    // check if necessary
+    /*
+                if (((float) pool_store_size / pool_store_capacity)
+                    > MEM_POOL_STORE_FILL_FACTOR) {...}
+     */
+    // don't forget to update capacity variables
+
+    if(((float)pool_store_size / pool_store_capacity) > MEM_POOL_STORE_FILL_FACTOR){
+        unsigned int oldCapacity = pool_store_capacity;
+        unsigned int newCapacity = pool_store_capacity * MEM_POOL_STORE_EXPAND_FACTOR;
+        pool_mgr_pt *newStore = (pool_mgr_pt  *)realloc(pool_store,sizeof(pool_mgr_pt) * newCapacity);
+
+        if(newStore == NULL){
+            return ALLOC_FAIL;
+        }
+
+        for(size_t i = oldCapacity; i< newCapacity; i++){
+            newStore[i] = NULL;
+        }
+        pool_store = newStore;
+        pool_store_capacity = newCapacity;
+    }
+
+    return ALLOC_OK;
+}
+
+static alloc_status _mem_register_pool(pool_mgr_pt pool_mgr) {
+    // lock the pool store
+    // make sure the pool store is allocated
+    // expand the pool store, if necessary
+    // link pool mgr to pool store
+    // number the pool for traces and trace the open
+    // unlock the pool store
+    alloc_status status = ALLOC_FAIL;
+
+    pthread_mutex_lock(&pool_store_lock);
+
+    if(pool_store != NULL && _mem_resize_pool_store() == ALLOC_OK){
+        pool_store[pool_store_size] = pool_mgr;
+        pool_store_size++;
+        pool_mgr->trace_id = ++trace_num_pools;
+        _mem_trace(pool_mgr, TRACE_OPEN, (void *) (uintptr_t) pool_mgr->slab_object_size,
+                   pool_mgr->pool.total_size, pool_mgr->pool.policy);
+        status = ALLOC_OK;
+    }
+
+    pthread_mutex_unlock(&pool_store_lock);
+
+    return status;
+}
+
+static void _mem_release_pool(pool_mgr_pt pool_mgr) {
+    // free (or unmap) memory pool and its extra arenas, unmap the file
+    //    of a persistent pool, header and all, and close it, unlocking it
+    // free node heap chunks (the gap index lives in them)
+    // free block map (BUDDY_FIT only)
+    // free slot map (SLAB_FIT only) and slot states (ATOMIC_SLAB_FIT only)
+    // destroy the pool lock
+    // free mgr
+    if(pool_mgr->file != NULL){
+        munmap(pool_mgr->file, pool_mgr->map_size);
+        if(pool_mgr->file_fd >= 0){
+            close(pool_mgr->file_fd);
+        }
+    } else {
+        _mem_free_region(pool_mgr->pool.mem, pool_mgr->map_size);
+    }
+    for(unsigned i = 1; i < pool_mgr->num_arenas; i++){
+        _mem_free_region(pool_mgr->arenas[i].mem, pool_mgr->arenas[i].map_size);
+    }
+    for(unsigned i = 0; i < MEM_NODE_HEAP_MAX_CHUNKS; i++){
+        free(pool_mgr->node_heap[i]);
+    }
+    free(pool_mgr->buddy_map);
+    free(pool_mgr->slab_map);
+    free(pool_mgr->lf_state);
+    free(pool_mgr->cache_map);
+    pthread_mutex_destroy(&pool_mgr->lock);
+    free(pool_mgr);
+}
+
+static char * _mem_new_region(pool_mgr_pt pool_mgr, size_t size, size_t *map_size) {
+    // if the pool is not mapped, allocate zeroed memory from the heap,
+    //   at the base alignment if there is one
+    // for huge pages, round the size up to whole huge pages and try
+    //   reserved huge pages (hugetlbfs) first, those come aligned
+    // otherwise round the size up to whole pages
+    // map anonymous memory, with room to trim to an alignment above a page
+    //   (for huge pages, at least the huge page size)
+    // unmap the slack before and after the aligned start
+    // for huge pages, ask for transparent huge pages, without failing
+    //   if the kernel does not do them, the pages are then small ones
+    // note: aligned_alloc wants a multiple of the alignment, the region
+    //       still spans size bytes
+    // note: the pages are committed when first touched, and read as zeros
+    size_t alignment = pool_mgr->mem_alignment;
+    size_t page = pool_mgr->map_page;
+    int huge = (page == MEM_MAP_HUGE_PAGE);
+
+    *map_size = 0;
+    if(page == 0){
+        if(alignment <= 1){
+            return (char *) calloc(size, sizeof(char));
+        }
+        if(size > SIZE_MAX - alignment){
+            return NULL;
+        }
+        char *mem = (char *) aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+        if(mem != NULL){
+            memset(mem, 0, size);
+        }
+        return mem;
+    }
+
+    if(size == 0 || size > SIZE_MAX - page - alignment){
+        return NULL;
+    }
+    size_t rounded = (size + page - 1) & ~(page - 1);
+
+#ifdef MAP_HUGETLB
+    if(huge && alignment <= page){
+        char *map = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(map != MAP_FAILED){
+            *map_size = rounded;
+            return map;
+        }
+    }
+#endif
+
+    if(huge && alignment < page){
+        alignment = page;
+    }
+    size_t slack = (alignment > (size_t) sysconf(_SC_PAGESIZE)) ? alignment : 0;
+
+    char *map = mmap(NULL, rounded + slack, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(map == MAP_FAILED){
+        return NULL;
+    }
+
+    char *mem = map;
+    if(slack != 0){
+        mem = (char *) (((uintptr_t) map + alignment - 1) & ~((uintptr_t) alignment - 1));
+        if(mem != map){
+            munmap(map, (size_t) (mem - map));
+        }
+        if(mem + rounded != map + rounded + slack){
+            munmap(mem + rounded, (size_t) (map + slack - mem));
+        }
+    }
+
+#ifdef MADV_HUGEPAGE
+    if(huge){
+        madvise(mem, rounded, MADV_HUGEPAGE);
+    }
+#endif
+
+    *map_size = rounded;
+    return mem;
+}
+
+static void _mem_free_region(char *mem, size_t map_size) {
+    // unmap a mapped region, free one from the heap
+    if(map_size != 0){
+        munmap(mem, map_size);
+    } else {
+        free(mem);
+    }
+}
+
+static alloc_status _mem_file_map(pool_mgr_pt pool_mgr, const char *path, size_t size, int shm) {
+    // if size is not 0, create the file, only if there is none at path,
+    //    and size it to a header and size rounded up to whole pages,
+    //    otherwise open it as it is, it has to hold more than a header
+    // for shm, path names a shared memory object instead, others may be
+    //    using it
+    // lock the file, failing if another open pool holds it
+    // map all of it shared, so that stores reach the file
+    // keep the file open to hold the lock, close a shared memory object,
+    //    the mapping keeps it open
+    // pool.mem starts right after the header, on a page boundary
+    // note: a new file reads as zeros
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t file_size;
+    int fd;
+
+    if(size != 0){
+        if(size > SIZE_MAX - page - MEM_FILE_HEADER_SIZE){
+            return ALLOC_FAIL;
+        }
+        file_size = MEM_FILE_HEADER_SIZE + ((size + page - 1) & ~(page - 1));
+        fd = shm ? shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600)
+                 : open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if(fd < 0){
+            return ALLOC_FAIL;
+        }
+        if((!shm && flock(fd, LOCK_EX | LOCK_NB) != 0) || ftruncate(fd, (off_t) file_size) != 0){
+            close(fd);
+            return ALLOC_FAIL;
+        }
+    } else {
+        struct stat st;
+        fd = shm ? shm_open(path, O_RDWR, 0) : open(path, O_RDWR);
+        if(fd < 0){
+            return ALLOC_FAIL;
+        }
+        if((!shm && flock(fd, LOCK_EX | LOCK_NB) != 0)
+           || fstat(fd, &st) != 0 || st.st_size <= MEM_FILE_HEADER_SIZE){
+            close(fd);
+            return ALLOC_FAIL;
+        }
+        file_size = (size_t) st.st_size;
+    }
+
+    char *map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(shm || map == MAP_FAILED){
+        close(fd);
+        fd = -1;
+    }
+    if(map == MAP_FAILED){
+        return ALLOC_FAIL;
+    }
+
+    pool_mgr->file = (mem_file_header_pt) map;
+    pool_mgr->file_fd = fd;
+    pool_mgr->map_size = file_size;
+    pool_mgr->pool.mem = map + MEM_FILE_HEADER_SIZE;
+
+    return ALLOC_OK;
+}
+
+static void _mem_file_save(pool_mgr_pt pool_mgr, uint32_t clean) {
+    // write the magic, the version and the counts into the header
+    // flush the whole file, then mark the header and flush it again, so
+    //    that a header marked closed never goes out ahead of the pool
+    // note: the root and the free lists are kept in the header already
+    mem_file_header_pt file = pool_mgr->file;
+
+    memcpy(file->magic, MEM_FILE_MAGIC, sizeof(file->magic));
+    file->version = MEM_FILE_VERSION;
+    file->size = pool_mgr->map_size - MEM_FILE_HEADER_SIZE;
+    file->tag_first = pool_mgr->tag_first;
+    file->total_size = pool_mgr->pool.total_size;
+    file->alloc_size = pool_mgr->pool.alloc_size;
+    file->num_allocs = pool_mgr->pool.num_allocs;
+    file->num_gaps = pool_mgr->pool.num_gaps;
+
+    msync(file, pool_mgr->map_size, MS_SYNC);
+    file->clean = clean;
+    msync(file, MEM_FILE_HEADER_SIZE, MS_SYNC);
+}
+
+static pool_pt _mem_reopen(const char *path, int shm) {
+    // allocate a new mem pool mgr
+    // check success, on error return null
+    // initialize the pool lock
+    // map the file (or shared memory object) of the pool, on error
+    //   deallocate mgr and return null
+    // check the header is one this version wrote, for a pool the size of
+    //   the file, on error deallocate all and return null
+    // keep the free lists in the header
+    // if the pool is shared, take its counts under its lock
+    // otherwise, if the pool was closed, take its counts from the header,
+    //   if not, rebuild the free lists and the counts from the boundary
+    //   tags, on error deallocate all and return null, then mark the
+    //   header open
+    // link pool mgr to pool store (it must be allocated), on error deallocate all
+    // return the address of the mgr, cast to (pool_pt)
+
+    // allocate a new mem pool mgr
+    pool_mgr_pt mem_mgr = (pool_mgr_pt ) calloc(1, sizeof(pool_mgr_t));
+    // check if successful
+    if(mem_mgr == NULL)
+    {
+        return NULL;
+    }
+
+    // initialize the pool lock
+    pthread_mutex_init(&mem_mgr->lock, NULL);
+
+    // map the file (or shared memory object) of the pool
+    mem_mgr->pool.policy = TAGGED_FIT;
+    mem_mgr->map_release_min = SIZE_MAX;
+    if(_mem_file_map(mem_mgr, path, 0, shm) == ALLOC_FAIL)
+    {
+        _mem_release_pool(mem_mgr);
+        return NULL;
+    }
+
+    // check the header is one this version wrote, for a pool the size of the file
+    mem_file_header_pt file = mem_mgr->file;
+    if(memcmp(file->magic, MEM_FILE_MAGIC, sizeof(file->magic)) != 0
+       || file->version != MEM_FILE_VERSION
+       || file->size != mem_mgr->map_size - MEM_FILE_HEADER_SIZE
+       || file->tag_first < MEM_TAG_SIZE || file->tag_first > file->size
+       || file->total_size > file->size - file->tag_first)
+    {
+        _mem_release_pool(mem_mgr);
+        return NULL;
+    }
+    mem_mgr->tag_first = file->tag_first;
+    mem_mgr->pool.total_size = file->total_size;
+
+    // keep the free lists in the header
+    mem_mgr->tag_lists = &file->tag_lists;
+
+    // if the pool is shared, take its counts under its lock
+    if(file->shared)
+    {
+        _mem_lock(mem_mgr);
+        _mem_unlock(mem_mgr);
+    }
+    else
+    {
+        // if the pool was closed, take its counts from the header,
+        //   otherwise rebuild the free lists and the counts from the tags
+        if(file->clean)
+        {
+            mem_mgr->pool.alloc_size = file->alloc_size;
+            mem_mgr->pool.num_allocs = file->num_allocs;
+            mem_mgr->pool.num_gaps = file->num_gaps;
+        }
+        else if(_mem_tag_rebuild(mem_mgr) == ALLOC_FAIL)
+        {
+            _mem_release_pool(mem_mgr);
+            return NULL;
+        }
+
+        // mark the header open
+        file->clean = 0;
+    }
+
+    // link pool mgr to pool store (it must be allocated), on error deallocate all
+    if(_mem_register_pool(mem_mgr) == ALLOC_FAIL)
+    {
+        _mem_release_pool(mem_mgr);
+        return NULL;
+    }
+
+    // return the address of the mgr, cast to (pool_pt)
+    return (pool_pt)mem_mgr;
+}
+
+// note: a shared pool is used by several processes, each with its own mgr;
+//       its free lists are in the header, its counts are taken from the
+//       header with the lock and put back before letting go of it
+static void _mem_lock(pool_mgr_pt pool_mgr) {
+    // lock the pool in this process
+    // if the pool is shared, lock it across processes too
+    //    if the last holder died with the lock, rebuild the free lists and
+    //    the counts from the boundary tags and mark the lock consistent
+    //    otherwise take the counts from the header
+    // note num_allocs, for the statistics
+    pthread_mutex_lock(&pool_mgr->lock);
+
+    mem_file_header_pt file = pool_mgr->file;
+    if(file != NULL && file->shared){
+        if(pthread_mutex_lock(&file->lock) == EOWNERDEAD){
+            _mem_tag_rebuild(pool_mgr);
+            pthread_mutex_consistent(&file->lock);
+        } else {
+            pool_mgr->pool.alloc_size = file->alloc_size;
+            pool_mgr->pool.num_allocs = file->num_allocs;
+            pool_mgr->pool.num_gaps = file->num_gaps;
+        }
+    }
+
+    pool_mgr->locked_num_allocs = pool_mgr->pool.num_allocs;
+}
+
+static void _mem_unlock(pool_mgr_pt pool_mgr) {
+    // count the allocations and frees of the call by the change in
+    //    num_allocs, keep the peak of alloc_size
+    // if the pool is shared, put the counts back in the header and
+    //    unlock it across processes
+    // unlock the pool in this process
+    // note: ATOMIC_SLAB_FIT counts in its allocator, num_allocs changes
+    //       without the lock
+    if(pool_mgr->pool.policy != ATOMIC_SLAB_FIT){
+        if(pool_mgr->pool.num_allocs > pool_mgr->locked_num_allocs){
+            pool_mgr->total_allocs += pool_mgr->pool.num_allocs - pool_mgr->locked_num_allocs;
+        } else {
+            pool_mgr->total_frees += pool_mgr->locked_num_allocs - pool_mgr->pool.num_allocs;
+        }
+        if(pool_mgr->pool.alloc_size > pool_mgr->peak_alloc_size){
+            pool_mgr->peak_alloc_size = pool_mgr->pool.alloc_size;
+        }
+    }
+
+    mem_file_header_pt file = pool_mgr->file;
+    if(file != NULL && file->shared){
+        file->alloc_size = pool_mgr->pool.alloc_size;
+        file->num_allocs = pool_mgr->pool.num_allocs;
+        file->num_gaps = pool_mgr->pool.num_gaps;
+        pthread_mutex_unlock(&file->lock);
+    }
+
+    pthread_mutex_unlock(&pool_mgr->lock);
+}
+
+static void _mem_count_failed(pool_mgr_pt pool_mgr) {
+    atomic_fetch_add_explicit(&pool_mgr->failed_allocs, 1, memory_order_relaxed);
+}
+
+// note: exact, past the bit-scan for the largest size class only its
+//       list is walked (the tree policies take the rightmost gap)
+static size_t _mem_largest_gap(pool_mgr_pt pool_mgr) {
+    // BUDDY_FIT, the block of the highest non-empty order
+    // SLAB_FIT and ATOMIC_SLAB_FIT, a slot, if any is free
+    // TAGGED_FIT, the largest block on the highest non-empty class list
+    // FAST_FIT, the largest gap on the highest non-empty class list
+    // TLSF_FIT, the largest gap on the highest non-empty two-level list
+    // otherwise, the rightmost gap of the tree, keyed on (size, mem)
+    // note: the caller holds the pool lock
+    size_t largest = 0;
+
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        if(pool_mgr->buddy_free_map != 0){
+            largest = (size_t) 1 << (63 - __builtin_clzll(pool_mgr->buddy_free_map));
+        }
+    } else if(pool_mgr->pool.policy == SLAB_FIT || pool_mgr->pool.policy == ATOMIC_SLAB_FIT){
+        if(pool_mgr->pool.num_gaps != 0){
+            largest = pool_mgr->slab_slot_size;
+        }
+    } else if(pool_mgr->pool.policy == TAGGED_FIT){
+        if(pool_mgr->tag_lists->class_map != 0){
+            unsigned c = 63 - __builtin_clzll(pool_mgr->tag_lists->class_map);
+            for(size_t offset = pool_mgr->tag_lists->classes[c]; offset != 0;
+                offset = ((tag_link_pt) (pool_mgr->pool.mem + offset + MEM_TAG_SIZE))->next){
+                size_t block = *(size_t *) (pool_mgr->pool.mem + offset);
+                if(block > largest){
+                    largest = block;
+                }
+            }
+        }
+    } else if(pool_mgr->pool.policy == FAST_FIT || pool_mgr->pool.policy == TLSF_FIT){
+        node_pt head = NULL;
+        if(pool_mgr->pool.policy == FAST_FIT && pool_mgr->gap_class_map != 0){
+            head = pool_mgr->gap_classes[63 - __builtin_clzll(pool_mgr->gap_class_map)];
+        }
+        if(pool_mgr->pool.policy == TLSF_FIT && pool_mgr->tlsf_fl_map != 0){
+            unsigned fl = 63 - __builtin_clzll(pool_mgr->tlsf_fl_map);
+            head = pool_mgr->tlsf_lists[fl][31 - __builtin_clz(pool_mgr->tlsf_sl_map[fl])];
+        }
+        for(node_pt node = head; node != NULL; node = node->class_next){
+            if(node->alloc_record.size > largest){
+                largest = node->alloc_record.size;
+            }
+        }
+    } else {
+        node_pt node = pool_mgr->gap_ix;
+        while(node != NULL && node->right != NULL){
+            node = node->right;
+        }
+        if(node != NULL){
+            largest = node->alloc_record.size;
+        }
+    }
+
+    return largest;
+}
+
+// note: lock-free, the ring belongs to the calling thread and a dump reads
+//       only up to the head it finds
+static void _mem_trace(pool_mgr_pt pool_mgr, trace_op op, const void *handle, size_t size, size_t arg) {
+    // nothing to do unless tracing
+    // get the ring of the calling thread, none if it could not be had
+    // stamp the event and write it at the head, over the oldest one
+    // publish it by moving the head past it
+    if(!atomic_load_explicit(&trace_on, memory_order_relaxed)){
+        return;
+    }
+
+    mem_trace_ring_pt ring = _mem_trace_ring();
+    if(ring == NULL){
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_event_pt event = &ring->events[head & ring->mask];
+    event->time_ns = (unsigned long long) ts.tv_sec * 1000000000u + (unsigned long long) ts.tv_nsec;
+    event->handle = (uintptr_t) handle;
+    event->size = size;
+    event->arg = arg;
+    event->pool = pool_mgr->trace_id;
+    event->op = (unsigned short) op;
+    event->thread = (unsigned short) ring->thread;
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+static mem_trace_ring_pt _mem_trace_ring() {
+    // if the thread has a ring of the current trace, that is it
+    // otherwise, with the trace locked, if the trace is still on:
+    //    allocate a ring of the trace capacity and number the thread
+    //    link it to the rings of the trace
+    // remember the ring for this trace, none if it could not be had
+    unsigned generation = atomic_load_explicit(&trace_generation, memory_order_acquire);
+    if(thread_ring_generation == generation){
+        return thread_ring;
+    }
+
+    mem_trace_ring_pt ring = NULL;
+    pthread_mutex_lock(&trace_lock);
+    if(atomic_load_explicit(&trace_on, memory_order_relaxed)
+       && generation == atomic_load_explicit(&trace_generation, memory_order_relaxed)
+       && trace_num_threads < MEM_TRACE_MAX_THREADS){
+        ring = calloc(1, sizeof(mem_trace_ring_t) + trace_capacity * sizeof(trace_event_t));
+        if(ring != NULL){
+            ring->thread = trace_num_threads++;
+            ring->mask = trace_capacity - 1;
+            atomic_init(&ring->head, 0);
+            ring->next = trace_rings;
+            trace_rings = ring;
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    thread_ring = ring;
+    thread_ring_generation = generation;
+
+    return ring;
+}
+
+static node_pt _mem_grow(pool_mgr_pt pool_mgr, size_t size) {
+    // check the pool can grow and has room for one more arena
+    // expand heap node for the arena's node and two splits, quit on error
+    // allocate a region of size, at least the pool's arena size, backed
+    //    like pool.mem
+    // make its one gap node, at the end of the node list (the end of the
+    //    last arena), and add it to the gap index
+    // add the arena, update metadata (total_size)
+    // return the gap node
+    if(pool_mgr->arena_size == 0 || pool_mgr->num_arenas == MEM_MAX_ARENAS){
+        return NULL;
+    }
+
+    if(_mem_resize_node_heap(pool_mgr, 3) == ALLOC_FAIL
+       || pool_mgr->total_nodes - pool_mgr->used_nodes < 3){
+        return NULL;
+    }
+
+    if(size < pool_mgr->arena_size){
+        size = pool_mgr->arena_size;
+    }
+    size_t map_size;
+    char *mem = _mem_new_region(pool_mgr, size, &map_size);
+    if(mem == NULL){
+        return NULL;
+    }
+
+    node_pt tail = pool_mgr->arenas[pool_mgr->num_arenas - 1].head;
+    while(tail->next != NULL){
+        tail = tail->next;
+    }
+
+    node_pt node = _mem_get_node(pool_mgr);
+    node->allocated = 0;
+    node->alloc_record.mem = mem;
+    node->alloc_record.size = size;
+    node->prev = tail;
+    node->next = NULL;
+    tail->next = node;
+    _mem_add_to_gap_ix(pool_mgr, size, node);
+
+    mem_arena_pt arena = &pool_mgr->arenas[pool_mgr->num_arenas++];
+    arena->mem = mem;
+    arena->size = size;
+    arena->map_size = map_size;
+    arena->head = node;
+    pool_mgr->pool.total_size += size;
+
+    return node;
+}
+
+static void _mem_shrink(pool_mgr_pt pool_mgr, node_pt gap) {
+    // check the gap is a whole arena other than the first
+    // remove it from the gap index and the node list
+    // push its node onto the free node stack as unused
+    // free the region, drop the arena, keeping the others in list order
+    // update metadata (total_size)
+    unsigned i = _mem_arena_of(pool_mgr, gap);
+    if(i == 0 || gap->alloc_record.size != pool_mgr->arenas[i].size){
+        return;
+    }
+
+    _mem_remove_from_gap_ix(pool_mgr, gap->alloc_record.size, gap);
+    gap->prev->next = gap->next;
+    if(gap->next != NULL){
+        gap->next->prev = gap->prev;
+    }
+    _mem_put_node(pool_mgr, gap);
+
+    mem_arena_t arena = pool_mgr->arenas[i];
+    _mem_free_region(arena.mem, arena.map_size);
+    memmove(&pool_mgr->arenas[i], &pool_mgr->arenas[i + 1],
+            (pool_mgr->num_arenas - i - 1) * sizeof(mem_arena_t));
+    pool_mgr->num_arenas--;
+    pool_mgr->pool.total_size -= arena.size;
+}
+
+// note: there are at most MEM_MAX_ARENAS arenas, so this is bounded by a
+//       constant, and free for pools that cannot grow
+static unsigned _mem_arena_of(pool_mgr_pt pool_mgr, node_pt node) {
+    // the index of the arena node is the head of, 0 if none but the first
+    for(unsigned i = 1; i < pool_mgr->num_arenas; i++){
+        if(pool_mgr->arenas[i].head == node){
+            return i;
+        }
+    }
+    return 0;
+}
+
+static void _mem_release_pages(pool_mgr_pt pool_mgr, char *gap, size_t gap_size, char *lo, char *hi) {
+    // only for mapped pools, and gaps of at least the release minimum
+    // the pages to give back are those inside the gap that overlap [lo, hi),
+    //   the bytes just freed and the small gaps merged with them
+    // note: pages of big gaps were given back when those were freed, they
+    //       are not given back again every time the gap grows
+    // note: huge pages are given back whole only, a partly free huge page
+    //       is kept rather than split
+    if(pool_mgr->map_size == 0 || gap_size < pool_mgr->map_release_min){
+        return;
+    }
+
+    uintptr_t page = (uintptr_t) pool_mgr->map_page;
+    uintptr_t start = ((uintptr_t) gap + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t) gap + gap_size) & ~(page - 1);
+    uintptr_t lo_page = (uintptr_t) lo & ~(page - 1);
+    uintptr_t hi_page = ((uintptr_t) hi + page - 1) & ~(page - 1);
+
+    if(start < lo_page){
+        start = lo_page;
+    }
+    if(end > hi_page){
+        end = hi_page;
+    }
+    if(start < end){
+        madvise((void *) start, end - start, MADV_DONTNEED);
+    }
+}
+
+static alloc_status _mem_resize_node_heap(pool_mgr_pt pool_mgr, unsigned needed) {
+    // see above, with needed more nodes about to be used
+    // note: the heap grows by adding a chunk, so nodes never move and
+    //       neither handles nor node links need fixing up
+    while(((float)(pool_mgr->used_nodes + needed) / pool_mgr->total_nodes) > MEM_NODE_HEAP_FILL_FACTOR){
+        if(pool_mgr->num_chunks == MEM_NODE_HEAP_MAX_CHUNKS){
+            return ALLOC_FAIL;
+        }
+
+        unsigned int chunkSize = pool_mgr->total_nodes * (MEM_NODE_HEAP_EXPAND_FACTOR - 1);
+        node_pt chunk = (node_pt) calloc(chunkSize, sizeof(node_t));
+
+        if(chunk == NULL){
+            return ALLOC_FAIL;
+        }
+
+        pool_mgr->node_heap[pool_mgr->num_chunks] = chunk;
+        pool_mgr->num_chunks++;
+        pool_mgr->total_nodes += chunkSize;
+
+        // stack the new nodes as unused, lowest on top
+        for(size_t i = chunkSize; i > 0; i--){
+            _mem_put_node(pool_mgr, &chunk[i - 1]);
+        }
+    }
+
+    return ALLOC_OK;
+}
+
+// note: the handle is checked against each chunk, of which there are at
+//       most MEM_NODE_HEAP_MAX_CHUNKS, so this is bounded by a constant
+static node_pt _mem_find_node(pool_mgr_pt pool_mgr, void *alloc) {
+    // find the node heap chunk the address is in, check it is at a node
+    //   and the node is intact
+    uintptr_t addr = (uintptr_t) alloc;
+    unsigned chunkSize = MEM_NODE_HEAP_INIT_CAPACITY;
+    unsigned total = 0;
+
+    for(unsigned i = 0; i < pool_mgr->num_chunks; i++){
+        uintptr_t base = (uintptr_t) pool_mgr->node_heap[i];
+
+        if(i > 0){
+            chunkSize = total * (MEM_NODE_HEAP_EXPAND_FACTOR - 1);
+        }
+        total += chunkSize;
+
+        if(addr >= base && addr - base < (uintptr_t) chunkSize * sizeof(node_t)){
+            if((addr - base) % sizeof(node_t) != 0 || ((node_pt) addr)->magic != MEM_NODE_MAGIC){
+                return NULL;
+            }
+            return (node_pt) addr;
+        }
+    }
+
+    return NULL;
+}
+
+static node_pt _mem_get_node(pool_mgr_pt pool_mgr) {
+    // pop the top of the free node stack
+    // mark it as used
+    // update metadata (used_nodes)
+    node_pt node = pool_mgr->free_nodes;
+
+    if(node == NULL){
+        return NULL;
+    }
+
+    pool_mgr->free_nodes = node->next;
+    node->next = NULL;
+    node->used = 1;
+    pool_mgr->used_nodes++;
+
+    return node;
+}
+
+static void _mem_put_node(pool_mgr_pt pool_mgr, node_pt node) {
+    // mark the node as unused, clearing the allocation record
+    // push it on the free node stack
+    // update metadata (used_nodes), if it was used
+    // start the next compaction over
+    if(node->used){
+        pool_mgr->used_nodes--;
+    }
+    node->used = 0;
+    node->allocated = 0;
+    node->magic = MEM_NODE_MAGIC;
+    node->alloc_record.size = 0;
+    node->alloc_record.mem = NULL;
+    node->prev = NULL;
+
+    node->next = pool_mgr->free_nodes;
+    pool_mgr->free_nodes = node;
+
+    pool_mgr->compact_cursor = NULL;
+}
+
+static alloc_status _mem_add_to_gap_ix(pool_mgr_pt pool_mgr,
+                                       size_t size,
+                                       node_pt node) {
+
+    // if FAST_FIT, push the node onto the list of its size class
+    //    and mark the class as non-empty
+    // if TLSF_FIT, push the node onto the list of its (first, second) level
+    //    and mark both levels as non-empty
+    // otherwise, reset the tree links of the node
+    // insert the node into the tree, keyed on (size, mem)
+    // update metadata (num_gaps, gap counts)
+    // start the next compaction over, the gap may let more move
+    pool_mgr->compact_cursor = NULL;
+
+    if(pool_mgr->pool.policy == FAST_FIT){
+        unsigned c = _mem_gap_class(size);
+
+        _mem_gap_list_push(&pool_mgr->gap_classes[c], node);
+        pool_mgr->gap_class_map |= (uint64_t) 1 << c;
+
+        pool_mgr->pool.num_gaps += 1;
+        pool_mgr->gap_counts[_mem_gap_class(size)]++;
+        return ALLOC_OK;
+    }
+
+    if(pool_mgr->pool.policy == TLSF_FIT){
+        unsigned fl, sl;
+
+        _mem_tlsf_mapping(size, &fl, &sl);
+        _mem_gap_list_push(&pool_mgr->tlsf_lists[fl][sl], node);
+        pool_mgr->tlsf_sl_map[fl] |= (uint32_t) 1 << sl;
+        pool_mgr->tlsf_fl_map |= (uint64_t) 1 << fl;
+
+        pool_mgr->pool.num_gaps += 1;
+        pool_mgr->gap_counts[_mem_gap_class(size)]++;
+        return ALLOC_OK;
+    }
+
+    node->left = NULL;
+    node->right = NULL;
+    node->height = 1;
+
+    pool_mgr->gap_ix = _mem_gap_insert(pool_mgr->gap_ix, node);
+
+    pool_mgr->pool.num_gaps += 1;
+    pool_mgr->gap_counts[_mem_gap_class(size)]++;
+    return ALLOC_OK;
+}
+
+static alloc_status _mem_remove_from_gap_ix(pool_mgr_pt pool_mgr,
+                                            size_t size,
+                                            node_pt node) {
+    // if FAST_FIT, unlink the node from the list of its size class
+    //    and clear the class bit if the list became empty
+    // if TLSF_FIT, unlink the node from the list of its (first, second) level
+    //    and clear the level bits if the lists became empty
+    // otherwise, find the node in the tree by its key (size, mem) and unlink it
+    // update metadata (num_gaps, gap counts)
+    if(pool_mgr->pool.policy == FAST_FIT){
+        unsigned c = _mem_gap_class(size);
+
+        if(_mem_gap_list_unlink(&pool_mgr->gap_classes[c], node) == ALLOC_FAIL){
+            return ALLOC_FAIL;
+        }
+        if(pool_mgr->gap_classes[c] == NULL){
+            pool_mgr->gap_class_map &= ~((uint64_t) 1 << c);
+        }
+
+        pool_mgr->pool.num_gaps -= 1;
+        pool_mgr->gap_counts[_mem_gap_class(size)]--;
+        return ALLOC_OK;
+    }
+
+    if(pool_mgr->pool.policy == TLSF_FIT){
+        unsigned fl, sl;
+
+        _mem_tlsf_mapping(size, &fl, &sl);
+        if(_mem_gap_list_unlink(&pool_mgr->tlsf_lists[fl][sl], node) == ALLOC_FAIL){
+            return ALLOC_FAIL;
+        }
+        if(pool_mgr->tlsf_lists[fl][sl] == NULL){
+            pool_mgr->tlsf_sl_map[fl] &= ~((uint32_t) 1 << sl);
+            if(pool_mgr->tlsf_sl_map[fl] == 0){
+                pool_mgr->tlsf_fl_map &= ~((uint64_t) 1 << fl);
+            }
+        }
+
+        pool_mgr->pool.num_gaps -= 1;
+        pool_mgr->gap_counts[_mem_gap_class(size)]--;
+        return ALLOC_OK;
+    }
+
+    int found = 0;
+
+    pool_mgr->gap_ix = _mem_gap_remove(pool_mgr->gap_ix, node, &found);
+
+    if(!found){
+        return ALLOC_FAIL;
+    }
+
+    node->left = NULL;
+    node->right = NULL;
+    node->height = 0;
+
+    pool_mgr->pool.num_gaps -= 1;
+    pool_mgr->gap_counts[_mem_gap_class(size)]--;
+    return ALLOC_OK;
+}
+
+// note: the smallest gap that fits, ties broken on the lowest address (mem)
+static node_pt _mem_find_gap(pool_mgr_pt pool_mgr, size_t size) {
+    // find a gap of at least size by the policy:
+    node_pt temp_node = NULL;
+
+    // if FIRST_FIT, then find the first sufficient node in the node list
+    if(pool_mgr->pool.policy == FIRST_FIT)
+    {
+        /* walk the list in address order, need to check if node is
+         * a gap and if the gap size is larger than size
+         */
+        for(node_pt node = pool_mgr->node_list; node != NULL; node = node->next)
+        {
+            if(!(node->allocated) && node->alloc_record.size >= size)
+            {
+                temp_node = node;
+                break;
+            }
+        }
+    }
+
+    // if BEST_FIT, then find the smallest sufficient node in the gap index
+    if(pool_mgr->pool.policy == BEST_FIT)
+    {
+        temp_node = _mem_find_best_gap(pool_mgr, size);
+    }
+
+    // if FAST_FIT, then find a sufficient node in the gap size classes
+    if(pool_mgr->pool.policy == FAST_FIT)
+    {
+        temp_node = _mem_find_fast_gap(pool_mgr, size);
+    }
+
+    // if TLSF_FIT, then find a sufficient node in the two-level gap lists
+    if(pool_mgr->pool.policy == TLSF_FIT)
+    {
+        temp_node = _mem_find_tlsf_gap(pool_mgr, size);
+    }
+
+    return temp_node;
+}
+
+static node_pt _mem_split_node(pool_mgr_pt pool_mgr, node_pt node, size_t rem_gap) {
+    // pop an unused node off the free node stack
+    // make sure one was found
+    // initialize it to a gap node of rem_gap, right after the end of node
+    // update linked list (new node right after node)
+    // note: the caller has already shrunk node, the new gap is not indexed
+    node_pt new_node = _mem_get_node(pool_mgr);
+    if(new_node == NULL){
+        return NULL;
+    }
+
+    new_node->allocated = 0;
+    new_node->used = 1;
+    new_node->alloc_record.size = rem_gap;
+    new_node->alloc_record.mem = node->alloc_record.mem + node->alloc_record.size;
+
+    new_node->prev = node;
+    new_node->next = node->next;
+    if(node->next != NULL){
+        node->next->prev = new_node;
+    }
+    node->next = new_node;
+
+    return new_node;
+}
+
+static node_pt _mem_find_best_gap(pool_mgr_pt pool_mgr, size_t size) {
+    // descend from the root:
+    //    if the current gap is sufficient, remember it and go left
+    //    otherwise go right
+    node_pt best = NULL;
+    node_pt cur = pool_mgr->gap_ix;
+
+    while(cur != NULL){
+        if(cur->alloc_record.size >= size){
+            best = cur;
+            cur = cur->left;
+        } else {
+            cur = cur->right;
+        }
+    }
+
+    return best;
+}
+
+// note: not a best fit, the head of the size's own class is tried first,
+//       then the head of the next non-empty larger class (every gap there fits)
+static node_pt _mem_find_fast_gap(pool_mgr_pt pool_mgr, size_t size) {
+    // get the class of the size
+    // if the head of its list is sufficient, take it
+    // mask off the classes up to and including the size's class
+    // bit-scan for the lowest remaining non-empty class and take its head
+    unsigned c = _mem_gap_class(size);
+    node_pt head = pool_mgr->gap_classes[c];
+
+    if(head != NULL && head->alloc_record.size >= size){
+        return head;
+    }
+
+    if(c + 1 >= MEM_GAP_NUM_CLASSES){
+        return NULL;
+    }
+
+    uint64_t larger = pool_mgr->gap_class_map & (~(uint64_t) 0 << (c + 1));
+    if(larger == 0){
+        return NULL;
+    }
+
+    return pool_mgr->gap_classes[__builtin_ctzll(larger)];
+}
+
+// note: good fit in constant time, past the head of the size's own list
+//       the size is rounded up so that every gap on the chosen list fits
+static node_pt _mem_find_tlsf_gap(pool_mgr_pt pool_mgr, size_t size) {
+    // if the head of the list of the size itself fits, take it
+    // otherwise round the size up to the next second-level boundary
+    // map it to its (first, second) level
+    // bit-scan for a non-empty list at the same first level, at or above
+    //    the second level
+    // otherwise bit-scan for the next non-empty first level and take its
+    //    lowest non-empty second level
+    unsigned fl, sl;
+
+    _mem_tlsf_mapping(size, &fl, &sl);
+    node_pt head = pool_mgr->tlsf_lists[fl][sl];
+    if(head != NULL && head->alloc_record.size >= size){
+        return head;
+    }
+
+    if(size >= MEM_TLSF_SL_COUNT){
+        size_t round = ((size_t) 1 << (_mem_gap_class(size) - MEM_TLSF_SL_LOG2)) - 1;
+        if(size + round < size){
+            return NULL;
+        }
+        size += round;
+    }
+    _mem_tlsf_mapping(size, &fl, &sl);
+
+    uint32_t sl_map = pool_mgr->tlsf_sl_map[fl] & (~(uint32_t) 0 << sl);
+    if(sl_map == 0){
+        if(fl + 1 >= MEM_TLSF_FL_COUNT){
+            return NULL;
+        }
+        uint64_t fl_map = pool_mgr->tlsf_fl_map & (~(uint64_t) 0 << (fl + 1));
+        if(fl_map == 0){
+            return NULL;
+        }
+        fl = __builtin_ctzll(fl_map);
+        sl_map = pool_mgr->tlsf_sl_map[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    return pool_mgr->tlsf_lists[fl][sl];
+}
+
+// note: sizes below MEM_TLSF_SL_COUNT go on first level 0 one per list,
+//       the rest split each power of two into MEM_TLSF_SL_COUNT lists
+static void _mem_tlsf_mapping(size_t size, unsigned *fl, unsigned *sl) {
+    if(size < MEM_TLSF_SL_COUNT){
+        *fl = 0;
+        *sl = (unsigned) size;
+        return;
+    }
+
+    unsigned c = _mem_gap_class(size);
+    *fl = c - MEM_TLSF_SL_LOG2 + 1;
+    *sl = (unsigned) (size >> (c - MEM_TLSF_SL_LOG2)) - MEM_TLSF_SL_COUNT;
+}
+
+static void _mem_gap_list_push(node_pt *head, node_pt node) {
+    node->class_prev = NULL;
+    node->class_next = *head;
+    if(node->class_next != NULL){
+        node->class_next->class_prev = node;
+    }
+    *head = node;
+}
+
+static alloc_status _mem_gap_list_unlink(node_pt *head, node_pt node) {
+    if(node->class_prev != NULL){
+        node->class_prev->class_next = node->class_next;
+    } else if(*head == node){
+        *head = node->class_next;
+    } else {
+        return ALLOC_FAIL;
+    }
+    if(node->class_next != NULL){
+        node->class_next->class_prev = node->class_prev;
+    }
+
+    node->class_next = NULL;
+    node->class_prev = NULL;
+    return ALLOC_OK;
+}
+
+// note: class c holds the gaps with sizes in [2^c, 2^(c+1))
+static unsigned _mem_gap_class(size_t size) {
+    if(size == 0){
+        return 0;
+    }
+    return 63 - __builtin_clzll((unsigned long long) size);
+}
+
+static int _mem_gap_cmp(size_t size, const char *mem, node_pt node) {
+    if(size != node->alloc_record.size){
+        return (size < node->alloc_record.size) ? -1 : 1;
+    }
+    if(mem != node->alloc_record.mem){
+        return ((uintptr_t) mem < (uintptr_t) node->alloc_record.mem) ? -1 : 1;
+    }
+    return 0;
+}
+
+static int _mem_gap_height(node_pt node) {
+    return (node == NULL) ? 0 : node->height;
+}
+
+static void _mem_gap_update(node_pt node) {
+    int hl = _mem_gap_height(node->left);
+    int hr = _mem_gap_height(node->right);
+    node->height = ((hl > hr) ? hl : hr) + 1;
+}
+
+static node_pt _mem_gap_rotate_left(node_pt node) {
+    node_pt pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    _mem_gap_update(node);
+    _mem_gap_update(pivot);
+    return pivot;
+}
+
+static node_pt _mem_gap_rotate_right(node_pt node) {
+    node_pt pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    _mem_gap_update(node);
+    _mem_gap_update(pivot);
+    return pivot;
+}
+
+static node_pt _mem_gap_rebalance(node_pt node) {
+    // update the height
+    // if left-heavy, rotate right (left-right case first rotates the child)
+    // if right-heavy, rotate left (right-left case first rotates the child)
+    _mem_gap_update(node);
+
+    int balance = _mem_gap_height(node->left) - _mem_gap_height(node->right);
+
+    if(balance > 1){
+        if(_mem_gap_height(node->left->left) < _mem_gap_height(node->left->right)){
+            node->left = _mem_gap_rotate_left(node->left);
+        }
+        return _mem_gap_rotate_right(node);
+    }
+
+    if(balance < -1){
+        if(_mem_gap_height(node->right->right) < _mem_gap_height(node->right->left)){
+            node->right = _mem_gap_rotate_right(node->right);
+        }
+        return _mem_gap_rotate_left(node);
+    }
+
+    return node;
+}
+
+static node_pt _mem_gap_insert(node_pt root, node_pt node) {
+    if(root == NULL){
+        return node;
+    }
+
+    if(_mem_gap_cmp(node->alloc_record.size, node->alloc_record.mem, root) < 0){
+        root->left = _mem_gap_insert(root->left, node);
+    } else {
+        root->right = _mem_gap_insert(root->right, node);
+    }
+
+    return _mem_gap_rebalance(root);
+}
+
+static node_pt _mem_gap_remove_min(node_pt root, node_pt *min) {
+    if(root->left == NULL){
+        *min = root;
+        return root->right;
+    }
+
+    root->left = _mem_gap_remove_min(root->left, min);
+
+    return _mem_gap_rebalance(root);
+}
+
+static node_pt _mem_gap_remove(node_pt root, node_pt node, int *found) {
+    if(root == NULL){
+        return NULL;
+    }
+
+    int cmp = _mem_gap_cmp(node->alloc_record.size, node->alloc_record.mem, root);
+
+    if(cmp < 0){
+        root->left = _mem_gap_remove(root->left, node, found);
+    } else if(cmp > 0){
+        root->right = _mem_gap_remove(root->right, node, found);
+    } else {
+        // replace the node with the minimum of its right subtree
+        node_pt min = NULL;
+
+        *found = 1;
+        if(root->right == NULL){
+            return root->left;
+        }
+        root->right = _mem_gap_remove_min(root->right, &min);
+        min->left = root->left;
+        min->right = root->right;
+        root = min;
+    }
+
+    return _mem_gap_rebalance(root);
+}
+
+// note: the pool is carved into one top-level block per set bit of its size,
+//       largest first, so every block offset is a multiple of the block size
+static alloc_status _mem_buddy_init(pool_mgr_pt pool_mgr) {
+    // round the pool size down to a whole number of min blocks
+    // allocate the block map, one entry per min block
+    // check success
+    // for each set bit of the size, from the highest:
+    //    push a free block of that order at the running offset
+    size_t min_block = (size_t) 1 << MEM_BUDDY_MIN_ORDER;
+    size_t size = pool_mgr->pool.total_size & ~(min_block - 1);
+
+    pool_mgr->pool.total_size = size;
+    pool_mgr->buddy_map = (unsigned char *) calloc(size / min_block + 1, sizeof(unsigned char));
+    if(pool_mgr->buddy_map == NULL){
+        return ALLOC_FAIL;
+    }
+
+    size_t offset = 0;
+    for(int order = MEM_BUDDY_NUM_ORDERS - 1; order >= MEM_BUDDY_MIN_ORDER; order--){
+        if(size & ((size_t) 1 << order)){
+            _mem_buddy_push(pool_mgr, offset, (unsigned) order);
+            offset += (size_t) 1 << order;
+        }
+    }
+
+    return ALLOC_OK;
+}
+
+static void * _mem_buddy_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    // find the order of the smallest block that holds the size
+    // bit-scan for the lowest non-empty free list at or above that order
+    // take its head block
+    // split it down to the order, pushing the upper halves (the buddies)
+    // mark the block as allocated in the block map
+    // update metadata (num_allocs, alloc_size)
+    unsigned order = MEM_BUDDY_MIN_ORDER;
+    if(size > ((size_t) 1 << MEM_BUDDY_MIN_ORDER)){
+        order = 64 - __builtin_clzll((unsigned long long) (size - 1));
+    }
+    if(order >= MEM_BUDDY_NUM_ORDERS){
+        return NULL;
+    }
+
+    uint64_t free_map = pool_mgr->buddy_free_map & (~(uint64_t) 0 << order);
+    if(free_map == 0){
+        return NULL;
+    }
+
+    unsigned block_order = __builtin_ctzll(free_map);
+    size_t offset = (size_t) ((char *) pool_mgr->buddy_free[block_order] - pool_mgr->pool.mem);
+    _mem_buddy_unlink(pool_mgr, offset, block_order);
+
+    while(block_order > order){
+        block_order--;
+        _mem_buddy_push(pool_mgr, offset + ((size_t) 1 << block_order), block_order);
+    }
+
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] = (unsigned char) (order | MEM_BUDDY_ALLOCATED);
+
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += (size_t) 1 << order;
+
+    return pool_mgr->pool.mem + offset;
+}
+
+static alloc_status _mem_buddy_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // check the address is a min block inside the pool
+    // check the block map has a block starting there
+    // check the block is allocated
+    // update metadata (num_allocs, alloc_size)
+    // while the buddy (offset XOR block size) is a free block of the same order:
+    //    unlink the buddy, the merged block starts at the lower of the two
+    //    clear the map entry of the upper half
+    // push the merged block
+    // give the pages past its link back to the OS, of the freed block and
+    //    of small buddies merged with it
+    uintptr_t addr = (uintptr_t) alloc;
+    uintptr_t base = (uintptr_t) pool_mgr->pool.mem;
+
+    if(addr < base || addr >= base + pool_mgr->pool.total_size){
+        return ALLOC_INVALID_HANDLE;
+    }
+
+    size_t offset = (size_t) (addr - base);
+    if(offset & (((size_t) 1 << MEM_BUDDY_MIN_ORDER) - 1)){
+        return ALLOC_INVALID_HANDLE;
+    }
+
+    unsigned char entry = pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER];
+    if(entry == 0){
+        return ALLOC_INVALID_HANDLE;
+    }
+    if(!(entry & MEM_BUDDY_ALLOCATED)){
+        return ALLOC_DOUBLE_FREE;
+    }
+
+    unsigned order = entry & ~MEM_BUDDY_ALLOCATED;
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] = 0;
+
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size -= (size_t) 1 << order;
+
+    size_t lo = offset, hi = offset + ((size_t) 1 << order);
+    while(order + 1 < MEM_BUDDY_NUM_ORDERS){
+        size_t buddy = offset ^ ((size_t) 1 << order);
+
+        if(buddy + ((size_t) 1 << order) > pool_mgr->pool.total_size
+           || pool_mgr->buddy_map[buddy >> MEM_BUDDY_MIN_ORDER] != order){
+            break;
+        }
+
+        _mem_buddy_unlink(pool_mgr, buddy, order);
+        if(((size_t) 1 << order) < pool_mgr->map_release_min){
+            lo = (buddy < lo) ? buddy : lo;
+            hi = (buddy + ((size_t) 1 << order) > hi) ? buddy + ((size_t) 1 << order) : hi;
+        }
+        if(buddy < offset){
+            offset = buddy;
+        }
+        pool_mgr->buddy_map[(offset + ((size_t) 1 << order)) >> MEM_BUDDY_MIN_ORDER] = 0;
+        order++;
+    }
+
+    _mem_buddy_push(pool_mgr, offset, order);
+    _mem_release_pages(pool_mgr, pool_mgr->pool.mem + offset + sizeof(buddy_link_t),
+                       ((size_t) 1 << order) - sizeof(buddy_link_t),
+                       pool_mgr->pool.mem + lo, pool_mgr->pool.mem + hi);
+
+    return ALLOC_OK;
+}
+
+static unsigned _mem_buddy_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg) {
+    // walk the block map from block start to block start
+    //    for each block, visit its size and allocated, stop if the visitor says so
+    size_t offset = 0;
+    unsigned n = 0;
+
+    while(offset < pool_mgr->pool.total_size){
+        unsigned char entry = pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER];
+        pool_segment_t segment = { (size_t) 1 << (entry & ~MEM_BUDDY_ALLOCATED),
+                                   (entry & MEM_BUDDY_ALLOCATED) ? 1 : 0 };
+        offset += segment.size;
+        n++;
+        if(visit(&segment, arg) != 0){
+            break;
+        }
+    }
+
+    return n;
+}
+
+static void _mem_buddy_push(pool_mgr_pt pool_mgr, size_t offset, unsigned order) {
+    buddy_link_pt block = (buddy_link_pt) (pool_mgr->pool.mem + offset);
+
+    block->prev = NULL;
+    block->next = pool_mgr->buddy_free[order];
+    if(block->next != NULL){
+        block->next->prev = block;
+    }
+    pool_mgr->buddy_free[order] = block;
+    pool_mgr->buddy_free_map |= (uint64_t) 1 << order;
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] = (unsigned char) order;
+
+    pool_mgr->pool.num_gaps++;
+    pool_mgr->gap_counts[order]++;
+}
+
+static void _mem_buddy_unlink(pool_mgr_pt pool_mgr, size_t offset, unsigned order) {
+    buddy_link_pt block = (buddy_link_pt) (pool_mgr->pool.mem + offset);
+
+    if(block->prev != NULL){
+        block->prev->next = block->next;
+    } else {
+        pool_mgr->buddy_free[order] = block->next;
+    }
+    if(block->next != NULL){
+        block->next->prev = block->prev;
+    }
+    if(pool_mgr->buddy_free[order] == NULL){
+        pool_mgr->buddy_free_map &= ~((uint64_t) 1 << order);
+    }
+    pool_mgr->buddy_map[offset >> MEM_BUDDY_MIN_ORDER] = 0;
+
+    pool_mgr->pool.num_gaps--;
+    pool_mgr->gap_counts[order]--;
+}
+
+static void * _mem_slab_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    // check the size fits in an object
+    // pop the head slot off the free list, mark it allocated
+    // update metadata (num_allocs, alloc_size, num_gaps)
+    char *slot = pool_mgr->slab_free;
+
+    if(size > pool_mgr->slab_object_size || slot == NULL){
+        return NULL;
+    }
+
+    pool_mgr->slab_free = *(char **) slot;
+    size_t i = (size_t) (slot - pool_mgr->pool.mem) / pool_mgr->slab_slot_size;
+    pool_mgr->slab_map[i / 64] |= (uint64_t) 1 << (i % 64);
+
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += pool_mgr->slab_object_size;
+    pool_mgr->pool.num_gaps--;
+
+    return slot;
+}
+
+static alloc_status _mem_slab_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // check the address is the start of a slot inside the pool
+    // check the slot is allocated, and mark it free
+    // push the slot onto the free list
+    // update metadata (num_allocs, alloc_size, num_gaps)
+    uintptr_t addr = (uintptr_t) alloc;
+    uintptr_t base = (uintptr_t) pool_mgr->pool.mem;
+
+    if(addr < base || addr >= base + pool_mgr->pool.total_size
+       || (addr - base) % pool_mgr->slab_slot_size != 0){
+        return ALLOC_INVALID_HANDLE;
+    }
+    size_t i = (addr - base) / pool_mgr->slab_slot_size;
+    if(!((pool_mgr->slab_map[i / 64] >> (i % 64)) & 1)){
+        return ALLOC_DOUBLE_FREE;
+    }
+    pool_mgr->slab_map[i / 64] &= ~((uint64_t) 1 << (i % 64));
+
+    *(char **) alloc = pool_mgr->slab_free;
+    pool_mgr->slab_free = (char *) alloc;
+
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size -= pool_mgr->slab_object_size;
+    pool_mgr->pool.num_gaps++;
+
+    return ALLOC_OK;
+}
+
+static unsigned _mem_slab_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg) {
+    // visit each slot with its bit in the slot map, stop if the visitor says so
+    size_t count = pool_mgr->pool.total_size / pool_mgr->slab_slot_size;
+    unsigned n = 0;
+
+    for(size_t i = 0; i < count; i++){
+        pool_segment_t segment = { pool_mgr->slab_slot_size, (pool_mgr->slab_map[i / 64] >> (i % 64)) & 1 };
+        n++;
+        if(visit(&segment, arg) != 0){
+            break;
+        }
+    }
+
+    return n;
+}
+
+// note: the first header sits MEM_TAG_SIZE short of an MEM_TAG_ALIGN boundary,
+//       so that with block sizes in multiples of MEM_TAG_ALIGN every payload
+//       is aligned; total_size becomes the span of the blocks
+static alloc_status _mem_tag_init(pool_mgr_pt pool_mgr) {
+    // keep the free lists in the file header of a persistent pool
+    // find the offset of the first header
+    // round the span of the blocks down to whole alignment units
+    // check there is room for one block
+    // push the whole span as one free block
+    pool_mgr->tag_lists = (pool_mgr->file != NULL) ? &pool_mgr->file->tag_lists : &pool_mgr->tag_lists_store;
+
+    uintptr_t base = (uintptr_t) pool_mgr->pool.mem;
+    size_t first = (MEM_TAG_ALIGN - (base + MEM_TAG_SIZE) % MEM_TAG_ALIGN) % MEM_TAG_ALIGN;
+
+    if(first == 0){
+        first = MEM_TAG_ALIGN; // offset 0 stands for the end of a free list
+    }
+    if(pool_mgr->pool.total_size < first + MEM_TAG_MIN_BLOCK){
+        return ALLOC_FAIL;
+    }
+
+    size_t span = (pool_mgr->pool.total_size - first) & ~((size_t) MEM_TAG_ALIGN - 1);
+    if(span < MEM_TAG_MIN_BLOCK){
+        return ALLOC_FAIL;
+    }
+
+    pool_mgr->tag_first = first;
+    pool_mgr->pool.total_size = span;
+    _mem_tag_push(pool_mgr, first, span);
+
+    return ALLOC_OK;
+}
+
+static void * _mem_tag_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    // find the block size, tags included, rounded up to the alignment
+    // if the head of the block size's own class fits, take it
+    // otherwise bit-scan for the next non-empty larger class and take its head
+    // unlink the block
+    // if the remainder can hold a block, split it off and push it
+    // write the allocated header and footer
+    // update metadata (num_allocs, alloc_size)
+    if(size > SIZE_MAX - 2 * MEM_TAG_SIZE - MEM_TAG_ALIGN){
+        return NULL;
+    }
+    size_t need = (size + 2 * MEM_TAG_SIZE + MEM_TAG_ALIGN - 1) & ~((size_t) MEM_TAG_ALIGN - 1);
+    if(need < MEM_TAG_MIN_BLOCK){
+        need = MEM_TAG_MIN_BLOCK;
+    }
+
+    char *mem = pool_mgr->pool.mem;
+    unsigned c = _mem_gap_class(need);
+    size_t offset = pool_mgr->tag_lists->classes[c];
+
+    if(offset == 0 || *(size_t *) (mem + offset) < need){
+        if(c + 1 >= MEM_GAP_NUM_CLASSES){
+            return NULL;
+        }
+        uint64_t larger = pool_mgr->tag_lists->class_map & (~(uint64_t) 0 << (c + 1));
+        if(larger == 0){
+            return NULL;
+        }
+        offset = pool_mgr->tag_lists->classes[__builtin_ctzll(larger)];
+    }
+
+    size_t block = *(size_t *) (mem + offset);
+    _mem_tag_unlink(pool_mgr, offset, block);
+
+    if(block - need >= MEM_TAG_MIN_BLOCK){
+        _mem_tag_push(pool_mgr, offset + need, block - need);
+        block = need;
+    }
+
+    *(size_t *) (mem + offset) = block | MEM_TAG_ALLOCATED;
+    *(size_t *) (mem + offset + block - MEM_TAG_SIZE) = block | MEM_TAG_ALLOCATED;
+
+    pool_mgr->pool.num_allocs++;
+    pool_mgr->pool.alloc_size += block;
+
+    return mem + offset + MEM_TAG_SIZE;
+}
+
+static void * _mem_tag_alloc_aligned(pool_mgr_pt pool_mgr, size_t size, size_t alignment) {
+    // allocate a block with room for size, the alignment and a free block
+    //    in front of the aligned payload
+    // find the aligned payload, at least a minimum block past the payload
+    // carve the block into front, aligned and back blocks, all allocated
+    // free the front and the back (if it can be a block), which merges them
+    //    with their free neighbours and hands them back as gaps
+    // note: alignment is larger than MEM_TAG_ALIGN, so a power of two
+    //       of at least MEM_TAG_MIN_BLOCK
+    if(size > SIZE_MAX - 2 * MEM_TAG_SIZE - MEM_TAG_ALIGN - alignment - MEM_TAG_MIN_BLOCK){
+        return NULL;
+    }
+    char *payload = _mem_tag_alloc(pool_mgr, size + alignment + MEM_TAG_MIN_BLOCK);
+    if(payload == NULL){
+        return NULL;
+    }
+
+    char *mem = pool_mgr->pool.mem;
+    size_t offset = (size_t) (payload - mem) - MEM_TAG_SIZE;
+    size_t block = *(size_t *) (mem + offset) & ~((size_t) MEM_TAG_ALIGN - 1);
+    size_t need = (size + 2 * MEM_TAG_SIZE + MEM_TAG_ALIGN - 1) & ~((size_t) MEM_TAG_ALIGN - 1);
+    if(need < MEM_TAG_MIN_BLOCK){
+        need = MEM_TAG_MIN_BLOCK;
+    }
+
+    uintptr_t aligned = ((uintptr_t) payload + MEM_TAG_MIN_BLOCK + alignment - 1) & ~((uintptr_t) alignment - 1);
+    size_t front = (size_t) (aligned - (uintptr_t) payload);
+    size_t back = block - front - need;
+    if(back < MEM_TAG_MIN_BLOCK){
+        need += back;
+        back = 0;
+    }
+
+    size_t blocks[3] = { front, need, back };
+    size_t at = offset;
+    for(unsigned i = 0; i < 3 && blocks[i] != 0; i++){
+        *(size_t *) (mem + at) = blocks[i] | MEM_TAG_ALLOCATED;
+        *(size_t *) (mem + at + blocks[i] - MEM_TAG_SIZE) = blocks[i] | MEM_TAG_ALLOCATED;
+        at += blocks[i];
+    }
+    pool_mgr->pool.num_allocs += (back != 0) ? 2 : 1;
+
+    _mem_tag_free(pool_mgr, payload);
+    if(back != 0){
+        _mem_tag_free(pool_mgr, (char *) aligned + need);
+    }
+
+    return (void *) aligned;
+}
+
+// note: a pointer into the middle of a payload cannot always be told apart
+//       from a payload, the header and footer are checked for consistency
+static alloc_status _mem_tag_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // check the address is an aligned payload inside the pool
+    // check the header and footer agree
+    // check the block is allocated
+    // if it is the root of a persistent pool, clear the root
+    // update metadata (num_allocs, alloc_size)
+    // if the next block (right after the footer) is free, unlink and absorb it
+    // if the previous block (footer right before the header) is free,
+    //    unlink it and absorb the block into it
+    // push the merged block
+    // give the pages between its link and its footer back to the OS, of the
+    //    freed block and of small free blocks merged with it
+    char *mem = pool_mgr->pool.mem;
+    size_t end = pool_mgr->tag_first + pool_mgr->pool.total_size;
+    uintptr_t addr = (uintptr_t) alloc;
+
+    if(addr < (uintptr_t) mem + pool_mgr->tag_first + MEM_TAG_SIZE
+       || addr >= (uintptr_t) mem + end
+       || (addr - (uintptr_t) mem - pool_mgr->tag_first - MEM_TAG_SIZE) % MEM_TAG_ALIGN != 0){
+        return ALLOC_INVALID_HANDLE;
+    }
+
+    size_t offset = (size_t) (addr - (uintptr_t) mem) - MEM_TAG_SIZE;
+    size_t header = *(size_t *) (mem + offset);
+    size_t block = header & ~((size_t) MEM_TAG_ALIGN - 1);
+
+    if(block < MEM_TAG_MIN_BLOCK || block > end - offset
+       || *(size_t *) (mem + offset + block - MEM_TAG_SIZE) != header){
+        return ALLOC_INVALID_HANDLE;
+    }
+    if(!(header & MEM_TAG_ALLOCATED)){
+        return ALLOC_DOUBLE_FREE;
+    }
+    if(pool_mgr->file != NULL && pool_mgr->file->root == offset + MEM_TAG_SIZE){
+        pool_mgr->file->root = 0;
+    }
+
+    pool_mgr->pool.num_allocs--;
+    pool_mgr->pool.alloc_size -= block;
+
+    size_t lo = offset, hi = offset + block;
+    if(offset + block < end){
+        size_t next = *(size_t *) (mem + offset + block);
+        if(!(next & MEM_TAG_ALLOCATED)){
+            _mem_tag_unlink(pool_mgr, offset + block, next);
+            if(next < pool_mgr->map_release_min){
+                hi += next;
+            }
+            block += next;
+        }
+    }
+
+    if(offset > pool_mgr->tag_first){
+        size_t prev = *(size_t *) (mem + offset - MEM_TAG_SIZE);
+        if(!(prev & MEM_TAG_ALLOCATED)){
+            _mem_tag_unlink(pool_mgr, offset - prev, prev);
+            if(prev < pool_mgr->map_release_min){
+                lo -= prev;
+            }
+            offset -= prev;
+            block += prev;
+        }
+    }
+
+    _mem_tag_push(pool_mgr, offset, block);
+    _mem_release_pages(pool_mgr, mem + offset + MEM_TAG_SIZE + sizeof(tag_link_t),
+                       block - 2 * MEM_TAG_SIZE - sizeof(tag_link_t), mem + lo, mem + hi);
+
+    return ALLOC_OK;
+}
+
+static unsigned _mem_tag_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg) {
+    // walk the blocks by the sizes in their headers
+    //    for each block, visit its size and allocated, stop if the visitor says so
+    size_t offset = pool_mgr->tag_first;
+    size_t end = pool_mgr->tag_first + pool_mgr->pool.total_size;
+    unsigned n = 0;
+
+    while(offset < end){
+        size_t header = *(size_t *) (pool_mgr->pool.mem + offset);
+        pool_segment_t segment = { header & ~((size_t) MEM_TAG_ALIGN - 1), header & MEM_TAG_ALLOCATED };
+        offset += segment.size;
+        n++;
+        if(visit(&segment, arg) != 0){
+            break;
+        }
+    }
+
+    return n;
+}
+
+static void _mem_tag_push(pool_mgr_pt pool_mgr, size_t offset, size_t size) {
+    char *mem = pool_mgr->pool.mem;
+    unsigned c = _mem_gap_class(size);
+    tag_link_pt link = (tag_link_pt) (mem + offset + MEM_TAG_SIZE);
+
+    *(size_t *) (mem + offset) = size;
+    *(size_t *) (mem + offset + size - MEM_TAG_SIZE) = size;
+
+    link->prev = 0;
+    link->next = pool_mgr->tag_lists->classes[c];
+    if(link->next != 0){
+        ((tag_link_pt) (mem + link->next + MEM_TAG_SIZE))->prev = offset;
+    }
+    pool_mgr->tag_lists->classes[c] = offset;
+    pool_mgr->tag_lists->class_map |= (uint64_t) 1 << c;
+    pool_mgr->tag_lists->counts[c]++;
+
+    pool_mgr->pool.num_gaps++;
+}
+
+static void _mem_tag_unlink(pool_mgr_pt pool_mgr, size_t offset, size_t size) {
+    char *mem = pool_mgr->pool.mem;
+    unsigned c = _mem_gap_class(size);
+    tag_link_pt link = (tag_link_pt) (mem + offset + MEM_TAG_SIZE);
+
+    if(link->prev != 0){
+        ((tag_link_pt) (mem + link->prev + MEM_TAG_SIZE))->next = link->next;
+    } else {
+        pool_mgr->tag_lists->classes[c] = link->next;
+    }
+    if(link->next != 0){
+        ((tag_link_pt) (mem + link->next + MEM_TAG_SIZE))->prev = link->prev;
+    }
+    if(pool_mgr->tag_lists->classes[c] == 0){
+        pool_mgr->tag_lists->class_map &= ~((uint64_t) 1 << c);
+    }
+    pool_mgr->tag_lists->counts[c]--;
+
+    pool_mgr->pool.num_gaps--;
+}
+
+static alloc_status _mem_tag_rebuild(pool_mgr_pt pool_mgr) {
+    // empty the free lists and zero the counts
+    // walk the blocks by the sizes in their headers, each one has to fit
+    //    in the span
+    // count each allocated block and write its footer, push each run of
+    //    free blocks as one
+    // note: recovers a persistent pool that was not closed, or a shared
+    //       one whose process died with the lock; the headers are trusted
+    //       and the footers rewritten, since the header of the first block
+    //       of a change is written last (an allocation the process did not
+    //       get to return stays allocated)
+    char *mem = pool_mgr->pool.mem;
+    size_t end = pool_mgr->tag_first + pool_mgr->pool.total_size;
+    size_t offset = pool_mgr->tag_first;
+    size_t run = offset; // start of the current run of free blocks
+
+    memset(pool_mgr->tag_lists, 0, sizeof(tag_lists_t));
+    pool_mgr->pool.alloc_size = 0;
+    pool_mgr->pool.num_allocs = 0;
+    pool_mgr->pool.num_gaps = 0;
+
+    while(offset < end){
+        size_t header = *(size_t *) (mem + offset);
+        size_t block = header & ~((size_t) MEM_TAG_ALIGN - 1);
+
+        if(block < MEM_TAG_MIN_BLOCK || block > end - offset
+           || (header & (MEM_TAG_ALIGN - 1) & ~(size_t) MEM_TAG_ALLOCATED) != 0){
+            return ALLOC_FAIL;
+        }
+        if(header & MEM_TAG_ALLOCATED){
+            if(run < offset){
+                _mem_tag_push(pool_mgr, run, offset - run);
+            }
+            *(size_t *) (mem + offset + block - MEM_TAG_SIZE) = header;
+            pool_mgr->pool.num_allocs++;
+            pool_mgr->pool.alloc_size += block;
+            run = offset + block;
+        }
+        offset += block;
+    }
+    if(run < end){
+        _mem_tag_push(pool_mgr, run, end - run);
+    }
+
+    return ALLOC_OK;
+}
+
+// note: a cache serves a thread without the pool lock, the lock is taken
+//       once per batch to refill or flush a size class
+static void * _mem_cache_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    // find the cache of the calling thread, on error go to the pool
+    // round the size to its class
+    // if the class has allocations, pop one (a hit)
+    // otherwise refill a batch from the pool under its lock (a miss),
+    //   marking each one as held by a cache
+    // clear the mark of the allocation handed out
+    mem_cache_pt cache = _mem_cache_get(pool_mgr);
+    if(cache == NULL){
+        _mem_lock(pool_mgr);
+        void *alloc = _mem_alloc(pool_mgr, size);
+        _mem_unlock(pool_mgr);
+        return alloc;
+    }
+
+    size_t rsize = _mem_cache_round(pool_mgr, size);
+    int c = _mem_cache_class(pool_mgr, rsize);
+    void **row = cache->slots + (size_t) c * 2 * cache->batch;
+
+    if(cache->counts[c] > 0){
+        _mem_cache_count(&cache->hits);
+    } else {
+        _mem_cache_count(&cache->misses);
+        _mem_lock(pool_mgr);
+        while(cache->counts[c] < cache->batch){
+            void *alloc = _mem_alloc(pool_mgr, rsize);
+            if(alloc == NULL){
+                break;
+            }
+            _mem_cache_mark(pool_mgr, alloc, 1);
+            row[cache->counts[c]++] = alloc;
+        }
+        _mem_unlock(pool_mgr);
+        if(cache->counts[c] == 0){
+            return NULL;
+        }
+    }
+
+    void *alloc = row[--cache->counts[c]];
+    _mem_cache_mark(pool_mgr, alloc, 0);
+    return alloc;
+}
+
+static alloc_status _mem_cache_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // find the cache of the calling thread, on error go to the pool
+    // find the class of the allocation
+    // mark the allocation as held by a cache, if it already is, freeing
+    //   it again is a double free
+    // if the class is full, flush a batch to the pool under its lock,
+    //   clearing their marks
+    // push the allocation
+    // note: the caller checked the handle, with _mem_cache_size_of
+    mem_cache_pt cache = _mem_cache_get(pool_mgr);
+    if(cache == NULL){
+        _mem_lock(pool_mgr);
+        alloc_status status = _mem_free(pool_mgr, alloc);
+        _mem_unlock(pool_mgr);
+        return status;
+    }
+
+    int c = _mem_cache_class(pool_mgr, _mem_cache_size_of(pool_mgr, alloc));
+    void **row = cache->slots + (size_t) c * 2 * cache->batch;
+
+    if(_mem_cache_mark(pool_mgr, alloc, 1)){
+        return ALLOC_DOUBLE_FREE;
+    }
+
+    if(cache->counts[c] == 2 * cache->batch){
+        _mem_cache_count(&cache->flushes);
+        _mem_lock(pool_mgr);
+        while(cache->counts[c] > cache->batch){
+            void *flushed = row[--cache->counts[c]];
+            _mem_cache_mark(pool_mgr, flushed, 0);
+            _mem_free(pool_mgr, flushed);
+        }
+        _mem_unlock(pool_mgr);
+    }
+
+    row[cache->counts[c]++] = alloc;
+
+    return ALLOC_OK;
+}
+
+static mem_cache_pt _mem_cache_get(pool_mgr_pt pool_mgr) {
+    // look for the cache of the pool among the calling thread's caches,
+    //   releasing the ones whose pool was closed
+    // if none, create one
+    // register it with the pool and the thread
+    mem_cache_pt *link = &thread_caches;
+    while(*link != NULL){
+        mem_cache_pt cache = *link;
+        pool_mgr_pt owner = atomic_load_explicit(&cache->pool_mgr, memory_order_acquire);
+
+        if(owner == pool_mgr){
+            return cache;
+        }
+        if(owner == NULL){
+            *link = cache->thread_next;
+            free(cache);
+            continue;
+        }
+        link = &cache->thread_next;
+    }
+
+    pthread_once(&thread_caches_once, _mem_cache_key_create);
+
+    unsigned batch = pool_mgr->cache_batch;
+    mem_cache_pt cache = calloc(1, sizeof(mem_cache_t)
+                                   + MEM_CACHE_NUM_CLASSES * 2 * batch * sizeof(void *));
+    if(cache == NULL){
+        return NULL;
+    }
+    cache->batch = batch;
+    atomic_init(&cache->pool_mgr, pool_mgr);
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    atomic_init(&cache->flushes, 0);
+
+    _mem_lock(pool_mgr);
+    cache->pool_next = pool_mgr->caches;
+    pool_mgr->caches = cache;
+    _mem_unlock(pool_mgr);
+
+    cache->thread_next = thread_caches;
+    thread_caches = cache;
+    pthread_setspecific(thread_caches_key, &thread_caches);
+
+    return cache;
+}
+
+static size_t _mem_cache_round(pool_mgr_pt pool_mgr, size_t size) {
+    // the size the pool will be asked for: a power of two for BUDDY_FIT,
+    // the object size for SLAB_FIT, a multiple of the grain otherwise
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        size_t min_block = (size_t) 1 << MEM_BUDDY_MIN_ORDER;
+        return (size <= min_block) ? min_block : (size_t) 1 << (64 - __builtin_clzll(size - 1));
+    }
+    if(pool_mgr->pool.policy == SLAB_FIT){
+        return (size <= pool_mgr->slab_object_size) ? pool_mgr->slab_object_size : SIZE_MAX;
+    }
+    return (size + MEM_CACHE_GRAIN - 1) & ~((size_t) MEM_CACHE_GRAIN - 1);
+}
+
+// note: node handles are trusted, the addresses handed out by the other
+//       policies are checked against the pool, 0 sends them to the pool
+// note: called without the pool lock on frees into a cache; the node
+//       heap only grows, and the node of a live handle is its owner's
+static size_t _mem_cache_size_of(pool_mgr_pt pool_mgr, void *alloc) {
+    // the largest size an allocation can serve, 0 if it cannot be told
+    //   or, for the node policies, the handle is foreign or stale
+    uintptr_t addr = (uintptr_t) alloc;
+    uintptr_t base = (uintptr_t) pool_mgr->pool.mem;
+
+    if(alloc == NULL){
+        return 0;
+    }
+
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        size_t min_block = (size_t) 1 << MEM_BUDDY_MIN_ORDER;
+        if(addr < base || addr >= base + pool_mgr->pool.total_size || (addr - base) % min_block != 0){
+            return 0;
+        }
+        unsigned char entry = pool_mgr->buddy_map[(addr - base) >> MEM_BUDDY_MIN_ORDER];
+        return (entry & MEM_BUDDY_ALLOCATED) ? (size_t) 1 << (entry & ~MEM_BUDDY_ALLOCATED) : 0;
+    }
+
+    if(pool_mgr->pool.policy == SLAB_FIT || pool_mgr->pool.policy == ATOMIC_SLAB_FIT){
+        if(addr < base || addr >= base + pool_mgr->pool.total_size
+           || (addr - base) % pool_mgr->slab_slot_size != 0){
+            return 0;
+        }
+        size_t slot = (addr - base) / pool_mgr->slab_slot_size;
+        if(pool_mgr->pool.policy == SLAB_FIT && !(pool_mgr->slab_map[slot / 64] & ((uint64_t) 1 << (slot % 64)))){
+            return 0;
+        }
+        return pool_mgr->slab_object_size;
+    }
+
+    if(pool_mgr->pool.policy == TAGGED_FIT){
+        uintptr_t first = base + pool_mgr->tag_first + MEM_TAG_SIZE;
+        if(addr < first || addr >= base + pool_mgr->tag_first + pool_mgr->pool.total_size
+           || (addr - first) % MEM_TAG_ALIGN != 0){
+            return 0;
+        }
+        size_t header = *(size_t *) (addr - MEM_TAG_SIZE);
+        size_t block = header & ~((size_t) MEM_TAG_ALIGN - 1);
+        return ((header & MEM_TAG_ALLOCATED) && block >= MEM_TAG_MIN_BLOCK) ? block - 2 * MEM_TAG_SIZE : 0;
+    }
+
+    node_pt node = _mem_find_node(pool_mgr, alloc);
+    if(node == NULL || !node->used || node->allocated != 1){
+        return 0;
+    }
+    return node->alloc_record.size;
+}
+
+static int _mem_cache_class(pool_mgr_pt pool_mgr, size_t size) {
+    // -1 for sizes the caches do not hold
+    if(size == 0 || size > pool_mgr->cache_max_size){
+        return -1;
+    }
+    if(pool_mgr->pool.policy == SLAB_FIT){
+        return 0;
+    }
+    if(size % MEM_CACHE_GRAIN != 0){
+        return -1;
+    }
+    return (int) (size / MEM_CACHE_GRAIN) - 1;
+}
+
+static void _mem_cache_drain(pool_mgr_pt pool_mgr, mem_cache_pt cache) {
+    // return every cached allocation to the pool
+    // note: the caller holds the pool lock
+    int flushed = 0;
+
+    for(unsigned c = 0; c < MEM_CACHE_NUM_CLASSES; c++){
+        void **row = cache->slots + (size_t) c * 2 * cache->batch;
+        while(cache->counts[c] > 0){
+            void *alloc = row[--cache->counts[c]];
+            _mem_cache_mark(pool_mgr, alloc, 0);
+            _mem_free(pool_mgr, alloc);
+            flushed = 1;
+        }
+    }
+    if(flushed){
+        _mem_cache_count(&cache->flushes);
+    }
+}
+
+// note: units cover the span allocations start in: slots for SLAB_FIT,
+//       smallest blocks for BUDDY_FIT, payload alignments for TAGGED_FIT
+static size_t _mem_cache_unit(pool_mgr_pt pool_mgr, void *alloc, size_t *units) {
+    // the unit alloc starts in, SIZE_MAX if it is outside the span
+    // units, if not null, gets the number of units in the span
+    uintptr_t base = (uintptr_t) pool_mgr->pool.mem;
+    size_t unit = pool_mgr->slab_slot_size;
+
+    if(pool_mgr->pool.policy == BUDDY_FIT){
+        unit = (size_t) 1 << MEM_BUDDY_MIN_ORDER;
+    } else if(pool_mgr->pool.policy == TAGGED_FIT){
+        base += pool_mgr->tag_first + MEM_TAG_SIZE;
+        unit = MEM_TAG_ALIGN;
+    }
+    if(units != NULL){
+        *units = pool_mgr->pool.total_size / unit + 1;
+    }
+
+    if((uintptr_t) alloc < base || (uintptr_t) alloc - base >= pool_mgr->pool.total_size){
+        return SIZE_MAX;
+    }
+    return ((uintptr_t) alloc - base) / unit;
+}
+
+// note: called without the pool lock, on an allocation of the pool; the
+//       caches mark what they hold, so that freeing it again, into any
+//       cache or the pool, is a double free
+static int _mem_cache_mark(pool_mgr_pt pool_mgr, void *alloc, int held) {
+    // set or clear the mark of the allocation, return the old one
+    //   for the node policies, the mark is in the node
+    //   otherwise, it is the bit of its unit in the cache map
+    if(pool_mgr->cache_map == NULL){
+        node_pt node = _mem_find_node(pool_mgr, alloc);
+        return atomic_exchange_explicit(&node->cached, (unsigned char) held, memory_order_acq_rel);
+    }
+
+    size_t unit = _mem_cache_unit(pool_mgr, alloc, NULL);
+    uint64_t bit = (uint64_t) 1 << (unit % 64);
+    uint64_t old = held ? atomic_fetch_or_explicit(&pool_mgr->cache_map[unit / 64], bit, memory_order_acq_rel)
+                        : atomic_fetch_and_explicit(&pool_mgr->cache_map[unit / 64], ~bit, memory_order_acq_rel);
+    return (old & bit) != 0;
+}
+
+static int _mem_cache_held(pool_mgr_pt pool_mgr, void *alloc) {
+    // 0 if the pool has no caches or alloc is not in it
+    // otherwise the mark of the node, or of the unit in the cache map
+    if(pool_mgr->cache_max_size == 0){
+        return 0;
+    }
+
+    if(pool_mgr->cache_map == NULL){
+        node_pt node = _mem_find_node(pool_mgr, alloc);
+        return node != NULL && atomic_load_explicit(&node->cached, memory_order_acquire);
+    }
+
+    size_t unit = _mem_cache_unit(pool_mgr, alloc, NULL);
+    return unit != SIZE_MAX
+           && (atomic_load_explicit(&pool_mgr->cache_map[unit / 64], memory_order_acquire) >> (unit % 64)) & 1;
+}
+
+static void _mem_cache_thread_exit(void *caches) {
+    // with the pool store locked, so that no pool is closed meanwhile:
+    // for each cache of the exiting thread
+    //    if its pool is open, return its allocations and counts to the pool
+    //    and unlink it from the pool's caches
+    //    release it
+    mem_cache_pt cache = *(mem_cache_pt *) caches;
+
+    pthread_mutex_lock(&pool_store_lock);
+    while(cache != NULL){
+        mem_cache_pt next = cache->thread_next;
+        pool_mgr_pt pool_mgr = atomic_load_explicit(&cache->pool_mgr, memory_order_acquire);
+
+        if(pool_mgr != NULL){
+            _mem_lock(pool_mgr);
+            _mem_cache_drain(pool_mgr, cache);
+            pool_mgr->cache_hits += atomic_load_explicit(&cache->hits, memory_order_relaxed);
+            pool_mgr->cache_misses += atomic_load_explicit(&cache->misses, memory_order_relaxed);
+            pool_mgr->cache_flushes += atomic_load_explicit(&cache->flushes, memory_order_relaxed);
+            mem_cache_pt *link = &pool_mgr->caches;
+            while(*link != cache){
+                link = &(*link)->pool_next;
+            }
+            *link = cache->pool_next;
+            _mem_unlock(pool_mgr);
+        }
+
+        free(cache);
+        cache = next;
+    }
+    *(mem_cache_pt *) caches = NULL;
+    pthread_mutex_unlock(&pool_store_lock);
+}
+
+static void _mem_cache_key_create() {
+    pthread_key_create(&thread_caches_key, _mem_cache_thread_exit);
+}
+
+static void _mem_cache_count(atomic_ulong *counter) {
+    // only the owner thread writes a counter, a plain increment will do
+    atomic_store_explicit(counter,
+                          atomic_load_explicit(counter, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+// note: the free stack head carries a tag bumped by every push and pop, so a
+//       pop that raced with a pop and push of the same slot (ABA) fails its
+//       compare-exchange and retries; the counters in pool are kept with
+//       atomic adds, and a slot's state catches a second free of it
+static void * _mem_lf_alloc(pool_mgr_pt pool_mgr, size_t size) {
+    // check the size fits in an object
+    // pop the head slot off the free stack:
+    //    read the head, if empty return null
+    //    read the next index out of the head slot
+    //    swap in the next index with the tag bumped, retry on a race
+    // mark the slot allocated
+    // update metadata (num_allocs, alloc_size, num_gaps)
+    // update the statistics (total_allocs, peak_alloc_size)
+    if(size > pool_mgr->slab_object_size){
+        return NULL;
+    }
+
+    uint64_t head = atomic_load_explicit(&pool_mgr->lf_head, memory_order_acquire);
+    uint64_t next;
+    char *slot;
+    do {
+        uint32_t index = (uint32_t) (head & MEM_LF_INDEX_MASK);
+        if(index == 0){
+            return NULL;
+        }
+        slot = pool_mgr->pool.mem + (size_t) (index - 1) * pool_mgr->slab_slot_size;
+        next = (((head >> 32) + 1) << 32)
+               | atomic_load_explicit((_Atomic uint32_t *) slot, memory_order_relaxed);
+    } while(!atomic_compare_exchange_weak_explicit(&pool_mgr->lf_head, &head, next,
+                                                   memory_order_acquire,
+                                                   memory_order_acquire));
+
+    atomic_store_explicit(&pool_mgr->lf_state[(slot - pool_mgr->pool.mem) / pool_mgr->slab_slot_size],
+                          1, memory_order_relaxed);
+
+    __atomic_fetch_add(&pool_mgr->pool.num_allocs, 1, __ATOMIC_RELAXED);
+    size_t alloc_size = __atomic_add_fetch(&pool_mgr->pool.alloc_size, pool_mgr->slab_object_size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&pool_mgr->pool.num_gaps, 1, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&pool_mgr->total_allocs, 1, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&pool_mgr->peak_alloc_size, __ATOMIC_RELAXED);
+    while(alloc_size > peak
+          && !__atomic_compare_exchange_n(&pool_mgr->peak_alloc_size, &peak, alloc_size, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    }
+
+    return slot;
+}
+
+static alloc_status _mem_lf_free(pool_mgr_pt pool_mgr, void *alloc) {
+    // check the address is the start of a slot inside the pool
+    // mark the slot free, if it already was it is a double free
+    // update metadata (num_allocs, alloc_size, num_gaps) and total_frees
+    // push the slot onto the free stack:
+    //    read the head, link the slot to it
+    //    swap in the slot with the tag bumped, retry on a race
+    uintptr_t addr = (uintptr_t) alloc;
+    uintptr_t base = (uintptr_t) pool_mgr->pool.mem;
+
+    if(addr < base || addr >= base + pool_mgr->pool.total_size
+       || (addr - base) % pool_mgr->slab_slot_size != 0){
+        return ALLOC_INVALID_HANDLE;
+    }
+
+    size_t index = (addr - base) / pool_mgr->slab_slot_size;
+    if(atomic_exchange_explicit(&pool_mgr->lf_state[index], 0, memory_order_relaxed) == 0){
+        return ALLOC_DOUBLE_FREE;
+    }
+
+    __atomic_fetch_sub(&pool_mgr->pool.num_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&pool_mgr->pool.alloc_size, pool_mgr->slab_object_size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pool_mgr->pool.num_gaps, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pool_mgr->total_frees, 1, __ATOMIC_RELAXED);
+
+    uint64_t head = atomic_load_explicit(&pool_mgr->lf_head, memory_order_relaxed);
+    uint64_t next;
+    do {
+        atomic_store_explicit((_Atomic uint32_t *) alloc,
+                              (uint32_t) (head & MEM_LF_INDEX_MASK), memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | (uint32_t) (index + 1);
+    } while(!atomic_compare_exchange_weak_explicit(&pool_mgr->lf_head, &head, next,
+                                                   memory_order_release,
+                                                   memory_order_relaxed));
+
+    return ALLOC_OK;
+}
+
+static unsigned _mem_lf_walk(pool_mgr_pt pool_mgr, pool_segment_visitor visit, void *arg) {
+    // visit each slot by its state, stop if the visitor says so
+    // note: a snapshot, slots may change hands while it is taken
+    size_t count = pool_mgr->pool.total_size / pool_mgr->slab_slot_size;
+    unsigned n = 0;
+
+    for(size_t i = 0; i < count; i++){
+        pool_segment_t segment = { pool_mgr->slab_slot_size,
+                                   atomic_load_explicit(&pool_mgr->lf_state[i], memory_order_relaxed) };
+        n++;
+        if(visit(&segment, arg) != 0){
+            break;
+        }
+    }
+
+    return n;
 }
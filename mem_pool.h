@@ -7,7 +7,18 @@
 
 /* type declarations */
 
-typedef enum _alloc_policy { FIRST_FIT, BEST_FIT } alloc_policy;
+// note: BUDDY_FIT pools hand out power-of-two blocks, their allocations are
+//       the addresses of the blocks in pool->mem and alloc_size counts whole blocks
+// note: SLAB_FIT pools are opened with mem_slab_open only, their allocations
+//       are the addresses of the slots in pool->mem and alloc_size counts
+//       object_size per allocation
+// note: ATOMIC_SLAB_FIT pools are opened with mem_atomic_slab_open only, they
+//       are SLAB_FIT pools whose allocations and deallocations never lock,
+//       so that threads freeing each other's objects never block
+// note: TAGGED_FIT pools keep their metadata in boundary tags inside pool->mem,
+//       their allocations are the addresses of the payloads in pool->mem and
+//       alloc_size counts whole blocks, tags included
+typedef enum _alloc_policy { FIRST_FIT, BEST_FIT, FAST_FIT, TLSF_FIT, BUDDY_FIT, SLAB_FIT, TAGGED_FIT, ATOMIC_SLAB_FIT } alloc_policy;
 
 typedef struct _pool {
     char *mem;
@@ -23,11 +34,103 @@ typedef struct _pool_segment {
     unsigned long allocated; // 1-allocation, 0-gap (note: 8 bytes)
 } pool_segment_t, *pool_segment_pt;
 
+// note: visitors are called in address order with the pool locked, so they
+//       must not call into the pool; a non-zero return stops the walk
+typedef int (*pool_segment_visitor)(const pool_segment_t *segment, void *arg);
+
+// note: gaps are counted as the allocator sees them: a free block for
+//       BUDDY_FIT and TAGGED_FIT, a free slot for the slab pools
+// note: allocs and frees count allocations made and freed, batches one per
+//       allocation and thread caches a batch at a time, as they take from
+//       and give back to the pool; a reallocation counts as neither, also
+//       when it moves; for a shared pool they and the peak are those of the
+//       calling process
+typedef struct _pool_stats {
+    size_t free_size; // bytes in gaps
+    size_t largest_gap; // 0 if there is none
+    double fragmentation; // external, 1 - largest_gap / free_size, 0 if nothing is free
+    unsigned long gap_classes[64]; // gap_classes[c] counts the gaps of [2^c, 2^(c+1)) bytes
+    size_t peak_alloc_size; // highest alloc_size so far
+    size_t metadata_size; // as mem_pool_metadata
+    unsigned long allocs; // allocations made so far
+    unsigned long frees; // allocations freed so far
+    unsigned long failed_allocs; // allocation calls that failed so far
+} pool_stats_t, *pool_stats_pt;
+
+// note: a trace is a trace_header_t and then num_events events, oldest first;
+//       handles are as mem_new_alloc returns them, 0 for a failed one,
+//       and pools are numbered in the order they were opened
+// note: TRACE_OPEN has the total size in size and the policy in arg, for
+//       the slab pools also the object size in handle; TRACE_ALIGNED has the
+//       alignment in arg, TRACE_REALLOC the old handle; batches are traced
+//       one event per allocation
+typedef enum _trace_op { TRACE_OPEN, TRACE_CLOSE, TRACE_ALLOC, TRACE_ALIGNED, TRACE_FREE, TRACE_REALLOC } trace_op;
+
+typedef struct _trace_event {
+    unsigned long long time_ns; // CLOCK_MONOTONIC
+    unsigned long long handle;
+    unsigned long long size;
+    unsigned long long arg;
+    unsigned pool;
+    unsigned short op; // a trace_op
+    unsigned short thread; // threads are numbered in the order they first traced
+} trace_event_t, *trace_event_pt;
+
+typedef struct _trace_header {
+    char magic[8]; // "MEMTRACE", not terminated
+    unsigned version;
+    unsigned event_size; // sizeof(trace_event_t)
+    unsigned long long num_events;
+} trace_header_t, *trace_header_pt;
+
+typedef struct _pool_cache_stats {
+    unsigned long hits;    // allocations served by a thread cache
+    unsigned long misses;  // allocations that refilled a thread cache from the pool
+    unsigned long flushes; // times a thread cache returned allocations to the pool
+} pool_cache_stats_t, *pool_cache_stats_pt;
+
+// note: with use_mmap, pool->mem is anonymous memory that is committed page
+//       by page when first touched, and the pages of gaps of at least
+//       release_min bytes are given back to the OS when they are freed
+// note: with huge_pages, pool->mem is mapped on 2 MB pages, reserved ones
+//       (MAP_HUGETLB) if there are any, otherwise transparent huge pages
+//       (MADV_HUGEPAGE) if the kernel does them, otherwise ordinary pages;
+//       pool->mem is then 2 MB-aligned and mapped in whole huge pages
+// note: with arena_size, a FIRST_FIT, BEST_FIT, FAST_FIT or TLSF_FIT pool
+//       that has no gap for an allocation adds an arena (a region backed
+//       like pool->mem) of at least arena_size instead of failing, and gives
+//       back an added arena as soon as it is all free again; gaps do not
+//       merge across arenas, total_size counts all of them and pool->mem is
+//       the first; a pool has at most 32 arenas
+// note: with path, a TAGGED_FIT pool is persistent: the file at path is
+//       created, failing if there is one already, and pool->mem is mapped
+//       from it, after a header; mem_pool_close keeps the allocations in
+//       the file and mem_pool_reopen gets them back, in this or a later
+//       process; the file is locked while the pool is open, so it is open
+//       in one pool at a time
+// note: with shm_name, a TAGGED_FIT pool is shared: it is persistent in a
+//       new POSIX shared memory object of that name, which other processes
+//       open with mem_pool_attach to allocate and free in the same pool at
+//       once, under a lock of its own; pool->mem is at another address in
+//       each process and the counts in pool are as of the last call of the
+//       process; shm_unlink removes the object
+typedef struct _pool_options {
+    size_t alignment; // of pool->mem, a power of two, 0 for the default
+    int use_mmap; // map pool->mem instead of allocating it from the heap
+    size_t release_min; // with use_mmap, 0 for the default of 128 KiB
+    int huge_pages; // map pool->mem on huge pages, implies use_mmap
+    size_t arena_size; // grow by arenas of at least this, 0 for a fixed pool
+    const char *path; // file of a persistent pool, null for a pool in memory
+    const char *shm_name; // shared memory object of a shared pool, null if not shared
+} pool_options_t, *pool_options_pt;
+
 typedef enum _alloc_status {
     ALLOC_OK,
     ALLOC_FAIL,
     ALLOC_CALLED_AGAIN,
-    ALLOC_NOT_FREED
+    ALLOC_NOT_FREED,
+    ALLOC_INVALID_HANDLE, // not an allocation of this pool
+    ALLOC_DOUBLE_FREE     // an allocation of this pool that is not live
 } alloc_status;
 
 /* function declarations */
@@ -41,6 +144,39 @@ mem_free();
 pool_pt
 mem_pool_open(size_t size, alloc_policy policy);
 
+// note: options may be null for the defaults, which mem_pool_open uses
+pool_pt
+mem_pool_open_opts(size_t size, alloc_policy policy, const pool_options_t *options);
+
+pool_pt
+mem_slab_open(size_t object_size, size_t count);
+
+// note: reopens a persistent pool, closed or not: the state of a closed
+//       pool is read back from its header, that of one whose process died
+//       is rebuilt from its boundary tags; pool->mem is mapped anew, likely
+//       at another address, so allocations should refer to each other by
+//       their offsets in pool->mem, and the root is the way back to them;
+//       fails while the pool is open, in this or another process
+pool_pt
+mem_pool_reopen(const char *path);
+
+// note: attaches to a shared pool, whose processes may come and go; if one
+//       dies while it holds the lock, the next to lock the pool rebuilds its
+//       state from the boundary tags
+pool_pt
+mem_pool_attach(const char *shm_name);
+
+// note: the root of a persistent pool is one of its allocations, kept in
+//       the file; freeing it (or moving it) clears the root
+alloc_status
+mem_pool_set_root(pool_pt pool, void *alloc);
+
+void *
+mem_pool_root(pool_pt pool);
+
+pool_pt
+mem_atomic_slab_open(size_t object_size, size_t count);
+
 alloc_status
 mem_pool_close(pool_pt pool);
 
@@ -50,6 +186,113 @@ mem_new_alloc(pool_pt pool, size_t size);
 alloc_status
 mem_del_alloc(pool_pt pool, void *alloc);
 
+// note: alignment is a power of two; FIRST_FIT, BEST_FIT, FAST_FIT, TLSF_FIT
+//       and TAGGED_FIT leave the padding in front as a gap, BUDDY_FIT hands
+//       out a block of at least alignment, the slab pools have to be aligned
+//       already; for the node policies it is the memory of the allocation
+//       that is aligned
+void *
+mem_new_alloc_aligned(pool_pt pool, size_t size, size_t alignment);
+
+// note: batches allocate n of size, all or none, and for FIRST_FIT, BEST_FIT,
+//       FAST_FIT and TLSF_FIT carve them out of one gap when one is big enough;
+//       batch frees merge each run of gaps once and free all the good handles,
+//       returning the status of the first bad one
+alloc_status
+mem_new_alloc_n(pool_pt pool, size_t size, unsigned n, void *allocs[]);
+
+alloc_status
+mem_del_alloc_n(pool_pt pool, unsigned n, void *allocs[]);
+
+// note: like realloc, returns the allocation, which may have moved, or null
+//       with the old one left as is; a null alloc is a new allocation, a
+//       new_size of 0 frees alloc and returns null; FIRST_FIT, BEST_FIT,
+//       FAST_FIT and TLSF_FIT grow and shrink in place into the gaps next
+//       to it, keeping the alignment of an aligned allocation, and growing
+//       into the gap before it slides the memory down and changes the
+//       handle even though it stays in place; the other policies keep it
+//       in place while its block holds new_size
+void *
+mem_realloc_alloc(pool_pt pool, void *alloc, size_t new_size);
+
+// note: FIRST_FIT, BEST_FIT, FAST_FIT and TLSF_FIT hand out a handle whose
+//       first word is the memory (*(char **) alloc), which moves on
+//       reallocation in place and compaction, so it is read through the
+//       handle or had with this; the other policies hand out the memory
+//       itself; null for a bad handle
+// note: a handle freed while its node is unused or a gap is caught as a
+//       double free, one freed after its node is handed out again is not
+void *
+mem_alloc_addr(pool_pt pool, void *alloc);
+
+// note: slides allocations toward the start of their arena, so the free
+//       bytes of each arena end up in one gap at its end; moves at most
+//       budget bytes (at least one allocation, no limit if 0) per call,
+//       returns ALLOC_CALLED_AGAIN while there is more to move, ALLOC_OK
+//       once nothing more can move; the next call carries on where it
+//       stopped, unless a gap was made or changed in between
+// note: FIRST_FIT, BEST_FIT, FAST_FIT and TLSF_FIT only (ALLOC_FAIL for the
+//       others), as their handles stay valid while the memory moves;
+//       aligned allocations only move to addresses of the same alignment
+alloc_status
+mem_pool_compact(pool_pt pool, size_t budget);
+
+// note: the segments are in address order, for a growable pool arena by
+//       arena; mem_inspect_pool allocates the array, which the caller frees,
+//       mem_inspect_pool_into and mem_inspect_pool_visit allocate nothing
 void
 mem_inspect_pool(pool_pt pool, pool_segment_pt *segments, unsigned *num_segments);
+
+// note: stores up to capacity segments, returns how many the pool has
+unsigned
+mem_inspect_pool_into(pool_pt pool, pool_segment_pt segments, unsigned capacity);
+
+// note: returns how many segments were visited
+unsigned
+mem_inspect_pool_visit(pool_pt pool, pool_segment_visitor visit, void *arg);
+
+// bytes of bookkeeping the pool holds outside pool->mem
+size_t
+mem_pool_metadata(pool_pt pool);
+
+// note: with thread caches on, allocations of up to max_size (at most 256)
+//       bytes are rounded up and served by a cache of the calling thread,
+//       which takes batch allocations from the pool at a time and gives them
+//       back batch at a time, when the thread exits or on mem_pool_cache_flush;
+//       the pool counts cached allocations as allocated, mem_pool_close
+//       returns all of them first; turn the caches on before sharing the pool
+// note: frees into a cache are checked like any other, and the caches mark
+//       what they hold, so that freeing it again, into any cache or the
+//       pool, is a double free
+alloc_status
+mem_pool_cache(pool_pt pool, size_t max_size, unsigned batch);
+
+alloc_status
+mem_pool_cache_flush(pool_pt pool);
+
+void
+mem_pool_cache_stats(pool_pt pool, pool_cache_stats_pt stats);
+
+// note: O(1) in the pool size, from counts kept as the pool changes, except
+//       for the largest gap: the rightmost of the tree of FIRST_FIT and
+//       BEST_FIT, O(log gaps), the largest on the highest non-empty list
+//       for FAST_FIT, TLSF_FIT and TAGGED_FIT, O(gaps on that list)
+void
+mem_pool_stats(pool_pt pool, pool_stats_pt stats);
+
+// note: tracing records the calls on all pools, each thread into a ring of
+//       its own of capacity events (rounded up to a power of two) that keeps
+//       the latest ones; tracing starts with an open for each pool already
+//       open, whose earlier allocations are unknown to the trace
+// note: mem_trace_dump writes the events of all the rings to a file, merged
+//       in time order; dump and stop when no traced call is in progress,
+//       mem_trace_stop releases the rings
+alloc_status
+mem_trace_start(unsigned capacity);
+
+alloc_status
+mem_trace_dump(const char *path);
+
+alloc_status
+mem_trace_stop();
 #endif //C_MEM_POOL_H
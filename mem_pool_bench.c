@@ -0,0 +1,505 @@
+/*
+ * Allocation benchmark for the pool policies.
+ *
+ * Runs a steady-state workload against each requested policy and prints one
+ * record per policy (CSV with a header line, or one JSON object per line).
+ *
+ *   mem_pool_bench [--policy first|best|fast|tlsf|buddy|slab|tagged|atomic|all]
+ *                  [--sizes uniform|exp] [--min N] [--max N] [--mean N]
+ *                  [--order lifo|fifo|random] [--pools N] [--pool-size N]
+ *                  [--live N] [--ops N] [--seed N] [--format csv|json]
+ *                  [--backing heap|mmap|huge] [--workload churn|touch]
+ *                  [--label TEXT]
+ *
+ * Each pool is filled to --live allocations, then every operation frees one
+ * allocation (in --order) and allocates a new one, on the pools in turn.
+ * Latencies are per call to mem_new_alloc/mem_del_alloc, in nanoseconds.
+ * --backing mmap opens the (non-slab) pools with use_mmap, --backing huge
+ * with huge_pages.
+ *
+ * With --workload touch the ops are instead 8-byte reads at random offsets
+ * of pool->mem, the pools in turn, after every page of them was faulted in;
+ * with pools much larger than the TLB reach they are bound by TLB misses,
+ * which is what huge pages cut down.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "mem_pool.h"
+
+/*************/
+/*           */
+/* Constants */
+/*           */
+/*************/
+#define                 BENCH_NUM_POLICIES      8
+
+static const char *     BENCH_POLICY_NAMES[BENCH_NUM_POLICIES] =
+        { "first", "best", "fast", "tlsf", "buddy", "slab", "tagged", "atomic" };
+static const alloc_policy BENCH_POLICIES[BENCH_NUM_POLICIES] =
+        { FIRST_FIT, BEST_FIT, FAST_FIT, TLSF_FIT, BUDDY_FIT, SLAB_FIT, TAGGED_FIT, ATOMIC_SLAB_FIT };
+
+
+/*********************/
+/*                   */
+/* Type declarations */
+/*                   */
+/*********************/
+typedef enum _bench_sizes { SIZES_UNIFORM, SIZES_EXP } bench_sizes;
+typedef enum _bench_order { ORDER_LIFO, ORDER_FIFO, ORDER_RANDOM } bench_order;
+typedef enum _bench_backing { BACKING_HEAP, BACKING_MMAP, BACKING_HUGE } bench_backing;
+typedef enum _bench_workload { WORKLOAD_CHURN, WORKLOAD_TOUCH } bench_workload;
+
+typedef struct _bench_config {
+    int policy; // index into BENCH_POLICIES, -1 for all
+    bench_sizes sizes;
+    size_t min_size;
+    size_t max_size;
+    double mean_size;
+    bench_order order;
+    unsigned pools;
+    size_t pool_size;
+    unsigned live;
+    unsigned long ops;
+    uint64_t seed;
+    int json;
+    bench_backing backing;
+    bench_workload workload;
+    const char *label;
+} bench_config_t;
+
+// live allocations of one pool, kept as a ring so that LIFO, FIFO and
+// random frees are all O(1)
+typedef struct _bench_pool {
+    pool_pt pool;
+    void **ring;
+    unsigned head;
+    unsigned count;
+} bench_pool_t;
+
+typedef struct _bench_result {
+    unsigned long alloc_ops;
+    unsigned long free_ops;
+    unsigned long touch_ops;
+    unsigned long failed;
+    double seconds;
+    uint64_t *alloc_ns;
+    uint64_t *free_ns;
+    size_t peak_metadata;
+} bench_result_t;
+
+
+/***************************/
+/*                         */
+/* Static global variables */
+/*                         */
+/***************************/
+static uint64_t rng_state;
+static volatile uint64_t bench_sink; // keeps the reads of the touch workload
+
+
+/********************************************/
+/*                                          */
+/* Forward declarations of static functions */
+/*                                          */
+/********************************************/
+static int parse_args(int argc, char *argv[], bench_config_t *config);
+static int run_policy(const bench_config_t *config, int policy, bench_result_t *result);
+static void print_result(const bench_config_t *config, int policy, const bench_result_t *result);
+static size_t next_size(const bench_config_t *config);
+static void * pop_alloc(const bench_config_t *config, bench_pool_t *bp);
+static void fault_in(pool_pt pool);
+static uint64_t now_ns();
+static uint64_t rng_next();
+static int cmp_u64(const void *a, const void *b);
+static uint64_t percentile(uint64_t *sorted, unsigned long n, double p);
+
+
+/*****************/
+/*               */
+/* Main function */
+/*               */
+/*****************/
+int main(int argc, char *argv[]) {
+    bench_config_t config = {
+            .policy = -1,
+            .sizes = SIZES_UNIFORM,
+            .min_size = 8,
+            .max_size = 1024,
+            .mean_size = 128,
+            .order = ORDER_RANDOM,
+            .pools = 1,
+            .pool_size = 1000000,
+            .live = 1000,
+            .ops = 200000,
+            .seed = 1,
+            .json = 0,
+            .backing = BACKING_HEAP,
+            .workload = WORKLOAD_CHURN,
+            .label = "",
+    };
+
+    if(parse_args(argc, argv, &config) != 0){
+        return 2;
+    }
+
+    if(!config.json){
+        printf("label,policy,sizes,order,pools,pool_size,live,ops,seed,backing,workload,"
+               "alloc_ops,free_ops,touch_ops,failed,seconds,ops_per_sec,"
+               "alloc_p50_ns,alloc_p99_ns,alloc_p999_ns,"
+               "free_p50_ns,free_p99_ns,free_p999_ns,peak_metadata_bytes\n");
+    }
+
+    for(int p = 0; p < BENCH_NUM_POLICIES; p++){
+        if(config.policy != -1 && config.policy != p){
+            continue;
+        }
+
+        bench_result_t result;
+        if(run_policy(&config, p, &result) != 0){
+            fprintf(stderr, "mem_pool_bench: %s: failed to set up the pools\n",
+                    BENCH_POLICY_NAMES[p]);
+            return 1;
+        }
+        print_result(&config, p, &result);
+        free(result.alloc_ns);
+        free(result.free_ns);
+    }
+
+    return 0;
+}
+
+
+/***********************************/
+/*                                 */
+/* Definitions of static functions */
+/*                                 */
+/***********************************/
+static int parse_args(int argc, char *argv[], bench_config_t *config) {
+    for(int i = 1; i < argc; i++){
+        const char *opt = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if(val == NULL){
+            fprintf(stderr, "mem_pool_bench: %s needs a value\n", opt);
+            return -1;
+        }
+        i++;
+
+        if(strcmp(opt, "--policy") == 0){
+            config->policy = -2;
+            if(strcmp(val, "all") == 0){
+                config->policy = -1;
+            }
+            for(int p = 0; p < BENCH_NUM_POLICIES; p++){
+                if(strcmp(val, BENCH_POLICY_NAMES[p]) == 0){
+                    config->policy = p;
+                }
+            }
+            if(config->policy == -2){
+                fprintf(stderr, "mem_pool_bench: unknown policy %s\n", val);
+                return -1;
+            }
+        } else if(strcmp(opt, "--sizes") == 0){
+            if(strcmp(val, "uniform") == 0){
+                config->sizes = SIZES_UNIFORM;
+            } else if(strcmp(val, "exp") == 0){
+                config->sizes = SIZES_EXP;
+            } else {
+                fprintf(stderr, "mem_pool_bench: unknown size distribution %s\n", val);
+                return -1;
+            }
+        } else if(strcmp(opt, "--order") == 0){
+            if(strcmp(val, "lifo") == 0){
+                config->order = ORDER_LIFO;
+            } else if(strcmp(val, "fifo") == 0){
+                config->order = ORDER_FIFO;
+            } else if(strcmp(val, "random") == 0){
+                config->order = ORDER_RANDOM;
+            } else {
+                fprintf(stderr, "mem_pool_bench: unknown free order %s\n", val);
+                return -1;
+            }
+        } else if(strcmp(opt, "--min") == 0){
+            config->min_size = strtoull(val, NULL, 10);
+        } else if(strcmp(opt, "--max") == 0){
+            config->max_size = strtoull(val, NULL, 10);
+        } else if(strcmp(opt, "--mean") == 0){
+            config->mean_size = strtod(val, NULL);
+        } else if(strcmp(opt, "--pools") == 0){
+            config->pools = (unsigned) strtoul(val, NULL, 10);
+        } else if(strcmp(opt, "--pool-size") == 0){
+            config->pool_size = strtoull(val, NULL, 10);
+        } else if(strcmp(opt, "--live") == 0){
+            config->live = (unsigned) strtoul(val, NULL, 10);
+        } else if(strcmp(opt, "--ops") == 0){
+            config->ops = strtoul(val, NULL, 10);
+        } else if(strcmp(opt, "--seed") == 0){
+            config->seed = strtoull(val, NULL, 10);
+        } else if(strcmp(opt, "--format") == 0){
+            config->json = (strcmp(val, "json") == 0);
+        } else if(strcmp(opt, "--backing") == 0){
+            if(strcmp(val, "heap") == 0){
+                config->backing = BACKING_HEAP;
+            } else if(strcmp(val, "mmap") == 0){
+                config->backing = BACKING_MMAP;
+            } else if(strcmp(val, "huge") == 0){
+                config->backing = BACKING_HUGE;
+            } else {
+                fprintf(stderr, "mem_pool_bench: unknown backing %s\n", val);
+                return -1;
+            }
+        } else if(strcmp(opt, "--workload") == 0){
+            if(strcmp(val, "churn") == 0){
+                config->workload = WORKLOAD_CHURN;
+            } else if(strcmp(val, "touch") == 0){
+                config->workload = WORKLOAD_TOUCH;
+            } else {
+                fprintf(stderr, "mem_pool_bench: unknown workload %s\n", val);
+                return -1;
+            }
+        } else if(strcmp(opt, "--label") == 0){
+            config->label = val;
+        } else {
+            fprintf(stderr, "mem_pool_bench: unknown option %s\n", opt);
+            return -1;
+        }
+    }
+
+    if(config->pools == 0 || config->live == 0 || config->min_size == 0
+       || config->min_size > config->max_size || config->mean_size <= 0){
+        fprintf(stderr, "mem_pool_bench: invalid configuration\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int run_policy(const bench_config_t *config, int policy, bench_result_t *result) {
+    // open the pools (slab pools get one slot per max_size in pool_size)
+    // fill every pool to live allocations (not timed)
+    // run the ops, one free and one alloc each, on the pools in turn,
+    //   or for the touch workload one random read each
+    // drain and close the pools
+    memset(result, 0, sizeof(bench_result_t));
+    result->alloc_ns = calloc(config->ops, sizeof(uint64_t));
+    result->free_ns = calloc(config->ops, sizeof(uint64_t));
+    bench_pool_t *pools = calloc(config->pools, sizeof(bench_pool_t));
+    if(result->alloc_ns == NULL || result->free_ns == NULL || pools == NULL){
+        free(pools);
+        return -1;
+    }
+
+    rng_state = config->seed ? config->seed : 1;
+    mem_init();
+
+    const pool_options_t options = {
+            .use_mmap = (config->backing == BACKING_MMAP),
+            .huge_pages = (config->backing == BACKING_HUGE),
+    };
+    size_t metadata = 0;
+    for(unsigned i = 0; i < config->pools; i++){
+        if(BENCH_POLICIES[policy] == SLAB_FIT){
+            pools[i].pool = mem_slab_open(config->max_size, config->pool_size / config->max_size);
+        } else if(BENCH_POLICIES[policy] == ATOMIC_SLAB_FIT){
+            pools[i].pool = mem_atomic_slab_open(config->max_size, config->pool_size / config->max_size);
+        } else {
+            pools[i].pool = mem_pool_open_opts(config->pool_size, BENCH_POLICIES[policy], &options);
+        }
+        pools[i].ring = calloc(config->live, sizeof(void *));
+        if(pools[i].pool == NULL || pools[i].ring == NULL){
+            return -1;
+        }
+        for(unsigned j = 0; j < config->live; j++){
+            void *alloc = mem_new_alloc(pools[i].pool, next_size(config));
+            if(alloc != NULL){
+                pools[i].ring[(pools[i].head + pools[i].count++) % config->live] = alloc;
+            }
+        }
+        metadata += mem_pool_metadata(pools[i].pool);
+    }
+    result->peak_metadata = metadata;
+
+    if(config->workload == WORKLOAD_TOUCH){
+        for(unsigned i = 0; i < config->pools; i++){
+            fault_in(pools[i].pool);
+        }
+    }
+
+    uint64_t start = now_ns();
+    uint64_t sum = 0;
+    for(unsigned long op = 0; op < config->ops; op++){
+        bench_pool_t *bp = &pools[op % config->pools];
+
+        if(config->workload == WORKLOAD_TOUCH){
+            size_t words = bp->pool->total_size / sizeof(uint64_t);
+            sum += ((volatile uint64_t *) bp->pool->mem)[rng_next() % words];
+            result->touch_ops++;
+            continue;
+        }
+
+        void *alloc = pop_alloc(config, bp);
+        if(alloc != NULL){
+            uint64_t t0 = now_ns();
+            mem_del_alloc(bp->pool, alloc);
+            result->free_ns[result->free_ops++] = now_ns() - t0;
+        }
+
+        size_t size = next_size(config);
+        size_t before = mem_pool_metadata(bp->pool);
+        uint64_t t0 = now_ns();
+        alloc = mem_new_alloc(bp->pool, size);
+        result->alloc_ns[result->alloc_ops++] = now_ns() - t0;
+        if(alloc == NULL){
+            result->failed++;
+        } else {
+            bp->ring[(bp->head + bp->count++) % config->live] = alloc;
+        }
+
+        metadata += mem_pool_metadata(bp->pool) - before;
+        if(metadata > result->peak_metadata){
+            result->peak_metadata = metadata;
+        }
+    }
+    result->seconds = (now_ns() - start) / 1e9;
+    bench_sink = sum;
+
+    for(unsigned i = 0; i < config->pools; i++){
+        void *alloc;
+        while((alloc = pop_alloc(config, &pools[i])) != NULL){
+            mem_del_alloc(pools[i].pool, alloc);
+        }
+        mem_pool_close(pools[i].pool);
+        free(pools[i].ring);
+    }
+    free(pools);
+    mem_free();
+
+    return 0;
+}
+
+static void print_result(const bench_config_t *config, int policy, const bench_result_t *result) {
+    static const char *sizes[] = { "uniform", "exp" };
+    static const char *orders[] = { "lifo", "fifo", "random" };
+    static const char *backings[] = { "heap", "mmap", "huge" };
+    static const char *workloads[] = { "churn", "touch" };
+
+    qsort(result->alloc_ns, result->alloc_ops, sizeof(uint64_t), cmp_u64);
+    qsort(result->free_ns, result->free_ops, sizeof(uint64_t), cmp_u64);
+
+    unsigned long ops = result->alloc_ops + result->free_ops + result->touch_ops;
+    double ops_per_sec = result->seconds > 0 ? ops / result->seconds : 0;
+
+    const char *fmt = config->json
+        ? "{\"label\":\"%s\",\"policy\":\"%s\",\"sizes\":\"%s\",\"order\":\"%s\","
+          "\"pools\":%u,\"pool_size\":%zu,\"live\":%u,\"ops\":%lu,\"seed\":%llu,"
+          "\"backing\":\"%s\",\"workload\":\"%s\","
+          "\"alloc_ops\":%lu,\"free_ops\":%lu,\"touch_ops\":%lu,\"failed\":%lu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+          "\"alloc_p50_ns\":%llu,\"alloc_p99_ns\":%llu,\"alloc_p999_ns\":%llu,"
+          "\"free_p50_ns\":%llu,\"free_p99_ns\":%llu,\"free_p999_ns\":%llu,"
+          "\"peak_metadata_bytes\":%zu}\n"
+        : "%s,%s,%s,%s,%u,%zu,%u,%lu,%llu,%s,%s,%lu,%lu,%lu,%lu,%.6f,%.0f,"
+          "%llu,%llu,%llu,%llu,%llu,%llu,%zu\n";
+
+    printf(fmt, config->label, BENCH_POLICY_NAMES[policy],
+           sizes[config->sizes], orders[config->order],
+           config->pools, config->pool_size, config->live, config->ops,
+           (unsigned long long) config->seed,
+           backings[config->backing], workloads[config->workload],
+           result->alloc_ops, result->free_ops, result->touch_ops, result->failed,
+           result->seconds, ops_per_sec,
+           (unsigned long long) percentile(result->alloc_ns, result->alloc_ops, 0.50),
+           (unsigned long long) percentile(result->alloc_ns, result->alloc_ops, 0.99),
+           (unsigned long long) percentile(result->alloc_ns, result->alloc_ops, 0.999),
+           (unsigned long long) percentile(result->free_ns, result->free_ops, 0.50),
+           (unsigned long long) percentile(result->free_ns, result->free_ops, 0.99),
+           (unsigned long long) percentile(result->free_ns, result->free_ops, 0.999),
+           result->peak_metadata);
+}
+
+static size_t next_size(const bench_config_t *config) {
+    size_t span = config->max_size - config->min_size + 1;
+
+    if(config->sizes == SIZES_UNIFORM){
+        return config->min_size + rng_next() % span;
+    }
+
+    // exponential with the given mean, clamped to [min, max]
+    double u = (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+    double size = -config->mean_size * log(1.0 - u);
+    if(size < config->min_size){
+        return config->min_size;
+    }
+    if(size > config->max_size){
+        return config->max_size;
+    }
+    return (size_t) size;
+}
+
+static void fault_in(pool_pt pool) {
+    // write every page of the pool with what it holds, so that the pages
+    // are committed without disturbing the tags of the in-band policies
+    for(size_t offset = 0; offset < pool->total_size; offset += 4096){
+        volatile char *byte = pool->mem + offset;
+        *byte = *byte;
+    }
+}
+
+static void * pop_alloc(const bench_config_t *config, bench_pool_t *bp) {
+    if(bp->count == 0){
+        return NULL;
+    }
+
+    unsigned slot;
+    if(config->order == ORDER_FIFO){
+        slot = bp->head;
+        bp->head = (bp->head + 1) % config->live;
+    } else {
+        slot = (bp->head + bp->count - 1) % config->live;
+        if(config->order == ORDER_RANDOM){
+            // swap a random live allocation into the last slot
+            unsigned pick = (bp->head + rng_next() % bp->count) % config->live;
+            void *temp = bp->ring[pick];
+            bp->ring[pick] = bp->ring[slot];
+            bp->ring[slot] = temp;
+        }
+    }
+    bp->count--;
+
+    return bp->ring[slot];
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t rng_next() {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(uint64_t *sorted, unsigned long n, double p) {
+    if(n == 0){
+        return 0;
+    }
+    unsigned long i = (unsigned long) (p * (n - 1) + 0.5);
+    return sorted[i];
+}
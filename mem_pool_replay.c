@@ -0,0 +1,563 @@
+/*
+ * Trace replay for the pool policies.
+ *
+ * Re-drives a trace written by mem_trace_dump against each requested policy
+ * and prints one record per policy (CSV with a header line, or one JSON
+ * object per line).
+ *
+ *   mem_pool_replay TRACE [--policy first|best|fast|tlsf|buddy|slab|tagged|atomic|all]
+ *                         [--sample N] [--format csv|json]
+ *
+ * The events are replayed in the order of the trace, from one thread. Each
+ * traced pool is opened with its traced size under the policy being replayed;
+ * slab pools get slots of the traced object size, or of the largest traced
+ * allocation of a pool that was not a slab pool. Frees and reallocations of
+ * handles the trace does not know (allocated before tracing started) and
+ * events of pools it never opened are skipped. Allocations that were traced
+ * as failed are tried again. What a pool still holds when it is closed, or
+ * at the end of the trace, is freed before the pool is closed.
+ *
+ * Every --sample events (0 for never) the fragmentation of the open pools
+ * is sampled with mem_pool_stats, outside of the timed replay.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "mem_pool.h"
+
+/*************/
+/*           */
+/* Constants */
+/*           */
+/*************/
+#define                 REPLAY_NUM_POLICIES     8
+
+static const char *     REPLAY_POLICY_NAMES[REPLAY_NUM_POLICIES] =
+        { "first", "best", "fast", "tlsf", "buddy", "slab", "tagged", "atomic" };
+static const alloc_policy REPLAY_POLICIES[REPLAY_NUM_POLICIES] =
+        { FIRST_FIT, BEST_FIT, FAST_FIT, TLSF_FIT, BUDDY_FIT, SLAB_FIT, TAGGED_FIT, ATOMIC_SLAB_FIT };
+
+
+/*********************/
+/*                   */
+/* Type declarations */
+/*                   */
+/*********************/
+typedef struct _replay_config {
+    const char *path;
+    int policy; // index into REPLAY_POLICIES, -1 for all
+    unsigned long sample;
+    int json;
+} replay_config_t;
+
+typedef struct _replay_pool {
+    unsigned id; // as traced
+    size_t size; // total size, as traced
+    int slab; // traced as a slab pool
+    size_t object_size; // slab pools: the traced object size, otherwise the largest allocation
+    pool_pt pool; // while it is replayed
+} replay_pool_t;
+
+// the events of a trace, with each free or reallocation resolved to the
+// allocation event it frees (so the replay needs no lookups), and each
+// event to its pool
+typedef struct _replay_trace {
+    trace_event_t *events;
+    unsigned long num_events;
+    long *refs; // per event, the event of the allocation it frees or reallocates, -1 for none
+    long *pool_ix; // per event, index into pools, -1 for a pool never opened
+    replay_pool_t *pools; // in the order of their ids
+    unsigned num_pools;
+} replay_trace_t;
+
+typedef struct _replay_entry {
+    unsigned long long handle; // 0 for an empty entry
+    unsigned pool;
+    long event; // -1 once freed
+} replay_entry_t;
+
+typedef struct _replay_result {
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long reallocs;
+    unsigned long failed;
+    unsigned long skipped;
+    double seconds;
+    size_t peak_alloc_size; // over all pools
+    double fragmentation_sum;
+    unsigned long fragmentation_samples;
+    double max_fragmentation;
+} replay_result_t;
+
+
+/********************************************/
+/*                                          */
+/* Forward declarations of static functions */
+/*                                          */
+/********************************************/
+static int parse_args(int argc, char *argv[], replay_config_t *config);
+static int load_trace(const char *path, replay_trace_t *trace);
+static int resolve_trace(replay_trace_t *trace);
+static replay_entry_t * find_entry(replay_entry_t *table, size_t mask, unsigned pool, unsigned long long handle);
+static long find_pool(const replay_trace_t *trace, unsigned id);
+static int run_policy(const replay_config_t *config, const replay_trace_t *trace, int policy,
+                      replay_result_t *result);
+static pool_pt open_pool(int policy, const replay_pool_t *rp);
+static void close_pool(const replay_trace_t *trace, long p, unsigned long end, void **live,
+                       replay_result_t *result);
+static void sample_pools(const replay_trace_t *trace, replay_result_t *result);
+static void print_result(const replay_config_t *config, const replay_trace_t *trace, int policy,
+                         const replay_result_t *result);
+static uint64_t now_ns();
+
+
+/*****************/
+/*               */
+/* Main function */
+/*               */
+/*****************/
+int main(int argc, char *argv[]) {
+    replay_config_t config = {
+            .path = NULL,
+            .policy = -1,
+            .sample = 1000,
+            .json = 0,
+    };
+    replay_trace_t trace;
+
+    if(parse_args(argc, argv, &config) != 0){
+        return 2;
+    }
+
+    if(load_trace(config.path, &trace) != 0 || resolve_trace(&trace) != 0){
+        return 1;
+    }
+
+    if(!config.json){
+        printf("trace,policy,events,allocs,frees,reallocs,failed,skipped,seconds,ops_per_sec,"
+               "peak_alloc_bytes,mean_fragmentation,max_fragmentation\n");
+    }
+
+    for(int p = 0; p < REPLAY_NUM_POLICIES; p++){
+        if(config.policy != -1 && config.policy != p){
+            continue;
+        }
+
+        replay_result_t result;
+        if(run_policy(&config, &trace, p, &result) != 0){
+            fprintf(stderr, "mem_pool_replay: %s: failed to open the pools\n",
+                    REPLAY_POLICY_NAMES[p]);
+            return 1;
+        }
+        print_result(&config, &trace, p, &result);
+    }
+
+    free(trace.events);
+    free(trace.refs);
+    free(trace.pool_ix);
+    free(trace.pools);
+
+    return 0;
+}
+
+
+/***********************************/
+/*                                 */
+/* Definitions of static functions */
+/*                                 */
+/***********************************/
+static int parse_args(int argc, char *argv[], replay_config_t *config) {
+    for(int i = 1; i < argc; i++){
+        const char *opt = argv[i];
+
+        if(strncmp(opt, "--", 2) != 0){
+            if(config->path != NULL){
+                fprintf(stderr, "mem_pool_replay: more than one trace\n");
+                return -1;
+            }
+            config->path = opt;
+            continue;
+        }
+
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if(val == NULL){
+            fprintf(stderr, "mem_pool_replay: %s needs a value\n", opt);
+            return -1;
+        }
+        i++;
+
+        if(strcmp(opt, "--policy") == 0){
+            config->policy = -2;
+            if(strcmp(val, "all") == 0){
+                config->policy = -1;
+            }
+            for(int p = 0; p < REPLAY_NUM_POLICIES; p++){
+                if(strcmp(val, REPLAY_POLICY_NAMES[p]) == 0){
+                    config->policy = p;
+                }
+            }
+            if(config->policy == -2){
+                fprintf(stderr, "mem_pool_replay: unknown policy %s\n", val);
+                return -1;
+            }
+        } else if(strcmp(opt, "--sample") == 0){
+            config->sample = strtoul(val, NULL, 10);
+        } else if(strcmp(opt, "--format") == 0){
+            config->json = (strcmp(val, "json") == 0);
+        } else {
+            fprintf(stderr, "mem_pool_replay: unknown option %s\n", opt);
+            return -1;
+        }
+    }
+
+    if(config->path == NULL){
+        fprintf(stderr, "mem_pool_replay: no trace given\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int load_trace(const char *path, replay_trace_t *trace) {
+    // read and check the header
+    // read all the events
+    memset(trace, 0, sizeof(replay_trace_t));
+
+    FILE *file = fopen(path, "rb");
+    if(file == NULL){
+        perror(path);
+        return -1;
+    }
+
+    trace_header_t header;
+    if(fread(&header, sizeof(header), 1, file) != 1
+       || memcmp(header.magic, "MEMTRACE", sizeof(header.magic)) != 0
+       || header.version != 1 || header.event_size != sizeof(trace_event_t)){
+        fprintf(stderr, "mem_pool_replay: %s: not a trace\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    trace->num_events = (unsigned long) header.num_events;
+    trace->events = malloc((trace->num_events + 1) * sizeof(trace_event_t));
+    if(trace->events == NULL
+       || fread(trace->events, sizeof(trace_event_t), trace->num_events, file) != trace->num_events){
+        fprintf(stderr, "mem_pool_replay: %s: short trace\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int resolve_trace(replay_trace_t *trace) {
+    // size a table of live handles for every allocation of the trace
+    // for each event, in order:
+    //    an open adds its pool, if it is a new one
+    //    any other event is of the pool of its id, or skipped
+    //    an allocation makes its handle live (the largest one sizes slabs)
+    //    a free ends its handle, a reallocation moves it to its new one
+    //    (a failed reallocation still moves it, to the same allocation)
+    unsigned long n = trace->num_events;
+    size_t mask = 1;
+    while(mask < 2 * n){
+        mask <<= 1;
+    }
+    mask--;
+
+    replay_entry_t *table = calloc(mask + 1, sizeof(replay_entry_t));
+    trace->refs = malloc((n + 1) * sizeof(long));
+    trace->pool_ix = malloc((n + 1) * sizeof(long));
+    trace->pools = calloc(n + 1, sizeof(replay_pool_t));
+    if(table == NULL || trace->refs == NULL || trace->pool_ix == NULL || trace->pools == NULL){
+        fprintf(stderr, "mem_pool_replay: out of memory\n");
+        free(table);
+        return -1;
+    }
+
+    for(unsigned long i = 0; i < n; i++){
+        const trace_event_t *event = &trace->events[i];
+        trace->refs[i] = -1;
+
+        if(event->op == TRACE_OPEN){
+            long p = find_pool(trace, event->pool);
+            if(p < 0){
+                replay_pool_t *rp = &trace->pools[trace->num_pools];
+                rp->id = event->pool;
+                rp->size = event->size;
+                rp->slab = (event->handle != 0);
+                rp->object_size = event->handle;
+                p = trace->num_pools++;
+            }
+            trace->pool_ix[i] = p;
+            continue;
+        }
+
+        long p = find_pool(trace, event->pool);
+        trace->pool_ix[i] = p;
+        if(p < 0){
+            continue;
+        }
+
+        replay_entry_t *entry;
+        switch(event->op){
+            case TRACE_ALLOC:
+            case TRACE_ALIGNED:
+                if(event->handle != 0){
+                    entry = find_entry(table, mask, event->pool, event->handle);
+                    entry->event = (long) i;
+                }
+                if(!trace->pools[p].slab && event->size > trace->pools[p].object_size){
+                    trace->pools[p].object_size = event->size;
+                }
+                break;
+            case TRACE_FREE:
+                entry = find_entry(table, mask, event->pool, event->handle);
+                trace->refs[i] = entry->event;
+                entry->event = -1;
+                break;
+            case TRACE_REALLOC:
+                if(event->arg != 0){
+                    entry = find_entry(table, mask, event->pool, event->arg);
+                    trace->refs[i] = entry->event;
+                    entry->event = (event->handle == 0 && event->size != 0) ? (long) i : -1;
+                }
+                if(event->handle != 0){
+                    entry = find_entry(table, mask, event->pool, event->handle);
+                    entry->event = (long) i;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    free(table);
+    return 0;
+}
+
+static replay_entry_t * find_entry(replay_entry_t *table, size_t mask, unsigned pool, unsigned long long handle) {
+    // probe linearly from the hash of the handle and pool, up to the
+    //   entry of the handle or an empty one, which is made its entry
+    // note: entries are never emptied, the table holds every handle once
+    size_t i = (size_t) (((handle >> 4) ^ ((unsigned long long) pool << 40)) * 0x9E3779B97F4A7C15ULL) & mask;
+    while(table[i].handle != 0 && (table[i].handle != handle || table[i].pool != pool)){
+        i = (i + 1) & mask;
+    }
+    if(table[i].handle == 0){
+        table[i].handle = handle;
+        table[i].pool = pool;
+        table[i].event = -1;
+    }
+    return &table[i];
+}
+
+static long find_pool(const replay_trace_t *trace, unsigned id) {
+    // pools are numbered in the order they are opened, so the trace
+    //   adds them in order of their ids, search them by halves
+    long lo = 0, hi = (long) trace->num_pools - 1;
+    while(lo <= hi){
+        long mid = lo + (hi - lo) / 2;
+        if(trace->pools[mid].id == id){
+            return mid;
+        }
+        if(trace->pools[mid].id < id){
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+static int run_policy(const replay_config_t *config, const replay_trace_t *trace, int policy,
+                      replay_result_t *result) {
+    // replay the events in order, live[i] holds the allocation of event i
+    //    an open opens its pool under the policy, unless it is open
+    //    allocations, frees and reallocations go to the live allocations
+    //    a close frees what its pool still holds and closes it
+    //    sample the fragmentation every so often, not timed
+    // close the pools still open, not timed
+    memset(result, 0, sizeof(replay_result_t));
+    void **live = calloc(trace->num_events + 1, sizeof(void *));
+    if(live == NULL){
+        return -1;
+    }
+
+    mem_init();
+
+    uint64_t start = now_ns();
+    uint64_t paused = 0;
+    for(unsigned long i = 0; i < trace->num_events; i++){
+        const trace_event_t *event = &trace->events[i];
+        long p = trace->pool_ix[i];
+        replay_pool_t *rp = (p >= 0) ? &trace->pools[p] : NULL;
+
+        if(rp == NULL || (event->op != TRACE_OPEN && rp->pool == NULL)){
+            result->skipped++;
+            continue;
+        }
+
+        long ref = trace->refs[i];
+        void *alloc, *new_alloc;
+        switch(event->op){
+            case TRACE_OPEN:
+                if(rp->pool == NULL){
+                    rp->pool = open_pool(policy, rp);
+                    if(rp->pool == NULL){
+                        free(live);
+                        return -1;
+                    }
+                }
+                break;
+            case TRACE_CLOSE: {
+                uint64_t t0 = now_ns();
+                close_pool(trace, p, i, live, result);
+                paused += now_ns() - t0;
+                break;
+            }
+            case TRACE_ALLOC:
+                live[i] = mem_new_alloc(rp->pool, event->size);
+                result->allocs++;
+                result->failed += (live[i] == NULL);
+                break;
+            case TRACE_ALIGNED:
+                live[i] = mem_new_alloc_aligned(rp->pool, event->size, event->arg);
+                result->allocs++;
+                result->failed += (live[i] == NULL);
+                break;
+            case TRACE_FREE:
+                if(ref < 0 || live[ref] == NULL){
+                    result->skipped++;
+                    break;
+                }
+                mem_del_alloc(rp->pool, live[ref]);
+                live[ref] = NULL;
+                result->frees++;
+                break;
+            case TRACE_REALLOC:
+                if(event->arg != 0 && ref < 0){
+                    result->skipped++;
+                    break;
+                }
+                alloc = (ref >= 0) ? live[ref] : NULL;
+                new_alloc = mem_realloc_alloc(rp->pool, alloc, event->size);
+                if(ref >= 0){
+                    live[ref] = NULL;
+                }
+                live[i] = (new_alloc != NULL || event->size == 0) ? new_alloc : alloc;
+                result->reallocs++;
+                result->failed += (new_alloc == NULL && event->size != 0);
+                break;
+            default:
+                result->skipped++;
+                break;
+        }
+
+        if(config->sample != 0 && (i + 1) % config->sample == 0){
+            uint64_t t0 = now_ns();
+            sample_pools(trace, result);
+            paused += now_ns() - t0;
+        }
+    }
+    result->seconds = (now_ns() - start - paused) / 1e9;
+
+    for(unsigned p = 0; p < trace->num_pools; p++){
+        if(trace->pools[p].pool != NULL){
+            close_pool(trace, p, trace->num_events, live, result);
+        }
+    }
+
+    mem_free();
+    free(live);
+
+    return 0;
+}
+
+static pool_pt open_pool(int policy, const replay_pool_t *rp) {
+    // slab pools get as many slots of the object size as the traced size
+    //   holds, the others the traced size
+    if(REPLAY_POLICIES[policy] == SLAB_FIT || REPLAY_POLICIES[policy] == ATOMIC_SLAB_FIT){
+        size_t object_size = (rp->object_size != 0) ? rp->object_size : sizeof(void *);
+        size_t slot_size = (object_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+        size_t count = (rp->size / slot_size != 0) ? rp->size / slot_size : 1;
+        return (REPLAY_POLICIES[policy] == SLAB_FIT)
+               ? mem_slab_open(object_size, count)
+               : mem_atomic_slab_open(object_size, count);
+    }
+    return mem_pool_open(rp->size, REPLAY_POLICIES[policy]);
+}
+
+static void close_pool(const replay_trace_t *trace, long p, unsigned long end, void **live,
+                       replay_result_t *result) {
+    // free what the pool still holds of the events before end
+    // take its peak, then close it
+    replay_pool_t *rp = &trace->pools[p];
+
+    for(unsigned long i = 0; i < end; i++){
+        if(live[i] != NULL && trace->pool_ix[i] == p){
+            mem_del_alloc(rp->pool, live[i]);
+            live[i] = NULL;
+        }
+    }
+
+    pool_stats_t stats;
+    mem_pool_stats(rp->pool, &stats);
+    result->peak_alloc_size += stats.peak_alloc_size;
+
+    mem_pool_close(rp->pool);
+    rp->pool = NULL;
+}
+
+static void sample_pools(const replay_trace_t *trace, replay_result_t *result) {
+    // one sample per open pool that has something free
+    for(unsigned p = 0; p < trace->num_pools; p++){
+        if(trace->pools[p].pool == NULL){
+            continue;
+        }
+
+        pool_stats_t stats;
+        mem_pool_stats(trace->pools[p].pool, &stats);
+        if(stats.free_size == 0){
+            continue;
+        }
+        result->fragmentation_sum += stats.fragmentation;
+        result->fragmentation_samples++;
+        if(stats.fragmentation > result->max_fragmentation){
+            result->max_fragmentation = stats.fragmentation;
+        }
+    }
+}
+
+static void print_result(const replay_config_t *config, const replay_trace_t *trace, int policy,
+                         const replay_result_t *result) {
+    unsigned long ops = result->allocs + result->frees + result->reallocs;
+    double ops_per_sec = result->seconds > 0 ? ops / result->seconds : 0;
+    double mean_fragmentation = result->fragmentation_samples != 0
+                                ? result->fragmentation_sum / result->fragmentation_samples : 0;
+
+    const char *fmt = config->json
+        ? "{\"trace\":\"%s\",\"policy\":\"%s\",\"events\":%lu,"
+          "\"allocs\":%lu,\"frees\":%lu,\"reallocs\":%lu,\"failed\":%lu,\"skipped\":%lu,"
+          "\"seconds\":%.6f,\"ops_per_sec\":%.0f,\"peak_alloc_bytes\":%zu,"
+          "\"mean_fragmentation\":%.4f,\"max_fragmentation\":%.4f}\n"
+        : "%s,%s,%lu,%lu,%lu,%lu,%lu,%lu,%.6f,%.0f,%zu,%.4f,%.4f\n";
+
+    printf(fmt, config->path, REPLAY_POLICY_NAMES[policy], trace->num_events,
+           result->allocs, result->frees, result->reallocs, result->failed, result->skipped,
+           result->seconds, ops_per_sec, result->peak_alloc_size,
+           mean_fragmentation, result->max_fragmentation);
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
@@ -4,6 +4,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h> // for UINT_MAX
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h> // for shm_unlink()
+#include <sys/wait.h>
 
 #include <stdarg.h>
 #include <stddef.h>
@@ -233,6 +241,69 @@ static void test_pool_nonempty(void **state) {
     assert_int_equal(status, ALLOC_OK);
 }
 
+static void test_pool_bad_handles(void **state) {
+    (void) state; /* unused */
+
+    pool_pt pool = NULL;
+    int foreign = 0;
+
+    alloc_status status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    for (int i=0; i<2; i++) {
+        alloc_policy POOL_POLICY = (i % 2) ? FIRST_FIT : BEST_FIT;
+
+        INFO("Allocating pool of %lu bytes with policy %s\n",
+             (long) POOL_SIZE, (POOL_POLICY == FIRST_FIT) ? "FIRST_FIT" : "BEST_FIT");
+        pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+        assert_non_null(pool);
+
+        INFO("Allocating 100 bytes\n");
+        void * alloc = mem_new_alloc(pool, 100);
+        assert_non_null(alloc);
+
+        INFO("Deallocating a foreign pointer and a misaligned one...\n");
+        status = mem_del_alloc(pool, &foreign);
+        assert_int_equal(status, ALLOC_INVALID_HANDLE);
+        status = mem_del_alloc(pool, (char *) alloc + 1);
+        assert_int_equal(status, ALLOC_INVALID_HANDLE);
+        INFO("Failed, as expected\n");
+
+        INFO("Deallocating 100 bytes twice...\n");
+        status = mem_del_alloc(pool, alloc);
+        assert_int_equal(status, ALLOC_OK);
+        status = mem_del_alloc(pool, alloc);
+        assert_int_equal(status, ALLOC_DOUBLE_FREE);
+        INFO("Failed, as expected\n");
+
+        INFO("Deallocating 100 bytes again once its node is a gap...\n");
+        void * stale = mem_new_alloc(pool, 100);
+        void * keep = mem_new_alloc(pool, 100);
+        assert_non_null(stale);
+        assert_non_null(keep);
+        assert_ptr_equal(*(char **) stale, pool->mem);
+        assert_ptr_equal(mem_alloc_addr(pool, stale), pool->mem);
+        status = mem_del_alloc(pool, stale);
+        assert_int_equal(status, ALLOC_OK);
+        assert_null(mem_alloc_addr(pool, stale));
+        status = mem_del_alloc(pool, stale);
+        assert_int_equal(status, ALLOC_DOUBLE_FREE);
+        assert_null(mem_realloc_alloc(pool, stale, 200));
+        INFO("Failed, as expected\n");
+        status = mem_del_alloc(pool, keep);
+        assert_int_equal(status, ALLOC_OK);
+
+        check_metadata(pool, POOL_POLICY, POOL_SIZE, 0, 0, 1);
+
+        INFO("Closing pool\n");
+        status = mem_pool_close(pool);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+}
+
 
 /*******************************************/
 /***       2. USER-FACING METADATA       ***/
@@ -2315,125 +2386,3124 @@ static void test_pool_scenario19(void **state) {
 }
 
 /*******************************************/
-/***        5. STRESS TESTING            ***/
+/***        5. FAST_FIT SCENARIOS        ***/
 /*******************************************/
 
-void test_pool_stresstest0(void **state) {
-    (void) state; /* unused */
+static int pool_fast_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = FAST_FIT;
+    pool_pt pool = NULL;
 
-    const unsigned num_pools = 200;
-    const unsigned num_allocations = 1000;
-    const unsigned min_alloc_size = 10;
-    const unsigned pool_size =
-            (num_allocations / 2) *
-            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
-    assert_int_equal(pool_size, 5005000);
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
 
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "FAST_FIT");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
 
-    pool_pt pools[num_pools];
-    void *allocations[num_pools][num_allocations];
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_fast_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario20(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
 
     /*
-     * Testing dynamic reallocation of pool structures:
+     * Scenario 20:
      *
-     * 1. 200 pools of 5005000 each (many pools)
-     * 2. In each pool 1000 allocations of different sizes (many allocations)
-     * 3. In each pool 500 deallocations (many gaps)
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 100. That will be at the top. The rest is a gap.
+     * 3. Deallocate the 100 allocation. Pool is again one single gap.
      */
 
-    // initialize store
-    assert_int_equal(mem_init(), ALLOC_OK);
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FAST_FIT, POOL_SIZE, 0, 0, 1);
 
-    // allocate pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // open pool
-        pools[pix] =
-                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
-        assert_non_null(pools[pix]);
-        // allocate pool
-        unsigned allocated = 0;
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            allocations[pix][aix] =
-                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
-            allocated += (aix + 1) * min_alloc_size;
-            if (!allocations[pix][aix]) {
-                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
-            }
-            assert_non_null(allocations[pix][aix]);
-        }
 
-        // delete every other allocation
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (aix % 2) {
-                assert_int_equal(
-                        mem_del_alloc(pools[pix], allocations[pix][aix]),
-                        ALLOC_OK);
-                allocations[pix][aix] = NULL;
-            }
-        }
-    }
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
 
-    // delete pools
-    for (unsigned pix=0; pix < num_pools; ++pix) {
-        // delete pool's allocations
-        for (unsigned aix=0; aix < num_allocations; ++aix) {
-            if (allocations[pix][aix]) {
-                // delete allocation
-                assert_int_equal(
-                        mem_del_alloc(pools[pix], allocations[pix][aix]),
-                        ALLOC_OK);
-            }
-        }
-        // close pool
-        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
-    }
+    pool_segment_t exp1[2] =
+            {
+                    {100, 1},
+                    {pool->total_size-100, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FAST_FIT, POOL_SIZE, 100, 1, 1);
 
-    // free store
-    assert_int_equal(mem_free(), ALLOC_OK);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FAST_FIT, POOL_SIZE, 0, 0, 1);
 }
 
+static void test_pool_scenario21(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
 
-/*******************************************/
-/***         6. DRIVER ROUTINE           ***/
-/*******************************************/
+    /*
+     * Scenario 21:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10 x 100.
+     * 3. Deallocate 1, 4, 8, 6, 7 (the last one merges 6-8 into 300).
+     * 4. Allocate 100. Gaps of the same size class are reused last in,
+     *    first out, so it goes into the gap at 4.
+     * 5. Allocate 200. Its own class is empty, so it goes into the 300.
+     * 6. Allocate 50. Its own class is empty, so it goes into the head
+     *    of the 100 class, which is the remainder of the 300.
+     * 7. Clean up.
+     */
 
-int run_test_suite() {
-    const struct CMUnitTest tests[] = {
-            // General tests
-            cmocka_unit_test(test_pool_store_smoketest),
-            cmocka_unit_test(test_pool_smoketest),
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
 
-            cmocka_unit_test(test_pool_nonempty),
 
-            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+    const unsigned NUM_ALLOCS = 10;
 
-            // First-fit tests
-            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+    void * *allocs = (void * *) calloc(NUM_ALLOCS, sizeof(void *));
+    assert_non_null(allocs);
 
-            // Best-fit tests
-            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
-            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK); allocs[1]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK); allocs[4]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[8]), ALLOC_OK); allocs[8]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[6]), ALLOC_OK); allocs[6]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[7]), ALLOC_OK); allocs[7]=0;
+
+    pool_segment_t exp1[9] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FAST_FIT, POOL_SIZE, 500, 5, 4);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    pool_segment_t exp2[9] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp2);
+
+
+    void * alloc1 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc1);
+    pool_segment_t exp3[10] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {200, 1},
+                    {100, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp3);
+
+
+    void * alloc2 = mem_new_alloc(pool, 50);
+    assert_non_null(alloc2);
+    pool_segment_t exp4[11] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {200, 1},
+                    {50, 1},
+                    {50, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp4);
+    check_metadata(pool, FAST_FIT, POOL_SIZE, 850, 8, 3);
+
+
+    // clean up
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+    }
+    free(allocs);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+
+
+    check_pool(pool, exp0);
+    check_metadata(pool, FAST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario22(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 22:
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 4 x 100.
+     * 3. Deallocate 0 and 2, leaving two gaps of 100.
+     * 4. Allocate 128. No gap of its class or above but the tail,
+     *    so it goes into the tail.
+     * 5. Allocate 100 twice. Both gaps of 100 are reused.
+     * 6. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+
+
+    void * allocs[4];
+    for (int i=0; i<4; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[0]), ALLOC_OK); allocs[0]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[2]), ALLOC_OK); allocs[2]=0;
+
+
+    void * alloc0 = mem_new_alloc(pool, 128);
+    assert_non_null(alloc0);
+    pool_segment_t exp1[6] =
+            {
+                    {100, 0},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {128, 1},
+                    {pool->total_size - 528, 0},
+            };
+    check_pool(pool, exp1);
+
+
+    void * alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc1);
+    void * alloc2 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc2);
+    pool_segment_t exp2[6] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {128, 1},
+                    {pool->total_size - 528, 0},
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FAST_FIT, POOL_SIZE, 528, 5, 1);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[3]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+
+
+    check_pool(pool, exp0);
+}
+
+/*******************************************/
+/***        6. TLSF_FIT SCENARIOS        ***/
+/*******************************************/
+
+static int pool_tlsf_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = TLSF_FIT;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "TLSF_FIT");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_tlsf_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario23(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 23 (scenario 13 under TLSF_FIT):
+     *
+     * 1. Pool starts out as a single gap.
+     * 2. Allocate 10 x 100.
+     * 3. Deallocate 1, 4, (6, 7, 8)
+     * 4. Allocate 100. Gaps on the same list are reused last in,
+     *    first out, so it goes into the gap at 4, not the one at 1.
+     * 5. Clean up.
+     */
+
+    pool_segment_t exp0[1] =
+            {
+                    {pool->total_size, 0},
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TLSF_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    const unsigned NUM_ALLOCS = 10;
+
+    void * *allocs = (void * *) calloc(NUM_ALLOCS, sizeof(void *));
+    assert_non_null(allocs);
+
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+    }
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK); allocs[1]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK); allocs[4]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[8]), ALLOC_OK); allocs[8]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[6]), ALLOC_OK); allocs[6]=0;
+    assert_int_equal(mem_del_alloc(pool, allocs[7]), ALLOC_OK); allocs[7]=0;
+
+    pool_segment_t exp1[9] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TLSF_FIT, POOL_SIZE, 500, 5, 4);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    pool_segment_t exp2[9] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {300, 0},
+                    {100, 1},
+                    {pool->total_size - 1000, 0},
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, TLSF_FIT, POOL_SIZE, 600, 6, 3);
+
+
+    // clean up
+    for (int i=0; i<NUM_ALLOCS; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+    }
+    free(allocs);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+
+
+    check_pool(pool, exp0);
+    check_metadata(pool, TLSF_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***        7. BUDDY_FIT SCENARIOS       ***/
+/*******************************************/
+
+static int pool_buddy_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = BUDDY_FIT;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "BUDDY_FIT");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_buddy_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario24(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 24:
+     *
+     * 1. Pool starts out as one free block per set bit of its size
+     *    (1000000 = 2^19 + 2^18 + 2^17 + 2^16 + 2^14 + 2^9 + 2^6).
+     * 2. Allocate 100. It takes a 128 block, split from the 512 one.
+     * 3. Allocate 100. It takes the buddy of the first.
+     * 4. Deallocate the first. Its buddy is allocated, no merge.
+     * 5. Deallocate it again, and an address that is not a block.
+     * 6. Deallocate the second. The blocks merge back into the 512.
+     */
+
+    pool_segment_t exp0[7] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {512, 0},
+                    {64, 0},
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BUDDY_FIT, POOL_SIZE, 0, 0, 7);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+
+    pool_segment_t exp1[9] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {128, 1},
+                    {128, 0},
+                    {256, 0},
+                    {64, 0},
+            };
+    check_pool(pool, exp1);
+
+
+    void * alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc1);
+
+    pool_segment_t exp2[9] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {128, 1},
+                    {128, 1},
+                    {256, 0},
+                    {64, 0},
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BUDDY_FIT, POOL_SIZE, 256, 2, 7);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp3[9] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {128, 0},
+                    {128, 1},
+                    {256, 0},
+                    {64, 0},
+            };
+    check_pool(pool, exp3);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_DOUBLE_FREE);
+    status = mem_del_alloc(pool, pool->mem + 8);
+    assert_int_equal(status, ALLOC_INVALID_HANDLE);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, BUDDY_FIT, POOL_SIZE, 0, 0, 7);
+}
+
+static void test_pool_scenario25(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 25:
+     *
+     * 1. Pool starts out as one free block per set bit of its size.
+     * 2. Allocate 5000. It takes an 8192 block, split from the 16384 one.
+     * 3. Allocate 60000. It takes the 65536 block whole.
+     * 4. Allocate 300000. It takes the 524288 block whole.
+     * 5. Deallocate 60000, 300000, 5000. The pool is back to the start.
+     */
+
+    pool_segment_t exp0[7] =
+            {
+                    {524288, 0},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 0},
+                    {16384, 0},
+                    {512, 0},
+                    {64, 0},
+            };
+    check_pool(pool, exp0);
+
+
+    void * alloc0 = mem_new_alloc(pool, 5000);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc(pool, 60000);
+    assert_non_null(alloc1);
+    void * alloc2 = mem_new_alloc(pool, 300000);
+    assert_non_null(alloc2);
+
+    pool_segment_t exp1[8] =
+            {
+                    {524288, 1},
+                    {262144, 0},
+                    {131072, 0},
+                    {65536, 1},
+                    {8192, 1},
+                    {8192, 0},
+                    {512, 0},
+                    {64, 0},
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BUDDY_FIT, POOL_SIZE, 524288 + 65536 + 8192, 3, 5);
+
+
+    assert_null(mem_new_alloc(pool, 300000));
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, BUDDY_FIT, POOL_SIZE, 0, 0, 7);
+}
+
+/*******************************************/
+/***          8. SLAB POOLS              ***/
+/*******************************************/
+
+static void test_slab_smoketest(void **state) {
+    (void) state; /* unused */
+
+    pool_pt pool = NULL;
+    alloc_status status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating slab of 10 objects of 100 bytes\n");
+    pool = mem_slab_open(100, 10);
+    assert_non_null(pool);
+    assert_non_null(pool->mem);
+    assert_int_equal(pool->policy, SLAB_FIT);
+    assert_int_equal(pool->total_size, 10 * 104);
+    assert_int_equal(pool->alloc_size, 0);
+    assert_int_equal(pool->num_allocs, 0);
+    assert_int_equal(pool->num_gaps, 10);
+
+    INFO("Trying to open slabs as pools, or with too many objects...\n");
+    assert_null(mem_pool_open(1000, SLAB_FIT));
+    assert_null(mem_pool_open(1000, ATOMIC_SLAB_FIT));
+    assert_null(mem_pool_open_opts(1000, SLAB_FIT, NULL));
+    if(sizeof(size_t) > sizeof(unsigned))
+    {
+        assert_null(mem_slab_open(1, (size_t) UINT_MAX + 1));
+    }
+    INFO("Failed, as expected\n");
+
+    INFO("Trying to free the pool store with the slab open...\n");
+    status = mem_free();
+    assert_int_equal(status, ALLOC_FAIL);
+    INFO("Failed, as expected\n");
+
+    INFO("Closing slab\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+}
+
+static int slab_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating slab of 8 objects of 24 bytes\n");
+    pool = mem_slab_open(24, 8);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int slab_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing slab\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_slab_scenario00(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Slab scenario 00:
+     *
+     * 1. Slab starts out as 8 free slots.
+     * 2. Allocating more than the object size fails.
+     * 3. Allocate all 8 slots, in address order. The 9th fails.
+     * 4. Trying to close the slab fails.
+     * 5. Deallocate 1 and 4, then 4 again, and an address that is not a slot.
+     * 6. Allocate 24. Slots are reused last in, first out, so it is 4,
+     *    and the next one is 1, not 4 again.
+     * 7. Clean up.
+     */
+
+    check_metadata(pool, SLAB_FIT, 8 * 24, 0, 0, 8);
+
+    assert_null(mem_new_alloc(pool, 25));
+
+    void * allocs[8];
+    for (int i=0; i<8; ++i) {
+        allocs[i] = mem_new_alloc(pool, 24);
+        assert_non_null(allocs[i]);
+        assert_true((char *) allocs[i] == pool->mem + i * 24);
+    }
+    assert_null(mem_new_alloc(pool, 24));
+    check_metadata(pool, SLAB_FIT, 8 * 24, 8 * 24, 8, 0);
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_NOT_FREED);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_DOUBLE_FREE);
+    assert_int_equal(mem_del_alloc(pool, pool->mem + 4), ALLOC_INVALID_HANDLE);
+
+    pool_segment_t exp0[8] =
+            {
+                    {24, 1},
+                    {24, 0},
+                    {24, 1},
+                    {24, 1},
+                    {24, 0},
+                    {24, 1},
+                    {24, 1},
+                    {24, 1},
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, SLAB_FIT, 8 * 24, 6 * 24, 6, 2);
+
+
+    void * alloc0 = mem_new_alloc(pool, 10);
+    assert_true(alloc0 == allocs[4]);
+    allocs[4] = alloc0;
+    void * alloc1 = mem_new_alloc(pool, 10);
+    assert_true(alloc1 == allocs[1]);
+    allocs[1] = alloc1;
+
+
+    // clean up
+    for (int i=0; i<8; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+    }
+    check_metadata(pool, SLAB_FIT, 8 * 24, 0, 0, 8);
+}
+
+static int atomic_slab_setup(void **state) {
+    alloc_status status;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating atomic slab of 8 objects of 24 bytes\n");
+    pool = mem_atomic_slab_open(24, 8);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static void test_atomic_slab_scenario00(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Atomic slab scenario 00:
+     *
+     * 1. Slab starts out as 8 free slots.
+     * 2. Allocate all 8 slots, in address order. The 9th fails.
+     * 3. Deallocate 1 and 4, then 4 again, and an address that is not a slot.
+     * 4. Allocate 24. Slots are reused last in, first out, so it is 4.
+     * 5. Clean up.
+     */
+
+    assert_int_equal(pool->policy, ATOMIC_SLAB_FIT);
+    check_metadata(pool, ATOMIC_SLAB_FIT, 8 * 24, 0, 0, 8);
+
+    assert_null(mem_new_alloc(pool, 25));
+
+    void * allocs[8];
+    for (int i=0; i<8; ++i) {
+        allocs[i] = mem_new_alloc(pool, 24);
+        assert_non_null(allocs[i]);
+        assert_true((char *) allocs[i] == pool->mem + i * 24);
+    }
+    assert_null(mem_new_alloc(pool, 24));
+    check_metadata(pool, ATOMIC_SLAB_FIT, 8 * 24, 8 * 24, 8, 0);
+
+
+    assert_int_equal(mem_del_alloc(pool, allocs[1]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, allocs[4]), ALLOC_DOUBLE_FREE);
+    assert_int_equal(mem_del_alloc(pool, pool->mem + 4), ALLOC_INVALID_HANDLE);
+
+    pool_segment_t exp0[8] =
+            {
+                    {24, 1},
+                    {24, 0},
+                    {24, 1},
+                    {24, 1},
+                    {24, 0},
+                    {24, 1},
+                    {24, 1},
+                    {24, 1},
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, ATOMIC_SLAB_FIT, 8 * 24, 6 * 24, 6, 2);
+
+
+    void * alloc0 = mem_new_alloc(pool, 10);
+    assert_true(alloc0 == allocs[4]);
+    allocs[1] = NULL;
+
+
+    // clean up
+    for (int i=0; i<8; ++i) {
+        if (allocs[i])
+            assert_int_equal(mem_del_alloc(pool, allocs[i]), ALLOC_OK);
+    }
+    check_metadata(pool, ATOMIC_SLAB_FIT, 8 * 24, 0, 0, 8);
+}
+
+/*******************************************/
+/***        9. TAGGED_FIT SCENARIOS      ***/
+/*******************************************/
+
+static int pool_tagged_setup(void **state) {
+    alloc_status status;
+    const alloc_policy POOL_POLICY = TAGGED_FIT;
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "TAGGED_FIT");
+    pool = mem_pool_open(POOL_SIZE, POOL_POLICY);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_tagged_teardown(void **state) {
+    pool_pt pool = *state;
+    alloc_status status;
+
+    INFO("Closing pool\n");
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_free();
+    assert_int_equal(status, ALLOC_OK);
+
+    return 0;
+}
+
+static void test_pool_scenario26(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 26:
+     *
+     * 1. Pool starts out as one free block, the pool size less the
+     *    alignment of the first payload, rounded down to 16.
+     * 2. Allocate 100, 1000, 10000. Blocks are the sizes plus a header
+     *    and a footer, rounded up to 16.
+     * 3. Deallocate 1000, then 100. The two merge through their tags.
+     * 4. Deallocate 100 again, and an address that is not a payload.
+     * 5. Allocate 1100. It splits the merged block, leaving a 32 block.
+     * 6. Deallocate 1100 and 10000. The pool is back to one block.
+     */
+
+    const size_t span = pool->total_size;
+    assert_true(span <= POOL_SIZE && span > POOL_SIZE - 32);
+    assert_int_equal(span % 16, 0);
+
+    pool_segment_t exp0[1] =
+            {
+                    {span, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TAGGED_FIT, span, 0, 0, 1);
+
+
+    void * alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    void * alloc1 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc1);
+    void * alloc2 = mem_new_alloc(pool, 10000);
+    assert_non_null(alloc2);
+    assert_int_equal((uintptr_t) alloc0 % 16, 0);
+    assert_int_equal((uintptr_t) alloc1 % 16, 0);
+    assert_int_equal((uintptr_t) alloc2 % 16, 0);
+
+    pool_segment_t exp1[4] =
+            {
+                    {128, 1},
+                    {1024, 1},
+                    {10016, 1},
+                    {span - 11168, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TAGGED_FIT, span, 11168, 3, 1);
+
+
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[3] =
+            {
+                    {1152, 0},
+                    {10016, 1},
+                    {span - 11168, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, TAGGED_FIT, span, 10016, 1, 2);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_DOUBLE_FREE);
+    status = mem_del_alloc(pool, (char *) alloc2 + 8);
+    assert_int_equal(status, ALLOC_INVALID_HANDLE);
+    status = mem_del_alloc(pool, (char *) alloc2 + 16);
+    assert_int_equal(status, ALLOC_INVALID_HANDLE);
+
+
+    void * alloc3 = mem_new_alloc(pool, 1100);
+    assert_ptr_equal(alloc3, alloc0);
+
+    pool_segment_t exp3[4] =
+            {
+                    {1120, 1},
+                    {32, 0},
+                    {10016, 1},
+                    {span - 11168, 0}
+            };
+    check_pool(pool, exp3);
+
+
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+    check_pool(pool, exp0);
+    check_metadata(pool, TAGGED_FIT, span, 0, 0, 1);
+}
+
+/*******************************************/
+/***        10. THREAD CACHES            ***/
+/*******************************************/
+
+static void test_pool_cache(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pool_cache_stats_t stats;
+
+    /*
+     * Thread caches on a BEST_FIT pool, batches of 4:
+     *
+     * 1. Allocate 100. The cache misses and takes 4 allocations of 112.
+     * 2. Allocate 100. The cache hits.
+     * 3. Deallocate both. They stay in the cache, the pool still has 4.
+     *    Deallocating one again, or a foreign pointer, fails and leaves
+     *    the cache as it is.
+     * 4. Allocate 1000. It is not cached and goes to the pool.
+     * 5. Flush the cache. The pool is back to one gap.
+     * 6. Allocate 9 of 50, deallocate them. The cache flushes a batch.
+     * 7. Closing the pool (teardown) returns the cached allocations.
+     * 8. SLAB_FIT and BUDDY_FIT pools with caches. Freeing an allocation
+     *    the cache holds again is a double free, reallocating it fails,
+     *    and the cache hands it out once.
+     */
+
+    assert_int_equal(mem_pool_cache(pool, 512, 4), ALLOC_FAIL);
+    assert_int_equal(mem_pool_cache(pool, 256, 0), ALLOC_FAIL);
+    assert_int_equal(mem_pool_cache(pool, 256, 4), ALLOC_OK);
+    assert_int_equal(mem_pool_cache(pool, 256, 4), ALLOC_CALLED_AGAIN);
+
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 4 * 112, 4, 1);
+
+    void *alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc1);
+    assert_ptr_not_equal(alloc0, alloc1);
+
+    mem_pool_cache_stats(pool, &stats);
+    assert_int_equal(stats.hits, 1);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.flushes, 0);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 4 * 112, 4, 1);
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_DOUBLE_FREE);
+    status = mem_del_alloc(pool, &stats);
+    assert_int_equal(status, ALLOC_INVALID_HANDLE);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 4 * 112, 4, 1);
+
+
+    void *alloc2 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 4 * 112 + 1000, 5, 1);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    status = mem_pool_cache_flush(pool);
+    assert_int_equal(status, ALLOC_OK);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    void *allocs[9];
+    for (unsigned i = 0; i < 9; ++i) {
+        allocs[i] = mem_new_alloc(pool, 50);
+        assert_non_null(allocs[i]);
+    }
+    for (unsigned i = 0; i < 9; ++i) {
+        status = mem_del_alloc(pool, allocs[i]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+    mem_pool_cache_stats(pool, &stats);
+    assert_int_equal(stats.hits + stats.misses, 2 + 9);
+    assert_int_equal(stats.flushes, 2);
+    assert_true(pool->num_allocs > 0);
+
+
+    pool_pt cached[2] = { mem_slab_open(48, 64), mem_pool_open(POOL_SIZE, BUDDY_FIT) };
+    for (unsigned i = 0; i < 2; ++i) {
+        assert_non_null(cached[i]);
+        assert_int_equal(mem_pool_cache(cached[i], 64, 4), ALLOC_OK);
+        void *a = mem_new_alloc(cached[i], 48);
+        void *b = mem_new_alloc(cached[i], 48);
+        assert_non_null(a);
+        assert_non_null(b);
+        assert_int_equal(mem_del_alloc(cached[i], a), ALLOC_OK);
+        assert_int_equal(mem_del_alloc(cached[i], a), ALLOC_DOUBLE_FREE);
+        assert_null(mem_realloc_alloc(cached[i], a, 40));
+
+        void *c = mem_new_alloc(cached[i], 48);
+        void *d = mem_new_alloc(cached[i], 48);
+        assert_non_null(c);
+        assert_non_null(d);
+        assert_ptr_not_equal(c, d);
+        assert_ptr_not_equal(b, c);
+        assert_ptr_not_equal(b, d);
+
+        assert_int_equal(mem_del_alloc(cached[i], b), ALLOC_OK);
+        assert_int_equal(mem_del_alloc(cached[i], c), ALLOC_OK);
+        assert_int_equal(mem_del_alloc(cached[i], d), ALLOC_OK);
+        assert_int_equal(mem_pool_close(cached[i]), ALLOC_OK);
+    }
+}
+
+/*
+ * Workers of test_pool_stresstest2, as for test_pool_stresstest1.
+ */
+#define STRESS2_NUM_THREADS     8
+#define STRESS2_NUM_ROUNDS      500
+#define STRESS2_NUM_ALLOCS      32
+
+typedef struct _stress2_arg {
+    pool_pt pool;
+    unsigned id;
+    unsigned failures;
+} stress2_arg_t;
+
+static void *stress2_worker(void *arg) {
+    stress2_arg_t *sa = arg;
+    void *allocs[STRESS2_NUM_ALLOCS];
+
+    for (unsigned round = 0; round < STRESS2_NUM_ROUNDS; ++round) {
+        for (unsigned aix = 0; aix < STRESS2_NUM_ALLOCS; ++aix) {
+            allocs[aix] = mem_new_alloc(sa->pool, 8 + (aix * 13 + round) % 240);
+            if (!allocs[aix])
+                sa->failures++;
+            else
+                memset(allocs[aix], (int) sa->id, 8);
+        }
+        for (unsigned aix = 0; aix < STRESS2_NUM_ALLOCS; ++aix) {
+            unsigned char expected[8];
+            memset(expected, (int) sa->id, 8);
+            if (!allocs[aix])
+                continue;
+            if (memcmp(allocs[aix], expected, 8) != 0)
+                sa->failures++;
+            if (mem_del_alloc(sa->pool, allocs[aix]) != ALLOC_OK)
+                sa->failures++;
+        }
+    }
+
+    return NULL;
+}
+
+void test_pool_stresstest2(void **state) {
+    (void) state; /* unused */
+
+    pthread_t threads[STRESS2_NUM_THREADS];
+    stress2_arg_t args[STRESS2_NUM_THREADS];
+    pool_cache_stats_t stats;
+
+    /*
+     * Testing thread caches under concurrent use:
+     *
+     * 1. 8 threads allocating and deallocating in one TAGGED_FIT pool
+     *    with thread caches on
+     * 2. Exiting threads return their caches, the pool is back to one gap
+     * 3. Most allocations are served by the caches
+     */
+
+    // initialize store
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    pool_pt pool = mem_pool_open(1000000, TAGGED_FIT);
+    assert_non_null(pool);
+    assert_int_equal(mem_pool_cache(pool, 256, 16), ALLOC_OK);
+
+    for (unsigned tix = 0; tix < STRESS2_NUM_THREADS; ++tix) {
+        args[tix].pool = pool;
+        args[tix].id = tix + 1;
+        args[tix].failures = 0;
+        assert_int_equal(pthread_create(&threads[tix], NULL, stress2_worker, &args[tix]), 0);
+    }
+    for (unsigned tix = 0; tix < STRESS2_NUM_THREADS; ++tix) {
+        assert_int_equal(pthread_join(threads[tix], NULL), 0);
+        assert_int_equal(args[tix].failures, 0);
+    }
+
+    // the caches went back with their threads
+    assert_int_equal(pool->num_allocs, 0);
+    assert_int_equal(pool->num_gaps, 1);
+
+    mem_pool_cache_stats(pool, &stats);
+    assert_int_equal(stats.hits + stats.misses,
+                     STRESS2_NUM_THREADS * STRESS2_NUM_ROUNDS * STRESS2_NUM_ALLOCS);
+    assert_true(stats.hits > 10 * stats.misses);
+
+    // close pool and free store
+    assert_int_equal(mem_pool_close(pool), ALLOC_OK);
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*******************************************/
+/***        11. BATCH ALLOCATION         ***/
+/*******************************************/
+
+static void test_pool_scenario27(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 27:
+     *
+     * 1. Allocate 1000, then a batch of 5 of 100. The batch is carved
+     *    out of the gap after the 1000, in order.
+     * 2. Deallocate 1000, then batch-deallocate the 2nd and 3rd of 100.
+     *    They merge into one gap.
+     * 3. Batch-deallocate the rest, with the 1st given twice. The second
+     *    time is a double free, the others are freed, the pool is one gap.
+     * 4. A batch larger than the pool fails and allocates nothing.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc0);
+
+    void *allocs[5];
+    status = mem_new_alloc_n(pool, 100, 5, allocs);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp0[7] =
+            {
+                    {1000, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {POOL_SIZE - 1500, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 1500, 6, 1);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc_n(pool, 2, allocs + 1);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[6] =
+            {
+                    {1000, 0},
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {100, 1},
+                    {POOL_SIZE - 1500, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 300, 3, 3);
+
+
+    void *rest[4] = { allocs[0], allocs[3], allocs[4], allocs[0] };
+    status = mem_del_alloc_n(pool, 4, rest);
+    assert_int_equal(status, ALLOC_DOUBLE_FREE);
+
+    pool_segment_t exp2[1] =
+            {
+                    {POOL_SIZE, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    void *many[20];
+    status = mem_new_alloc_n(pool, POOL_SIZE / 10, 20, many);
+    assert_int_equal(status, ALLOC_FAIL);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario28(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 28:
+     *
+     * 1. Allocate 400, 100, 400 and the rest, then deallocate both 400.
+     * 2. Allocate a batch of 4 of 200. No gap holds all of them, so they
+     *    are allocated one by one, two in each gap.
+     * 3. Batch-deallocate them. The pool is back to two gaps of 400.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 400);
+    void *alloc1 = mem_new_alloc(pool, 100);
+    void *alloc2 = mem_new_alloc(pool, 400);
+    void *alloc3 = mem_new_alloc(pool, POOL_SIZE - 900);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_non_null(alloc2);
+    assert_non_null(alloc3);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+
+
+    void *allocs[4];
+    status = mem_new_alloc_n(pool, 200, 4, allocs);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp0[6] =
+            {
+                    {200, 1},
+                    {200, 1},
+                    {100, 1},
+                    {200, 1},
+                    {200, 1},
+                    {POOL_SIZE - 900, 1}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, POOL_SIZE, 6, 0);
+
+
+    status = mem_del_alloc_n(pool, 4, allocs);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp1[4] =
+            {
+                    {400, 0},
+                    {100, 1},
+                    {400, 0},
+                    {POOL_SIZE - 900, 1}
+            };
+    check_pool(pool, exp1);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc3), ALLOC_OK);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***        12. REALLOCATION             ***/
+/*******************************************/
+
+// the memory of a node allocation, read through its handle
+static char *node_mem(pool_pt pool, void *alloc) {
+    (void) pool;
+    return *(char **) alloc;
+}
+
+static void test_pool_scenario29(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 29:
+     *
+     * 1. Allocate 1000, 1000, and fill the second.
+     * 2. Reallocate the second to 3000, then to 500. It stays in place,
+     *    growing into and shrinking back to the gap after it.
+     * 3. Deallocate the first, reallocate the second to all but 200.
+     *    It slides down into the gap before it, its contents with it.
+     * 4. Reallocating past the pool size fails and changes nothing.
+     * 5. Reallocate to the pool size, then shrink to 100. A gap is split
+     *    off although there was none next to it.
+     * 6. Allocate 1, 10, 100 aligned to 256 and 1000, deallocate the 10.
+     *    Growing the aligned one cannot slide down to the odd address of
+     *    the gap before it, it moves to an aligned address instead.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 1000);
+    void *alloc1 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    memset(node_mem(pool, alloc1), 0x5a, 1000);
+
+
+    void *alloc = mem_realloc_alloc(pool, alloc1, 3000);
+    assert_ptr_equal(alloc, alloc1);
+
+    pool_segment_t exp0[3] =
+            {
+                    {1000, 1},
+                    {3000, 1},
+                    {POOL_SIZE - 4000, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 4000, 2, 1);
+
+    alloc = mem_realloc_alloc(pool, alloc1, 500);
+    assert_ptr_equal(alloc, alloc1);
+
+    pool_segment_t exp1[3] =
+            {
+                    {1000, 1},
+                    {500, 1},
+                    {POOL_SIZE - 1500, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 1500, 2, 1);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    alloc = mem_realloc_alloc(pool, alloc1, POOL_SIZE - 200);
+    assert_non_null(alloc);
+    assert_ptr_equal(node_mem(pool, alloc), pool->mem);
+    for(unsigned i = 0; i < 500; i++){
+        assert_int_equal((unsigned char) node_mem(pool, alloc)[i], 0x5a);
+    }
+
+    pool_segment_t exp2[2] =
+            {
+                    {POOL_SIZE - 200, 1},
+                    {200, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, POOL_SIZE - 200, 1, 1);
+
+
+    assert_null(mem_realloc_alloc(pool, alloc, POOL_SIZE + 1));
+    check_pool(pool, exp2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, POOL_SIZE - 200, 1, 1);
+
+
+    alloc = mem_realloc_alloc(pool, alloc, POOL_SIZE);
+    assert_non_null(alloc);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, POOL_SIZE, 1, 0);
+    alloc = mem_realloc_alloc(pool, alloc, 100);
+    assert_non_null(alloc);
+
+    pool_segment_t exp3[2] =
+            {
+                    {100, 1},
+                    {POOL_SIZE - 100, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 100, 1, 1);
+    assert_int_equal(mem_del_alloc(pool, alloc), ALLOC_OK);
+
+
+    void *alloc2 = mem_new_alloc(pool, 1);
+    alloc0 = mem_new_alloc(pool, 10);
+    alloc1 = mem_new_alloc_aligned(pool, 100, 256);
+    void *alloc3 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc2);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_non_null(alloc3);
+    memset(node_mem(pool, alloc1), 0x3c, 100);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+
+    alloc = mem_realloc_alloc(pool, alloc1, 105);
+    assert_non_null(alloc);
+    assert_int_equal((uintptr_t) node_mem(pool, alloc) % 256, 0);
+    assert_true(node_mem(pool, alloc) > node_mem(pool, alloc3));
+    for(unsigned i = 0; i < 100; i++){
+        assert_int_equal((unsigned char) node_mem(pool, alloc)[i], 0x3c);
+    }
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc3), ALLOC_OK);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario30(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 30:
+     *
+     * 1. Allocate 100, 100, 100, and fill the second.
+     * 2. Reallocate the second to 200. Its neighbours are allocations, so
+     *    it moves to the first gap that fits, its contents with it.
+     * 3. Reallocate it to 300. The gap after it holds the growth.
+     * 4. Reallocating a gap fails.
+     * 5. Reallocating the third to 0 frees it, like realloc.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    void *alloc1 = mem_new_alloc(pool, 100);
+    void *alloc2 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_non_null(alloc2);
+    memset(node_mem(pool, alloc1), 0xa5, 100);
+
+
+    void *alloc = mem_realloc_alloc(pool, alloc1, 200);
+    assert_non_null(alloc);
+    assert_ptr_equal(node_mem(pool, alloc), pool->mem + 300);
+    for(unsigned i = 0; i < 100; i++){
+        assert_int_equal((unsigned char) node_mem(pool, alloc)[i], 0xa5);
+    }
+
+    pool_segment_t exp0[5] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {200, 1},
+                    {POOL_SIZE - 500, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 400, 3, 2);
+
+
+    assert_ptr_equal(mem_realloc_alloc(pool, alloc, 300), alloc);
+
+    pool_segment_t exp1[5] =
+            {
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {300, 1},
+                    {POOL_SIZE - 600, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 500, 3, 2);
+
+    assert_null(mem_realloc_alloc(pool, alloc1, 50));
+    check_pool(pool, exp1);
+
+
+    assert_null(mem_realloc_alloc(pool, alloc2, 0));
+
+    pool_segment_t exp2[4] =
+            {
+                    {100, 1},
+                    {200, 0},
+                    {300, 1},
+                    {POOL_SIZE - 600, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 400, 2, 2);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_DOUBLE_FREE);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc), ALLOC_OK);
+    check_metadata(pool, FIRST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario31(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 31:
+     *
+     * 1. Allocate 10 from a TAGGED_FIT pool, in a block of 32.
+     * 2. Reallocate it to 16. The block holds it, it stays in place.
+     * 3. Reallocate it to 100. It moves, its contents with it, and its
+     *    old block is freed.
+     */
+
+    const size_t span = pool->total_size;
+
+    char *alloc0 = mem_new_alloc(pool, 10);
+    assert_non_null(alloc0);
+    memcpy(alloc0, "reallocate", 10);
+
+    assert_ptr_equal(mem_realloc_alloc(pool, alloc0, 16), alloc0);
+    check_metadata(pool, TAGGED_FIT, span, 32, 1, 1);
+
+    char *alloc = mem_realloc_alloc(pool, alloc0, 100);
+    assert_non_null(alloc);
+    assert_ptr_not_equal(alloc, alloc0);
+    assert_memory_equal(alloc, "reallocate", 10);
+
+    pool_segment_t exp0[3] =
+            {
+                    {32, 0},
+                    {128, 1},
+                    {span - 160, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TAGGED_FIT, span, 128, 1, 2);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc), ALLOC_OK);
+    check_metadata(pool, TAGGED_FIT, span, 0, 0, 1);
+}
+
+/*******************************************/
+/***        13. ALIGNED ALLOCATION       ***/
+/*******************************************/
+
+static int pool_aligned_setup(void **state) {
+    alloc_status status;
+    const pool_options_t options = { .alignment = 4096 };
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating pool of %lu bytes with policy %s at alignment %lu\n",
+         (long) POOL_SIZE, "BEST_FIT", (long) options.alignment);
+    pool = mem_pool_open_opts(POOL_SIZE, BEST_FIT, &options);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static void test_pool_scenario32(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 32:
+     *
+     * 1. The pool memory starts at the base alignment it was opened with.
+     *    A base alignment that is not a power of two is refused.
+     * 2. Allocate 100, then 256 at 64 and 10 at 4096. The padding in front
+     *    of the aligned allocations is left as gaps.
+     * 3. Allocate 20. The best fit is the padding gap of 28.
+     * 4. An alignment that is not a power of two fails.
+     * 5. Deallocate all. The pool is back to one gap.
+     */
+
+    const pool_options_t bad = { .alignment = 48 };
+    assert_int_equal((uintptr_t) pool->mem % 4096, 0);
+    assert_null(mem_pool_open_opts(POOL_SIZE, BEST_FIT, &bad));
+
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    void *alloc1 = mem_new_alloc_aligned(pool, 256, 64);
+    void *alloc2 = mem_new_alloc_aligned(pool, 10, 4096);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_non_null(alloc2);
+    assert_ptr_equal(node_mem(pool, alloc1), pool->mem + 128);
+    assert_ptr_equal(node_mem(pool, alloc2), pool->mem + 4096);
+
+    pool_segment_t exp0[6] =
+            {
+                    {100, 1},
+                    {28, 0},
+                    {256, 1},
+                    {3712, 0},
+                    {10, 1},
+                    {POOL_SIZE - 4106, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 366, 3, 3);
+
+
+    void *alloc3 = mem_new_alloc(pool, 20);
+    assert_non_null(alloc3);
+    assert_ptr_equal(node_mem(pool, alloc3), pool->mem + 100);
+
+    pool_segment_t exp1[7] =
+            {
+                    {100, 1},
+                    {20, 1},
+                    {8, 0},
+                    {256, 1},
+                    {3712, 0},
+                    {10, 1},
+                    {POOL_SIZE - 4106, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 386, 4, 3);
+
+
+    assert_null(mem_new_alloc_aligned(pool, 10, 48));
+    assert_null(mem_new_alloc_aligned(pool, 10, 0));
+    check_pool(pool, exp1);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc3), ALLOC_OK);
+
+    pool_segment_t exp2[1] =
+            {
+                    {POOL_SIZE, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+}
+
+static void test_pool_scenario33(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 33:
+     *
+     * 1. Allocate 100 at 16 and 100 at 256 from a TAGGED_FIT pool. The
+     *    block in front of the second is freed back and merges with the
+     *    free space in front of it, if any, or is left as a gap.
+     * 2. Deallocate both. The pool is back to one free block.
+     */
+
+    const size_t span = pool->total_size;
+
+    char *alloc0 = mem_new_alloc_aligned(pool, 100, 16);
+    char *alloc1 = mem_new_alloc_aligned(pool, 100, 256);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_int_equal((uintptr_t) alloc0 % 16, 0);
+    assert_int_equal((uintptr_t) alloc1 % 256, 0);
+    assert_true(alloc1 >= alloc0 + 128 + 32);
+    check_metadata(pool, TAGGED_FIT, span, 256, 2, 2);
+
+
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+
+    pool_segment_t exp0[1] =
+            {
+                    {span, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TAGGED_FIT, span, 0, 0, 1);
+}
+
+/*******************************************/
+/***        14. MAPPED POOLS             ***/
+/*******************************************/
+
+static int pool_mapped_setup(void **state) {
+    alloc_status status;
+    const pool_options_t options = { .use_mmap = 1 };
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Mapping pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "BEST_FIT");
+    pool = mem_pool_open_opts(POOL_SIZE, BEST_FIT, &options);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static void test_pool_scenario34(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 34:
+     *
+     * 1. The pool memory is mapped, page-aligned, and reads as zeros.
+     * 2. Allocate 300000, fill it, then allocate 100 after it.
+     * 3. Deallocate 300000. The gap is big enough, its whole pages are
+     *    given back and read as zeros again. The page it shares with
+     *    the 100 is kept.
+     * 4. Allocate 1000 from the gap, fill it, deallocate it. The page is
+     *    given back, the merged gap being big enough.
+     * 5. Do 2 and 3 for TAGGED_FIT and BUDDY_FIT mapped pools. Their free
+     *    lists survive the pages being given back, the pools end up with
+     *    the gaps they started with.
+     */
+
+    assert_int_equal((uintptr_t) pool->mem % 4096, 0);
+    assert_int_equal(pool->mem[0], 0);
+    assert_int_equal(pool->mem[POOL_SIZE - 1], 0);
+
+
+    void *alloc0 = mem_new_alloc(pool, 300000);
+    void *alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    memset(node_mem(pool, alloc0), 0xff, 300000);
+
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(pool->mem[0], 0);
+    assert_int_equal(pool->mem[150000], 0);
+    assert_int_equal(pool->mem[296 * 1024 - 1], 0);
+    assert_int_equal((unsigned char) pool->mem[299999], 0xff);
+
+
+    void *alloc2 = mem_new_alloc(pool, 1000);
+    assert_non_null(alloc2);
+    assert_ptr_equal(node_mem(pool, alloc2), pool->mem);
+    memset(node_mem(pool, alloc2), 0xee, 1000);
+    assert_int_equal(mem_del_alloc(pool, alloc2), ALLOC_OK);
+    assert_int_equal(pool->mem[0], 0);
+    assert_int_equal(pool->mem[999], 0);
+
+    pool_segment_t exp0[3] =
+            {
+                    {300000, 0},
+                    {100, 1},
+                    {POOL_SIZE - 300100, 0}
+            };
+    check_pool(pool, exp0);
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+
+
+    const pool_options_t options = { .use_mmap = 1 };
+    const alloc_policy policies[2] = { TAGGED_FIT, BUDDY_FIT };
+    for(unsigned i = 0; i < 2; i++){
+        pool_pt mapped = mem_pool_open_opts(POOL_SIZE, policies[i], &options);
+        assert_non_null(mapped);
+        const unsigned num_gaps = mapped->num_gaps;
+
+        char *big = mem_new_alloc(mapped, 300000);
+        char *small = mem_new_alloc(mapped, 100);
+        assert_non_null(big);
+        assert_non_null(small);
+        memset(big, 0xff, 300000);
+
+        assert_int_equal(mem_del_alloc(mapped, big), ALLOC_OK);
+        assert_int_equal(big[150000], 0);
+
+        assert_int_equal(mem_del_alloc(mapped, small), ALLOC_OK);
+        assert_int_equal(mapped->num_allocs, 0);
+        assert_int_equal(mapped->alloc_size, 0);
+        assert_int_equal(mapped->num_gaps, num_gaps);
+        assert_int_equal(mem_pool_close(mapped), ALLOC_OK);
+    }
+}
+
+static int pool_huge_setup(void **state) {
+    alloc_status status;
+    const pool_options_t options = { .huge_pages = 1 };
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Mapping pool of %lu bytes with policy %s on huge pages\n",
+         (long) (3 * POOL_SIZE), "BEST_FIT");
+    pool = mem_pool_open_opts(3 * POOL_SIZE, BEST_FIT, &options);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static void test_pool_scenario35(void **state) {
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 35:
+     *
+     * 1. The pool memory of a huge page pool is 2 MB-aligned, whether the
+     *    huge pages were had or not, and the pool size is as asked.
+     * 2. Allocate 2500000 and 100, deallocate 2500000. The first huge
+     *    page is given back whole and reads as zeros again.
+     */
+
+    assert_int_equal((uintptr_t) pool->mem % (2 * 1024 * 1024), 0);
+    check_metadata(pool, BEST_FIT, 3 * POOL_SIZE, 0, 0, 1);
+
+
+    void *alloc0 = mem_new_alloc(pool, 2500000);
+    void *alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    memset(node_mem(pool, alloc0), 0xff, 2500000);
+
+    assert_int_equal(mem_del_alloc(pool, alloc0), ALLOC_OK);
+    assert_int_equal(pool->mem[0], 0);
+    assert_int_equal(pool->mem[2 * 1024 * 1024 - 1], 0);
+    assert_int_equal((unsigned char) pool->mem[2499999], 0xff);
+
+
+    // clean up
+    assert_int_equal(mem_del_alloc(pool, alloc1), ALLOC_OK);
+    check_metadata(pool, BEST_FIT, 3 * POOL_SIZE, 0, 0, 1);
+}
+
+/*******************************************/
+/***        15. GROWABLE POOLS           ***/
+/*******************************************/
+
+static int pool_growable_setup(void **state) {
+    alloc_status status;
+    const pool_options_t options = { .arena_size = POOL_SIZE / 2 };
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    INFO("Allocating growable pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "BEST_FIT");
+    pool = mem_pool_open_opts(POOL_SIZE, BEST_FIT, &options);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static void test_pool_scenario36(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 36:
+     *
+     * 1. Fill the pool, then allocate 100. The pool grows by an arena of
+     *    the arena size.
+     * 2. Allocate 600000. No gap holds it, the pool grows by an arena
+     *    of 600000.
+     * 3. Deallocate 600000. Its arena is all free and is given back,
+     *    without merging with the gap of the arena before it.
+     * 4. Deallocate the first allocation and 100. The second arena is
+     *    given back, the gap of the first stays.
+     * 5. Allocate a batch of 5 of 300000. The pool grows by an arena
+     *    holding the batch, which is given back when the batch is freed.
+     * 6. Only the node policies grow.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, POOL_SIZE);
+    void *alloc1 = mem_new_alloc(pool, 100);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+
+    pool_segment_t exp0[3] =
+            {
+                    {POOL_SIZE, 1},
+                    {100, 1},
+                    {POOL_SIZE / 2 - 100, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE * 3 / 2, POOL_SIZE + 100, 2, 1);
+
+
+    void *alloc2 = mem_new_alloc(pool, 600000);
+    assert_non_null(alloc2);
+
+    pool_segment_t exp1[4] =
+            {
+                    {POOL_SIZE, 1},
+                    {100, 1},
+                    {POOL_SIZE / 2 - 100, 0},
+                    {600000, 1}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BEST_FIT, POOL_SIZE * 3 / 2 + 600000, POOL_SIZE + 600100, 3, 1);
+
+
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE * 3 / 2, POOL_SIZE + 100, 2, 1);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[1] =
+            {
+                    {POOL_SIZE, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    void *allocs[5];
+    status = mem_new_alloc_n(pool, 300000, 5, allocs);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp3[6] =
+            {
+                    {POOL_SIZE, 0},
+                    {300000, 1},
+                    {300000, 1},
+                    {300000, 1},
+                    {300000, 1},
+                    {300000, 1}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, BEST_FIT, POOL_SIZE + 1500000, 1500000, 5, 1);
+
+    status = mem_del_alloc_n(pool, 5, allocs);
+    assert_int_equal(status, ALLOC_OK);
+    check_pool(pool, exp2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 0, 0, 1);
+
+
+    const pool_options_t options = { .arena_size = POOL_SIZE };
+    assert_null(mem_pool_open_opts(POOL_SIZE, TAGGED_FIT, &options));
+    assert_null(mem_pool_open_opts(POOL_SIZE, BUDDY_FIT, &options));
+}
+
+/*******************************************/
+/***        16. PERSISTENT POOLS         ***/
+/*******************************************/
+
+static char persistent_path[64];
+
+static int pool_persistent_setup(void **state) {
+    alloc_status status;
+    pool_options_t options = { .path = persistent_path };
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    snprintf(persistent_path, sizeof(persistent_path), "/tmp/mem_pool_test_%ld.pool", (long) getpid());
+
+    INFO("Allocating persistent pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "TAGGED_FIT");
+    pool = mem_pool_open_opts(POOL_SIZE, TAGGED_FIT, &options);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_persistent_teardown(void **state) {
+    int status = pool_tagged_teardown(state);
+
+    unlink(persistent_path);
+
+    return status;
+}
+
+static void test_pool_scenario37(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 37:
+     *
+     * 1. Allocate 100 and 1000, and 10000 that is freed again. The 1000
+     *    is the root, it holds the offset of the 100 in pool->mem.
+     * 2. Close the pool with its allocations and reopen it. The blocks,
+     *    the metadata and the root are as they were. While it is open,
+     *    it does not reopen again, and no new pool replaces its file.
+     * 3. Close it again. A child process reopens it, allocates 500, links
+     *    it from the root and exits without closing. Reopening rebuilds
+     *    the pool from its tags, with the 500.
+     * 4. Freeing the root clears it, bad roots are refused.
+     * 5. Deallocate the rest. Only TAGGED_FIT pools persist, and only
+     *    existing files reopen.
+     */
+
+    const size_t span = pool->total_size;
+
+    char *alloc0 = mem_new_alloc(pool, 100);
+    size_t *root = mem_new_alloc(pool, 1000);
+    void *alloc2 = mem_new_alloc(pool, 10000);
+    assert_non_null(alloc0);
+    assert_non_null(root);
+    assert_non_null(alloc2);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+    strcpy(alloc0, "persistent");
+    root[0] = (size_t) (alloc0 - pool->mem);
+    root[1] = 0;
+    assert_null(mem_pool_root(pool));
+    status = mem_pool_set_root(pool, root);
+    assert_int_equal(status, ALLOC_OK);
+    assert_ptr_equal(mem_pool_root(pool), root);
+
+    pool_segment_t exp0[3] =
+            {
+                    {128, 1},
+                    {1024, 1},
+                    {span - 1152, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TAGGED_FIT, span, 1152, 2, 1);
+
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+    pool = mem_pool_reopen(persistent_path);
+    assert_non_null(pool);
+    *state = pool;
+
+    const pool_options_t options = { .path = persistent_path };
+    assert_null(mem_pool_reopen(persistent_path));
+    assert_null(mem_pool_open_opts(POOL_SIZE, TAGGED_FIT, &options));
+
+    check_pool(pool, exp0);
+    check_metadata(pool, TAGGED_FIT, span, 1152, 2, 1);
+    root = mem_pool_root(pool);
+    assert_non_null(root);
+    assert_string_equal(pool->mem + root[0], "persistent");
+
+
+    status = mem_pool_close(pool);
+    assert_int_equal(status, ALLOC_OK);
+
+    pid_t pid = fork();
+    assert_true(pid >= 0);
+    if(pid == 0){
+        pool_pt child = mem_pool_reopen(persistent_path);
+        char *alloc3 = (child != NULL) ? mem_new_alloc(child, 500) : NULL;
+        size_t *child_root = (child != NULL) ? mem_pool_root(child) : NULL;
+        if(alloc3 == NULL || child_root == NULL){
+            _exit(1);
+        }
+        strcpy(alloc3, "recovered");
+        child_root[1] = (size_t) (alloc3 - child->mem);
+        _exit(0);
+    }
+    int wstatus;
+    assert_int_equal(waitpid(pid, &wstatus, 0), pid);
+    assert_true(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+    pool = mem_pool_reopen(persistent_path);
+    assert_non_null(pool);
+    *state = pool;
+
+    pool_segment_t exp1[4] =
+            {
+                    {128, 1},
+                    {1024, 1},
+                    {528, 1},
+                    {span - 1680, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, TAGGED_FIT, span, 1680, 3, 1);
+    root = mem_pool_root(pool);
+    assert_non_null(root);
+    assert_string_equal(pool->mem + root[0], "persistent");
+    assert_string_equal(pool->mem + root[1], "recovered");
+
+
+    alloc0 = pool->mem + root[0];
+    char *alloc3 = pool->mem + root[1];
+    status = mem_pool_set_root(pool, alloc0 + 16);
+    assert_int_equal(status, ALLOC_INVALID_HANDLE);
+    status = mem_del_alloc(pool, root);
+    assert_int_equal(status, ALLOC_OK);
+    assert_null(mem_pool_root(pool));
+    status = mem_pool_set_root(pool, root);
+    assert_int_equal(status, ALLOC_INVALID_HANDLE);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp2[1] =
+            {
+                    {span, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, TAGGED_FIT, span, 0, 0, 1);
+
+    assert_null(mem_pool_open_opts(POOL_SIZE, BEST_FIT, &options));
+    assert_null(mem_pool_reopen("/nonexistent/mem_pool_test.pool"));
+}
+
+/*******************************************/
+/***        17. SHARED POOLS             ***/
+/*******************************************/
+
+#define SHARED_NUM_PROCS        4
+#define SHARED_NUM_ROUNDS       200
+#define SHARED_NUM_KEPT         10
+
+static char shared_name[64];
+
+static int pool_shared_setup(void **state) {
+    alloc_status status;
+    pool_options_t options = { .shm_name = shared_name };
+    pool_pt pool = NULL;
+
+    status = mem_init();
+    assert_int_equal(status, ALLOC_OK);
+
+    snprintf(shared_name, sizeof(shared_name), "/mem_pool_test_%ld", (long) getpid());
+
+    INFO("Allocating shared pool of %lu bytes with policy %s\n",
+         (long) POOL_SIZE, "TAGGED_FIT");
+    pool = mem_pool_open_opts(POOL_SIZE, TAGGED_FIT, &options);
+    assert_non_null(pool);
+
+    *state = pool;
+
+    return 0;
+}
+
+static int pool_shared_teardown(void **state) {
+    int status = pool_tagged_teardown(state);
+
+    shm_unlink(shared_name);
+
+    return status;
+}
+
+// a child process: churn in the shared pool, then keep some allocations
+// and record their offsets in the root
+static int shared_child(unsigned id) {
+    pool_pt pool = mem_pool_attach(shared_name);
+    if(pool == NULL){
+        return 1;
+    }
+    size_t *root = mem_pool_root(pool);
+    if(root == NULL){
+        return 1;
+    }
+
+    for(unsigned r = 0; r < SHARED_NUM_ROUNDS; r++){
+        char *alloc = mem_new_alloc(pool, 16 + (r * 37 + id * 101) % 1000);
+        if(alloc == NULL){
+            return 1;
+        }
+        alloc[0] = (char) r;
+        if(mem_del_alloc(pool, alloc) != ALLOC_OK){
+            return 1;
+        }
+    }
+    for(unsigned k = 0; k < SHARED_NUM_KEPT; k++){
+        unsigned *alloc = mem_new_alloc(pool, 64);
+        if(alloc == NULL){
+            return 1;
+        }
+        *alloc = id;
+        root[id * SHARED_NUM_KEPT + k] = (size_t) ((char *) alloc - pool->mem);
+    }
+
+    return (mem_pool_close(pool) == ALLOC_OK) ? 0 : 1;
+}
+
+static void test_pool_scenario38(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+
+    /*
+     * Scenario 38:
+     *
+     * 1. Allocate the root, room for the offsets of the children's
+     *    allocations.
+     * 2. Child processes attach to the pool at once, allocate and free
+     *    in it, and each keeps 10 allocations of 64, recorded in the root.
+     * 3. The pool counts all of them, and each holds its child's id. (A
+     *    block may keep a remainder too small to split, so alloc_size is
+     *    at least 80 per allocation.)
+     * 4. Deallocate them all by their offsets. The pool is one block again.
+     */
+
+    const size_t span = pool->total_size;
+
+    size_t *root = mem_new_alloc(pool, SHARED_NUM_PROCS * SHARED_NUM_KEPT * sizeof(size_t));
+    assert_non_null(root);
+    status = mem_pool_set_root(pool, root);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    pid_t pids[SHARED_NUM_PROCS];
+    for(unsigned i = 0; i < SHARED_NUM_PROCS; i++){
+        pids[i] = fork();
+        assert_true(pids[i] >= 0);
+        if(pids[i] == 0){
+            _exit(shared_child(i));
+        }
+    }
+    for(unsigned i = 0; i < SHARED_NUM_PROCS; i++){
+        int wstatus;
+        assert_int_equal(waitpid(pids[i], &wstatus, 0), pids[i]);
+        assert_true(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+    }
+
+
+    const size_t root_block = (SHARED_NUM_PROCS * SHARED_NUM_KEPT * sizeof(size_t) + 16 + 15) & ~(size_t) 15;
+    pool_segment_pt segs = NULL;
+    unsigned num_segs = 0;
+    mem_inspect_pool(pool, &segs, &num_segs);
+    assert_non_null(segs);
+    free(segs);
+    assert_int_equal(pool->num_allocs, 1 + SHARED_NUM_PROCS * SHARED_NUM_KEPT);
+    assert_true(pool->alloc_size >= root_block + SHARED_NUM_PROCS * SHARED_NUM_KEPT * 80);
+
+    for(unsigned i = 0; i < SHARED_NUM_PROCS * SHARED_NUM_KEPT; i++){
+        unsigned *alloc = (unsigned *) (pool->mem + root[i]);
+        assert_int_equal(*alloc, i / SHARED_NUM_KEPT);
+        status = mem_del_alloc(pool, alloc);
+        assert_int_equal(status, ALLOC_OK);
+    }
+    status = mem_del_alloc(pool, root);
+    assert_int_equal(status, ALLOC_OK);
+
+    pool_segment_t exp0[1] =
+            {
+                    {span, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, TAGGED_FIT, span, 0, 0, 1);
+
+    assert_null(mem_pool_attach("/mem_pool_test_nonexistent"));
+}
+
+/*******************************************/
+/***        18. POOL STATISTICS          ***/
+/*******************************************/
+
+static void test_pool_scenario39(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pool_stats_t stats;
+
+    /*
+     * Scenario 39:
+     *
+     * 1. A new pool is one gap, nothing is fragmented or counted yet.
+     * 2. Allocate 100, 1000, 10000, 100000, deallocate 1000 and 100000.
+     *    Gaps of 1000 and 988900, the peak was 111100.
+     * 3. An allocation larger than the pool fails and is counted.
+     *    A reallocation that moves counts as neither an allocation nor a free.
+     * 4. Deallocate the rest. One gap again, the peak and counts stay.
+     * 5. FAST_FIT and TLSF_FIT pools of 1000 with gaps of 100 and 70 in
+     *    the same power of two and nothing else free. Taking the 100
+     *    leaves the 70 as the largest gap, giving it back restores it.
+     */
+
+    mem_pool_stats(pool, &stats);
+    assert_int_equal(stats.free_size, POOL_SIZE);
+    assert_int_equal(stats.largest_gap, POOL_SIZE);
+    assert_true(stats.fragmentation == 0.0);
+    assert_int_equal(stats.gap_classes[19], 1);
+    assert_int_equal(stats.peak_alloc_size, 0);
+    assert_int_equal(stats.allocs, 0);
+    assert_int_equal(stats.frees, 0);
+    assert_int_equal(stats.failed_allocs, 0);
+    assert_int_equal(stats.metadata_size, mem_pool_metadata(pool));
+
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    void *alloc1 = mem_new_alloc(pool, 1000);
+    void *alloc2 = mem_new_alloc(pool, 10000);
+    void *alloc3 = mem_new_alloc(pool, 100000);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_non_null(alloc2);
+    assert_non_null(alloc3);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc3);
+    assert_int_equal(status, ALLOC_OK);
+
+    mem_pool_stats(pool, &stats);
+    assert_int_equal(stats.free_size, 989900);
+    assert_int_equal(stats.largest_gap, 988900);
+    assert_true(stats.fragmentation == 1.0 - (double) 988900 / (double) 989900);
+    assert_int_equal(stats.gap_classes[9], 1);
+    assert_int_equal(stats.gap_classes[19], 1);
+    assert_int_equal(stats.peak_alloc_size, 111100);
+    assert_int_equal(stats.allocs, 4);
+    assert_int_equal(stats.frees, 2);
+
+
+    assert_null(mem_new_alloc(pool, 2 * POOL_SIZE));
+    mem_pool_stats(pool, &stats);
+    assert_int_equal(stats.failed_allocs, 1);
+    assert_int_equal(stats.allocs, 4);
+    alloc0 = mem_realloc_alloc(pool, alloc0, 20000);
+    assert_non_null(alloc0);
+    mem_pool_stats(pool, &stats);
+    assert_int_equal(stats.allocs, 4);
+    assert_int_equal(stats.frees, 2);
+
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+    mem_pool_stats(pool, &stats);
+    assert_int_equal(stats.free_size, POOL_SIZE);
+    assert_int_equal(stats.largest_gap, POOL_SIZE);
+    assert_true(stats.fragmentation == 0.0);
+    assert_int_equal(stats.gap_classes[9], 0);
+    assert_int_equal(stats.gap_classes[19], 1);
+    assert_int_equal(stats.peak_alloc_size, 111100);
+    assert_int_equal(stats.allocs, 4);
+    assert_int_equal(stats.frees, 4);
+
+
+    const alloc_policy policies[2] = { FAST_FIT, TLSF_FIT };
+    for(unsigned i = 0; i < 2; i++){
+        pool_pt small = mem_pool_open(1000, policies[i]);
+        assert_non_null(small);
+        void *gap0 = mem_new_alloc(small, 100);
+        void *sep = mem_new_alloc(small, 10);
+        void *gap1 = mem_new_alloc(small, 70);
+        void *rest = mem_new_alloc(small, 820);
+        assert_non_null(gap0);
+        assert_non_null(sep);
+        assert_non_null(gap1);
+        assert_non_null(rest);
+        assert_int_equal(mem_del_alloc(small, gap1), ALLOC_OK);
+        assert_int_equal(mem_del_alloc(small, gap0), ALLOC_OK);
+        mem_pool_stats(small, &stats);
+        assert_int_equal(stats.largest_gap, 100);
+
+        gap0 = mem_new_alloc(small, 100);
+        assert_non_null(gap0);
+        mem_pool_stats(small, &stats);
+        assert_int_equal(stats.free_size, 70);
+        assert_int_equal(stats.largest_gap, 70);
+        assert_true(stats.fragmentation == 0.0);
+
+        assert_int_equal(mem_del_alloc(small, gap0), ALLOC_OK);
+        mem_pool_stats(small, &stats);
+        assert_int_equal(stats.free_size, 170);
+        assert_int_equal(stats.largest_gap, 100);
+
+        assert_int_equal(mem_del_alloc(small, sep), ALLOC_OK);
+        assert_int_equal(mem_del_alloc(small, rest), ALLOC_OK);
+        assert_int_equal(mem_pool_close(small), ALLOC_OK);
+    }
+}
+
+/*******************************************/
+/***        19. TRACING                  ***/
+/*******************************************/
+
+static void test_pool_scenario40(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/mem_pool_test_%ld.trace", (long) getpid());
+
+    /*
+     * Scenario 40:
+     *
+     * 1. Start tracing. The pool is already open, the trace opens it.
+     * 2. Allocate 100 and 200, reallocate the 100 to 300, deallocate both.
+     *    An allocation larger than the pool fails and is traced without a handle.
+     * 3. Dump the trace and stop. Tracing again after a stop starts afresh.
+     * 4. Read the trace back: a header and the six events, in order.
+     */
+
+    status = mem_trace_start(16);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_trace_start(16);
+    assert_int_equal(status, ALLOC_CALLED_AGAIN);
+
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    void *alloc1 = mem_new_alloc(pool, 200);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    void *alloc2 = mem_realloc_alloc(pool, alloc0, 300);
+    assert_non_null(alloc2);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+    assert_null(mem_new_alloc(pool, 2 * POOL_SIZE));
+
+
+    status = mem_trace_dump(path);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_trace_stop();
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_trace_stop();
+    assert_int_equal(status, ALLOC_CALLED_AGAIN);
+    status = mem_trace_dump(path);
+    assert_int_equal(status, ALLOC_FAIL);
+
+
+    trace_header_t header;
+    trace_event_t events[8];
+    FILE *file = fopen(path, "rb");
+    assert_non_null(file);
+    assert_int_equal(fread(&header, sizeof(header), 1, file), 1);
+    assert_int_equal(fread(events, sizeof(trace_event_t), 8, file), 7);
+    fclose(file);
+    unlink(path);
+
+    assert_memory_equal(header.magic, "MEMTRACE", 8);
+    assert_int_equal(header.version, 1);
+    assert_int_equal(header.event_size, sizeof(trace_event_t));
+    assert_int_equal(header.num_events, 7);
+
+    assert_int_equal(events[0].op, TRACE_OPEN);
+    assert_int_equal(events[0].size, POOL_SIZE);
+    assert_int_equal(events[0].arg, BEST_FIT);
+    assert_int_equal(events[1].op, TRACE_ALLOC);
+    assert_int_equal(events[1].handle, (uintptr_t) alloc0);
+    assert_int_equal(events[1].size, 100);
+    assert_int_equal(events[2].op, TRACE_ALLOC);
+    assert_int_equal(events[2].handle, (uintptr_t) alloc1);
+    assert_int_equal(events[3].op, TRACE_REALLOC);
+    assert_int_equal(events[3].handle, (uintptr_t) alloc2);
+    assert_int_equal(events[3].arg, (uintptr_t) alloc0);
+    assert_int_equal(events[3].size, 300);
+    assert_int_equal(events[4].op, TRACE_FREE);
+    assert_int_equal(events[4].handle, (uintptr_t) alloc1);
+    assert_int_equal(events[5].op, TRACE_FREE);
+    assert_int_equal(events[5].handle, (uintptr_t) alloc2);
+    assert_int_equal(events[6].op, TRACE_ALLOC);
+    assert_int_equal(events[6].handle, 0);
+    assert_int_equal(events[6].size, 2 * POOL_SIZE);
+    for(unsigned i = 0; i < 7; i++)
+    {
+        assert_int_equal(events[i].pool, events[0].pool);
+        assert_int_equal(events[i].thread, 0);
+        if(i > 0)
+        {
+            assert_true(events[i].time_ns >= events[i - 1].time_ns);
+        }
+    }
+}
+
+/*******************************************/
+/***        20. SEGMENT WALKS            ***/
+/*******************************************/
+
+static int count_gaps_visitor(const pool_segment_t *segment, void *arg) {
+    if(!segment->allocated)
+    {
+        (*(unsigned *) arg)++;
+    }
+    return 0;
+}
+
+static int first_gap_visitor(const pool_segment_t *segment, void *arg) {
+    (void) arg; /* unused */
+    return !segment->allocated;
+}
+
+static void test_pool_scenario41(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    pool_segment_t segments[8];
+    pool_segment_pt inspected = NULL;
+    unsigned num_inspected = 0;
+
+    /*
+     * Scenario 41:
+     *
+     * 1. Allocate 100, 200, 300, deallocate the 200.
+     *    The walks and mem_inspect_pool agree on four segments.
+     * 2. A buffer too small holds the first segments, all are counted.
+     * 3. A visitor counts the gaps, another stops at the first one.
+     * 4. In a slab pool of 8 slots, allocate 4, deallocate the 4th and
+     *    the 2nd. The walk sees them in address order and leaves the free
+     *    list as it was, so the next allocation is the 2nd slot again.
+     */
+
+    void *alloc0 = mem_new_alloc(pool, 100);
+    void *alloc1 = mem_new_alloc(pool, 200);
+    void *alloc2 = mem_new_alloc(pool, 300);
+    assert_non_null(alloc0);
+    assert_non_null(alloc1);
+    assert_non_null(alloc2);
+    status = mem_del_alloc(pool, alloc1);
+    assert_int_equal(status, ALLOC_OK);
+
+    const pool_segment_t expected[4] = {
+            {100, 1}, {200, 0}, {300, 1}, {POOL_SIZE - 600, 0}
+    };
+    assert_int_equal(mem_inspect_pool_into(pool, segments, 8), 4);
+    mem_inspect_pool(pool, &inspected, &num_inspected);
+    assert_int_equal(num_inspected, 4);
+    for(unsigned i = 0; i < 4; i++)
+    {
+        assert_int_equal(segments[i].size, expected[i].size);
+        assert_int_equal(segments[i].allocated, expected[i].allocated);
+        assert_int_equal(inspected[i].size, expected[i].size);
+        assert_int_equal(inspected[i].allocated, expected[i].allocated);
+    }
+    free(inspected);
+
+
+    memset(segments, 0, sizeof(segments));
+    assert_int_equal(mem_inspect_pool_into(pool, segments, 2), 4);
+    assert_int_equal(segments[1].size, 200);
+    assert_int_equal(segments[2].size, 0);
+
+
+    unsigned gaps = 0;
+    assert_int_equal(mem_inspect_pool_visit(pool, count_gaps_visitor, &gaps), 4);
+    assert_int_equal(gaps, 2);
+    assert_int_equal(mem_inspect_pool_visit(pool, first_gap_visitor, NULL), 2);
+
+    status = mem_del_alloc(pool, alloc0);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, alloc2);
+    assert_int_equal(status, ALLOC_OK);
+
+
+    pool_pt slab = mem_slab_open(24, 8);
+    assert_non_null(slab);
+    void *slots[4];
+    for(unsigned i = 0; i < 4; i++)
+    {
+        slots[i] = mem_new_alloc(slab, 24);
+        assert_non_null(slots[i]);
+    }
+    status = mem_del_alloc(slab, slots[3]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(slab, slots[1]);
+    assert_int_equal(status, ALLOC_OK);
+
+    const unsigned long slab_expected[8] = { 1, 0, 1, 0, 0, 0, 0, 0 };
+    assert_int_equal(mem_inspect_pool_into(slab, segments, 8), 8);
+    for(unsigned i = 0; i < 8; i++)
+    {
+        assert_int_equal(segments[i].size, 24);
+        assert_int_equal(segments[i].allocated, slab_expected[i]);
+    }
+    void *again = mem_new_alloc(slab, 24);
+    assert_ptr_equal(again, slots[1]);
+
+    status = mem_del_alloc(slab, again);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(slab, slots[2]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(slab, slots[0]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_close(slab);
+    assert_int_equal(status, ALLOC_OK);
+}
+
+/*******************************************/
+/***        21. COMPACTION               ***/
+/*******************************************/
+
+static void test_pool_scenario42(void **state) {
+    alloc_status status;
+    pool_pt pool = *state;
+    void *allocs[8];
+
+    /*
+     * Scenario 42:
+     *
+     * 1. Allocate 8 x 100, each filled with its index, deallocate the
+     *    even ones. There is a gap before each allocation left.
+     * 2. Compact with a budget of 150. One allocation moves, the next
+     *    would overrun the budget, so there is more to do.
+     * 3. Compact with no budget, carrying on from where the last call
+     *    stopped. The allocations are packed at the start of the pool with
+     *    their contents, followed by one gap.
+     * 4. Allocate 64 aligned at 4096. Deallocate the first allocation and
+     *    compact. The others move down, the aligned one stays put, as the
+     *    gap before it does not start at a multiple of 4096.
+     * 5. Deallocate the first allocation, compact with a budget of 100.
+     *    One moves, leaving a gap before the last. Deallocate the one that
+     *    moved, before where compaction stopped, and compact again. It
+     *    starts over, and the last allocation moves to the start.
+     * 6. Compacting a slab pool fails. Deallocate all.
+     */
+
+    for(unsigned i = 0; i < 8; i++)
+    {
+        allocs[i] = mem_new_alloc(pool, 100);
+        assert_non_null(allocs[i]);
+        memset(node_mem(pool, allocs[i]), (int) i, 100);
+    }
+    for(unsigned i = 0; i < 8; i += 2)
+    {
+        status = mem_del_alloc(pool, allocs[i]);
+        assert_int_equal(status, ALLOC_OK);
+    }
+
+
+    status = mem_pool_compact(pool, 150);
+    assert_int_equal(status, ALLOC_CALLED_AGAIN);
+    assert_ptr_equal(node_mem(pool, allocs[1]), pool->mem);
+
+    pool_segment_t exp0[8] =
+            {
+                    {100, 1},
+                    {200, 0},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {100, 0},
+                    {100, 1},
+                    {POOL_SIZE - 800, 0}
+            };
+    check_pool(pool, exp0);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 400, 4, 4);
+
+
+    status = mem_pool_compact(pool, 0);
+    assert_int_equal(status, ALLOC_OK);
+    for(unsigned i = 1; i < 8; i += 2)
+    {
+        assert_ptr_equal(node_mem(pool, allocs[i]), pool->mem + 100 * (i / 2));
+        for(unsigned j = 0; j < 100; j++)
+        {
+            assert_int_equal((unsigned char) node_mem(pool, allocs[i])[j], i);
+        }
+    }
+
+    pool_segment_t exp1[5] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {POOL_SIZE - 400, 0}
+            };
+    check_pool(pool, exp1);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 400, 4, 1);
+    assert_int_equal(mem_pool_compact(pool, 0), ALLOC_OK);
+
+
+    void *aligned = mem_new_alloc_aligned(pool, 64, 4096);
+    assert_non_null(aligned);
+    size_t at = (size_t) (node_mem(pool, aligned) - pool->mem);
+    assert_int_equal((uintptr_t) node_mem(pool, aligned) % 4096, 0);
+    status = mem_del_alloc(pool, allocs[1]);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_pool_compact(pool, 0);
+    assert_int_equal(status, ALLOC_OK);
+    assert_ptr_equal(node_mem(pool, allocs[3]), pool->mem);
+    assert_ptr_equal(node_mem(pool, allocs[7]), pool->mem + 200);
+    assert_int_equal((unsigned char) node_mem(pool, allocs[7])[99], 7);
+    assert_ptr_equal(node_mem(pool, aligned), pool->mem + at);
+
+    pool_segment_t exp2[6] =
+            {
+                    {100, 1},
+                    {100, 1},
+                    {100, 1},
+                    {at - 300, 0},
+                    {64, 1},
+                    {POOL_SIZE - at - 64, 0}
+            };
+    check_pool(pool, exp2);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 364, 4, 2);
+
+
+    status = mem_del_alloc(pool, allocs[3]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_compact(pool, 100);
+    assert_int_equal(status, ALLOC_CALLED_AGAIN);
+    assert_ptr_equal(node_mem(pool, allocs[5]), pool->mem);
+    assert_ptr_equal(node_mem(pool, allocs[7]), pool->mem + 200);
+
+    status = mem_del_alloc(pool, allocs[5]);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_pool_compact(pool, 0);
+    assert_int_equal(status, ALLOC_OK);
+    assert_ptr_equal(node_mem(pool, allocs[7]), pool->mem);
+    assert_int_equal((unsigned char) node_mem(pool, allocs[7])[99], 7);
+
+    pool_segment_t exp3[4] =
+            {
+                    {100, 1},
+                    {at - 100, 0},
+                    {64, 1},
+                    {POOL_SIZE - at - 64, 0}
+            };
+    check_pool(pool, exp3);
+    check_metadata(pool, BEST_FIT, POOL_SIZE, 164, 2, 2);
+
+
+    pool_pt slab = mem_slab_open(24, 8);
+    assert_non_null(slab);
+    assert_int_equal(mem_pool_compact(slab, 0), ALLOC_FAIL);
+    status = mem_pool_close(slab);
+    assert_int_equal(status, ALLOC_OK);
+
+    status = mem_del_alloc(pool, aligned);
+    assert_int_equal(status, ALLOC_OK);
+    status = mem_del_alloc(pool, allocs[7]);
+    assert_int_equal(status, ALLOC_OK);
+}
+
+/*******************************************/
+/***        22. STRESS TESTING           ***/
+/*******************************************/
+
+void test_pool_stresstest0(void **state) {
+    (void) state; /* unused */
+
+    const unsigned num_pools = 200;
+    const unsigned num_allocations = 1000;
+    const unsigned min_alloc_size = 10;
+    const unsigned pool_size =
+            (num_allocations / 2) *
+            (2 * min_alloc_size + (num_allocations - 1) * min_alloc_size);
+    assert_int_equal(pool_size, 5005000);
+
+
+    pool_pt pools[num_pools];
+    void *allocations[num_pools][num_allocations];
+
+    /*
+     * Testing dynamic reallocation of pool structures:
+     *
+     * 1. 200 pools of 5005000 each (many pools)
+     * 2. In each pool 1000 allocations of different sizes (many allocations)
+     * 3. In each pool 500 deallocations (many gaps)
+     */
+
+    // initialize store
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    // allocate pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // open pool
+        pools[pix] =
+                mem_pool_open(pool_size, (pix % 2) ? FIRST_FIT : BEST_FIT);
+        assert_non_null(pools[pix]);
+        // allocate pool
+        unsigned allocated = 0;
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            allocations[pix][aix] =
+                    mem_new_alloc(pools[pix], (aix + 1) * min_alloc_size);
+            allocated += (aix + 1) * min_alloc_size;
+            if (!allocations[pix][aix]) {
+                INFO("ASSERT WILL FAIL at pix = %u, aix = %u, allocated = %u\n", pix, aix, allocated);
+            }
+            assert_non_null(allocations[pix][aix]);
+        }
+
+        // delete every other allocation
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (aix % 2) {
+                assert_int_equal(
+                        mem_del_alloc(pools[pix], allocations[pix][aix]),
+                        ALLOC_OK);
+                allocations[pix][aix] = NULL;
+            }
+        }
+    }
+
+    // delete pools
+    for (unsigned pix=0; pix < num_pools; ++pix) {
+        // delete pool's allocations
+        for (unsigned aix=0; aix < num_allocations; ++aix) {
+            if (allocations[pix][aix]) {
+                // delete allocation
+                assert_int_equal(
+                        mem_del_alloc(pools[pix], allocations[pix][aix]),
+                        ALLOC_OK);
+            }
+        }
+        // close pool
+        assert_int_equal(mem_pool_close(pools[pix]), ALLOC_OK);
+    }
+
+    // free store
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*
+ * Workers of test_pool_stresstest1. cmocka asserts are not thread-safe,
+ * so each worker counts its failures and the test asserts on the counts.
+ */
+#define STRESS1_NUM_THREADS     8
+#define STRESS1_NUM_ROUNDS      50
+#define STRESS1_NUM_ALLOCS      64
+
+typedef struct _stress1_arg {
+    pool_pt shared[2];
+    unsigned id;
+    unsigned failures;
+} stress1_arg_t;
+
+static void *stress1_worker(void *arg) {
+    stress1_arg_t *sa = arg;
+    void *allocs[STRESS1_NUM_ALLOCS];
+
+    for (unsigned round = 0; round < STRESS1_NUM_ROUNDS; ++round) {
+        // a private pool, opened and closed while the others do the same
+        pool_pt own = mem_pool_open(100000, (round % 2) ? FIRST_FIT : BEST_FIT);
+        if (!own) {
+            sa->failures++;
+            continue;
+        }
+        for (unsigned aix = 0; aix < STRESS1_NUM_ALLOCS; ++aix) {
+            allocs[aix] = mem_new_alloc(own, 16 + aix);
+            if (!allocs[aix])
+                sa->failures++;
+        }
+        for (unsigned aix = 0; aix < STRESS1_NUM_ALLOCS; ++aix) {
+            if (allocs[aix] && mem_del_alloc(own, allocs[aix]) != ALLOC_OK)
+                sa->failures++;
+        }
+        if (mem_pool_close(own) != ALLOC_OK)
+            sa->failures++;
+
+        // the shared pools, each allocation stamped with the worker id
+        // (TAGGED_FIT hands out addresses, so the stamps can be checked)
+        for (unsigned pix = 0; pix < 2; ++pix) {
+            for (unsigned aix = 0; aix < STRESS1_NUM_ALLOCS; ++aix) {
+                allocs[aix] = mem_new_alloc(sa->shared[pix], 8 + (aix * 7 + sa->id) % 200);
+                if (!allocs[aix])
+                    sa->failures++;
+                else if (pix == 1)
+                    memset(allocs[aix], (int) sa->id, 8);
+            }
+            for (unsigned aix = 0; aix < STRESS1_NUM_ALLOCS; ++aix) {
+                if (!allocs[aix])
+                    continue;
+                if (pix == 1) {
+                    unsigned char expected[8];
+                    memset(expected, (int) sa->id, 8);
+                    if (memcmp(allocs[aix], expected, 8) != 0)
+                        sa->failures++;
+                }
+                if (mem_del_alloc(sa->shared[pix], allocs[aix]) != ALLOC_OK)
+                    sa->failures++;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+void test_pool_stresstest1(void **state) {
+    (void) state; /* unused */
+
+    pthread_t threads[STRESS1_NUM_THREADS];
+    stress1_arg_t args[STRESS1_NUM_THREADS];
+
+    /*
+     * Testing concurrent use of the library:
+     *
+     * 1. 8 threads, each opening and closing private pools (pool store)
+     * 2. All threads allocating and deallocating in two shared pools,
+     *    BEST_FIT and TAGGED_FIT (per-pool locking)
+     * 3. Shared pools back to one gap each at the end
+     */
+
+    // initialize store
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    pool_pt shared_bf = mem_pool_open(1000000, BEST_FIT);
+    assert_non_null(shared_bf);
+    pool_pt shared_tf = mem_pool_open(1000000, TAGGED_FIT);
+    assert_non_null(shared_tf);
+
+    for (unsigned tix = 0; tix < STRESS1_NUM_THREADS; ++tix) {
+        args[tix].shared[0] = shared_bf;
+        args[tix].shared[1] = shared_tf;
+        args[tix].id = tix + 1;
+        args[tix].failures = 0;
+        assert_int_equal(pthread_create(&threads[tix], NULL, stress1_worker, &args[tix]), 0);
+    }
+    for (unsigned tix = 0; tix < STRESS1_NUM_THREADS; ++tix) {
+        assert_int_equal(pthread_join(threads[tix], NULL), 0);
+        assert_int_equal(args[tix].failures, 0);
+    }
+
+    // shared pools back to one gap each
+    assert_int_equal(shared_bf->num_allocs, 0);
+    assert_int_equal(shared_bf->num_gaps, 1);
+    assert_int_equal(shared_tf->num_allocs, 0);
+    assert_int_equal(shared_tf->num_gaps, 1);
+
+    // close pools and free store
+    assert_int_equal(mem_pool_close(shared_bf), ALLOC_OK);
+    assert_int_equal(mem_pool_close(shared_tf), ALLOC_OK);
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+/*
+ * Producer and consumer of test_pool_stresstest3, passing allocations
+ * through a single-producer single-consumer ring.
+ */
+#define STRESS3_NUM_MESSAGES    200000
+#define STRESS3_RING_SIZE       64
+
+typedef struct _stress3_ring {
+    pool_pt pool;
+    void *slots[STRESS3_RING_SIZE];
+    _Atomic unsigned long head, tail;
+    unsigned failures;
+} stress3_ring_t;
+
+static void *stress3_producer(void *arg) {
+    stress3_ring_t *ring = arg;
+
+    for (unsigned long m = 0; m < STRESS3_NUM_MESSAGES; ++m) {
+        void *msg;
+        while ((msg = mem_new_alloc(ring->pool, sizeof(unsigned long))) == NULL)
+            ; // the consumer has not freed any yet
+        *(unsigned long *) msg = m;
+
+        unsigned long tail = atomic_load(&ring->tail);
+        while (tail - atomic_load(&ring->head) == STRESS3_RING_SIZE)
+            ;
+        ring->slots[tail % STRESS3_RING_SIZE] = msg;
+        atomic_store(&ring->tail, tail + 1);
+    }
+
+    return NULL;
+}
+
+static void *stress3_consumer(void *arg) {
+    stress3_ring_t *ring = arg;
+
+    for (unsigned long m = 0; m < STRESS3_NUM_MESSAGES; ++m) {
+        unsigned long head = atomic_load(&ring->head);
+        while (atomic_load(&ring->tail) == head)
+            ;
+        void *msg = ring->slots[head % STRESS3_RING_SIZE];
+        atomic_store(&ring->head, head + 1);
+
+        if (*(unsigned long *) msg != m)
+            ring->failures++;
+        if (mem_del_alloc(ring->pool, msg) != ALLOC_OK)
+            ring->failures++;
+    }
+
+    return NULL;
+}
+
+void test_pool_stresstest3(void **state) {
+    (void) state; /* unused */
+
+    pthread_t producer, consumer;
+    stress3_ring_t ring;
+
+    /*
+     * Testing the lock-free slab with cross-thread frees:
+     *
+     * 1. A producer allocates messages from an ATOMIC_SLAB_FIT pool
+     *    smaller than the ring, a consumer frees them
+     * 2. Every message arrives intact, the slab is back to all free
+     */
+
+    // initialize store
+    assert_int_equal(mem_init(), ALLOC_OK);
+
+    ring.pool = mem_atomic_slab_open(sizeof(unsigned long), STRESS3_RING_SIZE / 2);
+    assert_non_null(ring.pool);
+    atomic_init(&ring.head, 0);
+    atomic_init(&ring.tail, 0);
+    ring.failures = 0;
+
+    assert_int_equal(pthread_create(&producer, NULL, stress3_producer, &ring), 0);
+    assert_int_equal(pthread_create(&consumer, NULL, stress3_consumer, &ring), 0);
+    assert_int_equal(pthread_join(producer, NULL), 0);
+    assert_int_equal(pthread_join(consumer, NULL), 0);
+    assert_int_equal(ring.failures, 0);
+
+    assert_int_equal(ring.pool->num_allocs, 0);
+    assert_int_equal(ring.pool->num_gaps, STRESS3_RING_SIZE / 2);
+
+    // close pool and free store
+    assert_int_equal(mem_pool_close(ring.pool), ALLOC_OK);
+    assert_int_equal(mem_free(), ALLOC_OK);
+}
+
+
+/*******************************************/
+/***        23. DRIVER ROUTINE           ***/
+/*******************************************/
+
+int run_test_suite() {
+    const struct CMUnitTest tests[] = {
+            // General tests
+            cmocka_unit_test(test_pool_store_smoketest),
+            cmocka_unit_test(test_pool_smoketest),
+
+            cmocka_unit_test(test_pool_nonempty),
+            cmocka_unit_test(test_pool_bad_handles),
+
+            cmocka_unit_test_setup_teardown(test_pool_ff_metadata, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_bf_metadata, pool_bf_setup, pool_bf_teardown),
+
+            // First-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_ff_setup, pool_ff_teardown),
+
+            // Best-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario13, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_bf_setup, pool_bf_teardown),
+
+            // Fast-fit tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario20, pool_fast_setup, pool_fast_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario21, pool_fast_setup, pool_fast_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario22, pool_fast_setup, pool_fast_teardown),
+
+            // TLSF tests (the scenarios whose layouts do not depend on the policy)
+            cmocka_unit_test_setup_teardown(test_pool_scenario00, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario01, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario02, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario03, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario04, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario05, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario06, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario07, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario08, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario09, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario10, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario11, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario12, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario14, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario15, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario16, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario17, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario18, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario19, pool_tlsf_setup, pool_tlsf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario23, pool_tlsf_setup, pool_tlsf_teardown),
+
+            // Buddy tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario24, pool_buddy_setup, pool_buddy_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario25, pool_buddy_setup, pool_buddy_teardown),
+
+            // Slab tests
+            cmocka_unit_test(test_slab_smoketest),
+            cmocka_unit_test_setup_teardown(test_slab_scenario00, slab_setup, slab_teardown),
+            cmocka_unit_test_setup_teardown(test_atomic_slab_scenario00, atomic_slab_setup, slab_teardown),
+
+            // Tagged tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario26, pool_tagged_setup, pool_tagged_teardown),
+
+            // Thread cache tests
+            cmocka_unit_test_setup_teardown(test_pool_cache, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test(test_pool_stresstest2),
+
+            // Batch tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario27, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario28, pool_bf_setup, pool_bf_teardown),
+
+            // Reallocation tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario29, pool_bf_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario30, pool_ff_setup, pool_ff_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario31, pool_tagged_setup, pool_tagged_teardown),
+
+            // Aligned tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario32, pool_aligned_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario33, pool_tagged_setup, pool_tagged_teardown),
+
+            // Mapped tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario34, pool_mapped_setup, pool_bf_teardown),
+            cmocka_unit_test_setup_teardown(test_pool_scenario35, pool_huge_setup, pool_bf_teardown),
+
+            // Growable tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario36, pool_growable_setup, pool_bf_teardown),
+
+            // Persistent tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario37, pool_persistent_setup, pool_persistent_teardown),
+
+            // Shared tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario38, pool_shared_setup, pool_shared_teardown),
+
+            // Statistics tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario39, pool_bf_setup, pool_bf_teardown),
+
+            // Tracing tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario40, pool_bf_setup, pool_bf_teardown),
+
+            // Segment walk tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario41, pool_ff_setup, pool_ff_teardown),
+
+            // Compaction tests
+            cmocka_unit_test_setup_teardown(test_pool_scenario42, pool_bf_setup, pool_bf_teardown),
 
             // Stress tests
             cmocka_unit_test(test_pool_stresstest0),
+            cmocka_unit_test(test_pool_stresstest1),
+            cmocka_unit_test(test_pool_stresstest3),
     };
 
     return cmocka_run_group_tests_name("pool_test_suite", tests, NULL, NULL);